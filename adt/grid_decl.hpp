@@ -1,13 +1,84 @@
 #ifndef ADT_GRID_DECL_HPP
 #define ADT_GRID_DECL_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
 
 namespace adt {
 
 template <typename C, typename T, std::size_t D> class grid;
 template <typename C, typename T, std::size_t D>
 void swap(grid<C, T, D> &x, grid<C, T, D> &y);
+
+namespace detail {
+// Grids pad their leading dimension so that rows start at multiples of
+// this many bytes (a cache line, which is a multiple of the SIMD width)
+// from the start of their storage
+constexpr std::size_t grid_alignment = 64;
+
+// How the container C of a grid stores its elements of type T.
+// Containers that store each field of their elements separately (see
+// adt::soa) specialize this.
+template <typename C, typename T> struct grid_storage {
+  // Rows are padded to align elements of this size
+  static constexpr std::size_t elem_size = sizeof(T);
+  // Whether each field is stored separately, so that fun::simd_stencil
+  // loads packs from the columns of the fields (see adt::soa) instead
+  // of from consecutive elements
+  typedef std::false_type structure_of_arrays;
+};
+
+inline std::atomic<std::size_t> &grid_tile_bytes() {
+  static std::atomic<std::size_t> bytes{0};
+  return bytes;
+}
+} // namespace detail
+
+// An allocator that aligns storage to detail::grid_alignment bytes.
+// std::allocator guarantees only the alignment of max_align_t; with
+// this allocator (e.g. adt::grid<std::vector<adt::dummy,
+// adt::grid_allocator<adt::dummy>>, T, D>) the padded rows of a grid
+// also start at aligned addresses.
+template <typename T> struct grid_allocator {
+  typedef T value_type;
+  template <typename U> struct rebind { typedef grid_allocator<U> other; };
+
+  grid_allocator() noexcept {}
+  template <typename U> grid_allocator(const grid_allocator<U> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    void *ptr = nullptr;
+    if (n > std::size_t(-1) / sizeof(T) ||
+        posix_memalign(&ptr, std::max(detail::grid_alignment, alignof(T)),
+                       n * sizeof(T)))
+      throw std::bad_alloc();
+    return static_cast<T *>(ptr);
+  }
+  void deallocate(T *ptr, std::size_t n) noexcept { std::free(ptr); }
+};
+template <typename T, typename U>
+bool operator==(const grid_allocator<T> &, const grid_allocator<U> &) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const grid_allocator<T> &, const grid_allocator<U> &) {
+  return false;
+}
+
+// Stencils traverse multi-dimensional grids in columns: they block
+// all but the outermost dimension into tiles of about this many bytes
+// per plane, and stream through the outermost dimension, so that the
+// neighbouring planes are reused from cache. Pointwise operations are
+// not tiled since they reuse nothing. 0 (the default) disables tiling;
+// funhpc::hwloc sets this from FUNHPC_GRID_TILE_BYTES at startup.
+inline std::size_t get_grid_tile_bytes() { return detail::grid_tile_bytes(); }
+inline void set_grid_tile_bytes(std::size_t bytes) {
+  detail::grid_tile_bytes() = bytes;
+}
 } // namespace adt
 
 #define ADT_GRID_DECL_HPP_DONE
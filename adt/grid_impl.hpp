@@ -8,10 +8,12 @@
 #include <cxx/cstdlib.hpp>
 #include <cxx/invoke.hpp>
 #include <fun/fun_decl.hpp>
+#include <fun/simd_stencil.hpp>
 
 #include <cereal/access.hpp>
 
 #include <algorithm>
+#include <array>
 #include <type_traits>
 #include <utility>
 
@@ -19,6 +21,27 @@ namespace adt {
 
 namespace detail {
 
+// The largest r with r^k <= n (for n >= 1)
+inline std::ptrdiff_t int_root(std::ptrdiff_t n, std::size_t k) {
+  auto pow = [k](std::ptrdiff_t r) {
+    std::ptrdiff_t p = 1;
+    for (std::size_t j = 0; j < k; ++j)
+      p *= r;
+    return p;
+  };
+  std::ptrdiff_t r = 1;
+  while (pow(2 * r) <= n)
+    r *= 2;
+  for (std::ptrdiff_t step = r / 2; step > 0; step /= 2)
+    if (pow(r + step) <= n)
+      r += step;
+  return r;
+}
+
+// Rows whose length is a multiple of this many bytes map to the same
+// cache sets; such rows are padded further
+constexpr std::size_t grid_aliasing_stride = 4096;
+
 template <std::size_t D> class index_space {
 public:
   typedef adt::index_t<D> index_type;
@@ -26,19 +49,19 @@ public:
 private:
   index_type m_shape;
   std::ptrdiff_t m_offset;
-  // TODO: Make boundaries be the same type as the domain. This
-  // ensures that the stride of dimension 0 is always 1, which is much
-  // more efficient.
-  // TODO: Do this only for grid?
-  std::ptrdiff_t m_stride0;
+  // The stride of dimension 0 is always 1 and is not stored, so that
+  // the compiler can vectorize the innermost loops. Boundaries in
+  // dimension 0 would be strided; these are accessed via a
+  // strided_view and copied instead.
   index_type m_stride;
   std::ptrdiff_t m_allocated;
 
   template <std::size_t D1> friend class index_space;
+  template <std::size_t D1> friend class strided_view;
 
   friend class cereal::access;
   template <typename Archive> void serialize(Archive &ar) {
-    ar(m_shape, m_offset, m_stride0, m_stride, m_allocated);
+    ar(m_shape, m_offset, m_stride, m_allocated);
   }
 
   static constexpr index_type origin() noexcept {
@@ -59,8 +82,7 @@ private:
   }
 
   // Note: The stride for dimension 0 is always 1, and is not stored.
-  // (NOTE: Not any more; see above!) Instead, we store the total
-  // number of points.
+  // Instead, we store the total number of points.
   static index_type make_stride(const index_type &shape) {
     index_type stride;
     std::ptrdiff_t i = 1;
@@ -76,6 +98,27 @@ private:
     return adt::prod(shape);
   }
 
+  static index_type make_padded_allocated(const index_type &shape,
+                                          std::size_t elem_size,
+                                          std::size_t max_size) {
+    // There is only a single row for D < 2. Padding only the leading
+    // dimension keeps the overhead small, and we pad only if this
+    // wastes at most a quarter of the memory.
+    if (D < 2 || elem_size == 0 || grid_alignment % elem_size != 0)
+      return shape;
+    const std::ptrdiff_t align = grid_alignment / elem_size;
+    if (shape[0] < 4 * align)
+      return shape;
+    auto allocated = shape;
+    allocated[0] = cxx::align_ceil(shape[0], align);
+    if (allocated[0] * elem_size % grid_aliasing_stride == 0)
+      allocated[0] += align;
+    // Respect the container's maximum size
+    if (std::size_t(adt::prod(allocated)) > max_size)
+      return shape;
+    return allocated;
+  }
+
 public:
   bool invariant() const noexcept {
     if (adt::any(adt::lt(m_shape, 0)))
@@ -85,8 +128,6 @@ public:
     auto off = offset();
     if (adt::any(adt::lt(off, 0)))
       return false;
-    if (m_stride0 < 0)
-      return false;
     if (adt::any(adt::lt(m_stride, 0)))
       return false;
     for (std::ptrdiff_t d = 0; d < std::ptrdiff_t(D); ++d) {
@@ -108,21 +149,29 @@ public:
   }
 
   index_space() : index_space(origin()) {}
-  // TODO: Add padding if desired
   index_space(const index_type &shape) : index_space(shape, origin(), shape) {}
+  index_space(const index_type &shape, const index_type &allocated)
+      : index_space(shape, origin(), allocated) {}
   index_space(const index_type &shape, const index_type &offset,
               const index_type &allocated)
       : m_shape(shape), m_offset(make_offset(make_stride(allocated), offset)),
-        m_stride0(1), m_stride(make_stride(allocated)),
+        m_stride(make_stride(allocated)),
         m_allocated(make_allocated(allocated)) {
     cxx_assert(invariant());
   }
 
+  // An index space with padding chosen for elements of the given size,
+  // with at most max_size elements
+  static index_space padded(const index_type &shape, std::size_t elem_size,
+                            std::size_t max_size) {
+    return index_space(shape,
+                       make_padded_allocated(shape, elem_size, max_size));
+  }
+
   void swap(index_space &other) {
     using std::swap;
     swap(m_shape, other.m_shape);
     swap(m_offset, other.m_offset);
-    swap(m_stride0, other.m_stride0);
     swap(m_stride, other.m_stride);
     swap(m_allocated, other.m_allocated);
   }
@@ -134,8 +183,7 @@ public:
   std::ptrdiff_t stride(std::ptrdiff_t d) const {
     cxx_assert(d >= 0 && d <= std::ptrdiff_t(D));
     if (d == 0)
-      return D == 0 ? /*1*/ m_stride0
-                    : std::min(/*std::ptrdiff_t(1)*/ m_stride0, m_stride[0]);
+      return 1;
     return m_stride[d - 1];
   }
   index_type offset() const {
@@ -143,7 +191,7 @@ public:
     for (std::size_t d = 0; d < D; ++d)
       r[d] = stride(d) == 0 || stride(d + 1) == 0
                  ? 0
-                 : (m_offset / stride(d)) % stride(d + 1);
+                 : (m_offset / stride(d)) % (stride(d + 1) / stride(d));
     return r;
   }
   index_type allocated() const {
@@ -165,15 +213,19 @@ public:
     return lin;
   }
 
+  // Boundaries that keep dimension 0 share the storage
+  static constexpr bool boundary_is_contiguous(std::ptrdiff_t i) noexcept {
+    return D == 0 || i / 2 > 0;
+  }
   struct boundary {};
   index_space(boundary, const index_space<D + 1> &old, std::ptrdiff_t i) {
     cxx_assert(i >= 0 && i < 2 * (std::ptrdiff_t(D) + 1));
+    cxx_assert(boundary_is_contiguous(i));
     auto f = i % 2, d = i / 2;
     m_shape = adt::rmdir(old.m_shape, d);
     auto off = old.shape() * 0;
     off[d] = !f ? 0 : old.shape()[d] - 1;
     m_offset = old.linear(off);
-    m_stride0 = d == 0 ? old.m_stride[0] : old.m_stride0;
     m_stride = adt::rmdir(old.m_stride, d == 0 ? 0 : d - 1);
     m_allocated = old.m_allocated;
     cxx_assert(invariant());
@@ -184,16 +236,19 @@ private:
   // terminating case
   template <std::ptrdiff_t d, typename F, typename... Args,
             std::enable_if_t<(d == 0)> * = nullptr>
-  void loop_impl(F &&f, const index_type &pos, Args &&... args) const {
+  static void loop_impl(const index_type &imin, const index_type &imax, F &&f,
+                        const index_type &pos, Args &&... args) {
     cxx::invoke(std::forward<F>(f), pos, std::forward<Args>(args)...);
   }
   // recursive implementation
   template <std::ptrdiff_t d, typename F, typename... Args,
             std::enable_if_t<(d > 0)> * = nullptr>
-  void loop_impl(F &&f, const index_type &pos, Args &&... args) const {
+  static void loop_impl(const index_type &imin, const index_type &imax, F &&f,
+                        const index_type &pos, Args &&... args) {
 #pragma omp simd
-    for (std::ptrdiff_t i = 0; i < std::get<d - 1>(m_shape); ++i)
-      loop_impl<d - 1>(f, update<d - 1>(pos, i), args...);
+    for (std::ptrdiff_t i = std::get<d - 1>(imin); i < std::get<d - 1>(imax);
+         ++i)
+      loop_impl<d - 1>(imin, imax, f, update<d - 1>(pos, i), args...);
   }
 
 public:
@@ -202,7 +257,57 @@ public:
   void loop(F &&f, Args &&... args) const {
     static_assert(std::is_void<cxx::invoke_of_t<F, index_type, Args...>>::value,
                   "");
-    loop_impl<D>(std::forward<F>(f), origin(), std::forward<Args>(args)...);
+    loop_impl<D>(origin(), m_shape, std::forward<F>(f), origin(),
+                 std::forward<Args>(args)...);
+  }
+
+  // A tile shape for loop_tiled, for elements of the given size and
+  // tiles of at most max_bytes bytes per plane. Tiles block the
+  // dimensions 0..D-2 and span the outermost dimension, so that a
+  // stencil streams through it while the neighbouring planes of the
+  // tile stay in cache. Tiles keep whole rows if possible, so that the
+  // innermost loops remain long, and are squares (cubes, ...) in the
+  // other blocked dimensions.
+  static index_type tile_shape(const index_type &shape, std::size_t elem_size,
+                               std::size_t max_bytes) {
+    auto tile = adt::max(shape, std::ptrdiff_t(1));
+    if (D < 2 || elem_size == 0 || max_bytes == 0)
+      return tile;
+    const std::ptrdiff_t max_elems =
+        std::max(std::size_t(1), max_bytes / elem_size);
+    if (tile[0] > max_elems) {
+      // Split rows at cache line boundaries
+      const std::ptrdiff_t align =
+          std::max(std::size_t(1), grid_alignment / elem_size);
+      tile[0] = std::max(align, cxx::align_floor(max_elems, align));
+    }
+    if (D > 2) {
+      const auto len = int_root(
+          std::max(std::ptrdiff_t(1), max_elems / tile[0]), D - 2);
+      for (std::ptrdiff_t d = 1; d < std::ptrdiff_t(D) - 1; ++d)
+        tile[d] = std::min(tile[d], len);
+    }
+    return tile;
+  }
+
+  // Cache-blocked loop: visits the same points as loop, but tile by
+  // tile, in lexicographic order within each tile. Only for loops
+  // whose iterations are independent.
+  template <typename F, typename... Args>
+  void loop_tiled(const index_type &tile, F &&f, Args &&... args) const {
+    static_assert(std::is_void<cxx::invoke_of_t<F, index_type, Args...>>::value,
+                  "");
+    cxx_assert(adt::all(adt::gt(tile, 0)));
+    if (adt::all(adt::ge(tile, m_shape)))
+      return loop(std::forward<F>(f), std::forward<Args>(args)...);
+    const auto ntiles = (m_shape + tile - 1) / tile;
+    loop_impl<D>(origin(), ntiles,
+                 [&](const index_type &t) {
+                   const auto imin = t * tile;
+                   const auto imax = adt::min(imin + tile, m_shape);
+                   loop_impl<D>(imin, imax, f, imin, args...);
+                 },
+                 origin());
   }
 
   friend std::ostream &operator<<(std::ostream &os, const index_space &is) {
@@ -210,8 +315,7 @@ public:
     for (std::ptrdiff_t d = 0; d <= std::ptrdiff_t(D); ++d)
       strides[d] = is.stride(d);
     return os << "index_space{m_shape=" << is.m_shape
-              << ",m_offset=" << is.m_offset << ",m_stride0=" << is.m_stride0
-              << ",m_stride=" << is.m_stride
+              << ",m_offset=" << is.m_offset << ",m_stride=" << is.m_stride
               << ",m_allocated=" << is.m_allocated << ";stride()=" << strides
               << ",offset()=" << is.offset() << ",allocated=" << is.allocated()
               << "}";
@@ -220,8 +324,48 @@ public:
 template <std::size_t D> void swap(index_space<D> &x, index_space<D> &y) {
   x.swap(y);
 }
+
+// A boundary in dimension 0 of an index space, where no stride is 1
+template <std::size_t D> class strided_view {
+public:
+  typedef adt::index_t<D> index_type;
+
+private:
+  index_type m_shape;
+  std::ptrdiff_t m_offset;
+  index_type m_stride;
+
+public:
+  strided_view(const index_space<D + 1> &old, std::ptrdiff_t i) {
+    cxx_assert(i >= 0 && i < 2);
+    auto f = i % 2;
+    m_shape = adt::rmdir(old.m_shape, 0);
+    auto off = old.shape() * 0;
+    off[0] = !f ? 0 : old.shape()[0] - 1;
+    m_offset = old.linear(off);
+    for (std::size_t d = 0; d < D; ++d)
+      m_stride[d] = old.stride(d + 1);
+  }
+
+  const index_type &shape() const { return m_shape; }
+
+  // Convert a position to a linear index of the underlying index space
+  std::ptrdiff_t linear(const index_type &i) const {
+    std::ptrdiff_t lin = m_offset;
+    for (std::ptrdiff_t d = 0; d < std::ptrdiff_t(D); ++d) {
+      cxx_assert(i[d] >= 0 && i[d] < m_shape[d]);
+      lin += i[d] * m_stride[d];
+    }
+    return lin;
+  }
+};
 } // namespace detail
 
+// Grids can be surrounded by layers of ghost cells in every direction,
+// stored in the same container as the cells (see fill_ghosts and
+// copy_ghosts). Stencils then read the neighbours of the boundary cells
+// from the ghost cells. Reductions, boundaries, and head and last cover
+// only the cells.
 template <typename C, typename T, std::size_t D> class grid {
 public:
   static_assert(
@@ -241,23 +385,200 @@ public:
   template <typename C1, typename T1, std::size_t D1> friend class grid;
 
 private:
+  // The index space of the cells, offset by the ghost layers
   index_space indexing;
+  std::ptrdiff_t nghosts;
   container_constructor<T> data;
 
   friend class cereal::access;
   template <typename Archive> void serialize(Archive &ar) {
     // TODO: Serialize only the accessible part of data
-    ar(indexing, data);
+    ar(indexing, nghosts, data);
+  }
+
+  // The layout of newly created grids: Padding is added on top of the
+  // ghost layers. If rows are padded, the lower ghost layers of the
+  // leading dimension are widened as well, so that the first cell of
+  // each row is aligned (see grid_allocator).
+  static index_space padded_indexing(const index_type &shape,
+                                     std::ptrdiff_t ghosts = 0) {
+    const std::size_t elem_size = detail::grid_storage<C, T>::elem_size;
+    const std::size_t max_size = fun::fun_traits<C>::max_size();
+    const auto g = adt::set<index_type>(ghosts);
+    auto lo = g;
+    if (D >= 2 && ghosts > 0 && elem_size > 0 &&
+        detail::grid_alignment % elem_size == 0)
+      lo[0] = cxx::align_ceil(
+          ghosts, std::ptrdiff_t(detail::grid_alignment / elem_size));
+    auto allocated =
+        index_space::padded(shape + lo + g, elem_size, max_size).allocated();
+    if (lo[0] != g[0] &&
+        (allocated[0] * elem_size % detail::grid_alignment != 0 ||
+         std::size_t(adt::prod(allocated)) > max_size)) {
+      // The rows are not padded; widening would align nothing
+      lo = g;
+      allocated =
+          index_space::padded(shape + g + g, elem_size, max_size).allocated();
+    }
+    return index_space(shape, lo, allocated);
+  }
+
+  // The index space of the cells together with their innermost w ghost
+  // layers
+  index_space ghost_indexing(std::ptrdiff_t w) const {
+    cxx_assert(w >= 0 && w <= nghosts);
+    if (w == 0)
+      return indexing;
+    const auto g = adt::set<index_type>(w);
+    return index_space(indexing.shape() + g + g, indexing.offset() - g,
+                       indexing.allocated());
+  }
+
+  // Call f(j) for the positions j of all ghost cells, in the index
+  // space ghost_indexing(nghosts)
+  template <typename F> void ghost_loop(const F &f) const {
+    if (nghosts == 0)
+      return;
+    const auto shape = indexing.shape();
+    for (std::size_t d = 0; d < D; ++d) {
+      // Corner cells, beyond several faces, are visited for the first
+      // such direction only
+      index_type slab, imin;
+      for (std::size_t e = 0; e < D; ++e) {
+        slab[e] = e < d ? shape[e] : shape[e] + 2 * nghosts;
+        imin[e] = e < d ? nghosts : 0;
+      }
+      slab[d] = nghosts;
+      for (std::ptrdiff_t f1 = 0; f1 < 2; ++f1) {
+        imin[d] = f1 == 0 ? 0 : shape[d] + nghosts;
+        index_space(slab).loop([&](const index_type &j) { f(imin + j); });
+      }
+    }
+  }
+
+  // Call f(j) for all positions j of the cells adjacent to face i
+  template <typename F> void face_loop(std::ptrdiff_t i, const F &f) const {
+    cxx_assert(i >= 0 && i < 2 * std::ptrdiff_t(D));
+    const std::ptrdiff_t d = i / 2;
+    index_type face = shape();
+    face[d] = 1;
+    index_space(face).loop([&](index_type j) {
+      if (i % 2 == 1)
+        j[d] = shape()[d] - 1;
+      f(j);
+    });
+  }
+
+  // Set the ghost cells of a new grid, which a stencil cannot evaluate
+  template <typename Acc> void clear_ghosts(Acc &acc) const {
+    const auto cells = ghost_indexing(nghosts);
+    ghost_loop([&](const index_type &j) { acc[cells.linear(j)] = T(); });
+  }
+
+  // The tiles for stencils creating this grid
+  index_type tile_shape() const {
+    return index_space::tile_shape(shape(), sizeof(T), get_grid_tile_bytes());
+  }
+
+  // Evaluate a stencil, calling point(i) for each cell. If f is a
+  // fun::simd_stencil, the rows are evaluated in SIMD packs instead,
+  // except for the cells adjacent to the faces in skip (see bdirs),
+  // whose neighbours are not all cells of xs.
+  template <typename Acc, typename F, typename G, typename T1,
+            typename Point, typename... Args>
+  void stencil_loop(Acc &acc, const F &f, const G &g,
+                    const grid<C, T1, D> &xs, std::size_t skip,
+                    const Point &point, const Args &... args) const {
+    if (!fun::detail::is_simd_stencil<F>::value) {
+      indexing.loop_tiled(tile_shape(), point);
+      return;
+    }
+    const index_type &shape = xs.indexing.shape();
+    std::array<std::ptrdiff_t, D> di;
+    for (std::size_t d = 0; d < D; ++d)
+      di[d] = xs.indexing.stride(d);
+    const std::ptrdiff_t ilo = skip & 1;
+    const std::ptrdiff_t ihi = shape[0] - (skip >> 1 & 1);
+    index_type rows = shape;
+    rows[0] = 1;
+    index_space(rows).loop([&](index_type i) {
+      bool simd = shape[0] > 2;
+      for (std::size_t d = 1; d < D; ++d)
+        simd &= !(skip >> (2 * d) & 1 && i[d] == 0) &&
+                !(skip >> (2 * d + 1) & 1 && i[d] == shape[d] - 1);
+      std::ptrdiff_t imin = 0;
+      if (simd) {
+        for (i[0] = 0; i[0] < ilo; ++i[0])
+          point(i);
+        i[0] = 0;
+        imin = simd_row(
+            typename detail::grid_storage<C, T1>::structure_of_arrays(), acc,
+            f, g, xs, i, ilo, ihi, di, args...);
+      }
+      for (i[0] = imin; i[0] < shape[0]; ++i[0])
+        point(i);
+    });
+  }
+
+  // Evaluate the cells imin <= i[0] < imax of the row starting at i in
+  // SIMD packs, returning the first index that has not been evaluated
+  template <typename Acc, typename F, typename G, typename T1,
+            typename... Args>
+  std::ptrdiff_t simd_row(std::false_type, Acc &acc, const F &f, const G &g,
+                          const grid<C, T1, D> &xs, const index_type &i,
+                          std::ptrdiff_t imin, std::ptrdiff_t imax,
+                          const std::array<std::ptrdiff_t, D> &di,
+                          const Args &... args) const {
+    return fun::detail::simd_stencil_loop(
+        f, g, &fun::getIndex(xs.data, xs.indexing.linear(i)),
+        &acc[indexing.linear(i)], imin, imax, di, args...);
+  }
+  // Fields stored in separate columns are loaded with unit stride
+  template <typename Acc, typename F, typename G, typename T1,
+            typename... Args>
+  std::ptrdiff_t simd_row(std::true_type, Acc &acc, const F &f, const G &g,
+                          const grid<C, T1, D> &xs, const index_type &i,
+                          std::ptrdiff_t imin, std::ptrdiff_t imax,
+                          const std::array<std::ptrdiff_t, D> &di,
+                          const Args &... args) const {
+    return fun::detail::simd_soa_stencil_loop(
+        f, g, xs.data.pointers(), xs.indexing.linear(i), acc.pointers(),
+        indexing.linear(i), imin, imax, di, args...);
+  }
+
+  // A stencil point whose neighbours are read from xs, including its
+  // ghost cells
+  template <typename F, typename G, typename T1, std::size_t... Ds,
+            typename... Args>
+  static T ghost_stencil_point(const F &f, const G &g,
+                               const grid<C, T1, D> &xs, std::ptrdiff_t lin,
+                               std::size_t bdirs,
+                               const std::array<std::ptrdiff_t, D> &di,
+                               std::index_sequence<Ds...>,
+                               const Args &... args) {
+    return cxx::invoke(
+        f, fun::getIndex(xs.data, lin), bdirs,
+        cxx::invoke(g, fun::getIndex(xs.data, lin - di[Ds]),
+                    std::ptrdiff_t(2 * Ds + 1))...,
+        cxx::invoke(g, fun::getIndex(xs.data, lin + di[Ds]),
+                    std::ptrdiff_t(2 * Ds))...,
+        args...);
   }
 
 public:
   bool empty() const { return indexing.empty(); }
   std::size_t size() const { return indexing.size(); }
   index_type shape() const { return indexing.shape(); }
+  // The shape of the allocated storage, including ghosts and padding
+  index_type allocated() const { return indexing.allocated(); }
+  // The number of ghost layers in every direction
+  std::ptrdiff_t ghosts() const { return nghosts; }
 
 private:
   bool invariant0() const {
-    return indexing.allocated_size() == std::ptrdiff_t(fun::msize(data));
+    return nghosts >= 0 &&
+           adt::all(adt::ge(indexing.offset(), nghosts)) &&
+           indexing.allocated_size() == std::ptrdiff_t(fun::msize(data));
   }
 
 public:
@@ -270,18 +591,18 @@ public:
   }
 
   grid()
-      : indexing(),
+      : indexing(), nghosts(0),
         data(fun::accumulator<container_constructor<T>>(indexing.size())
                  .finalize()) {
     cxx_assert(invariant());
   }
 
   grid(const index_type &shape, const container_constructor<T> &data)
-      : indexing(shape), data(data) {
+      : indexing(shape), nghosts(0), data(data) {
     cxx_assert(invariant());
   }
   grid(const index_type &shape, container_constructor<T> &&data)
-      : indexing(shape), data(std::move(data)) {
+      : indexing(shape), nghosts(0), data(std::move(data)) {
     cxx_assert(invariant());
   }
 
@@ -292,15 +613,71 @@ public:
   void swap(grid &other) {
     using std::swap;
     swap(indexing, other.indexing);
+    swap(nghosts, other.nghosts);
     swap(data, other.data);
   }
 
-  const T &head() const {
-    return fun::getIndex(data, indexing.linear(adt::set<index_type>(0)));
+private:
+  // Elements that are read lazily (see fun::soa_element) are returned
+  // by value
+  static const T &element(const T &x) { return x; }
+  template <typename U> static T element(const U &x) { return x; }
+
+public:
+  decltype(auto) head() const {
+    return element(
+        fun::getIndex(data, indexing.linear(adt::set<index_type>(0))));
   }
-  const T &last() const {
-    return fun::getIndex(
-        data, indexing.linear(indexing.shape() - adt::set<index_type>(1)));
+  decltype(auto) last() const {
+    return element(fun::getIndex(
+        data, indexing.linear(indexing.shape() - adt::set<index_type>(1))));
+  }
+
+  // non-standard: The underlying storage, e.g. to place it in memory
+  const container_constructor<T> &storage() const noexcept { return data; }
+
+  // Fill the ghost layers beyond face i in place (face 2 * d is the
+  // lower and face 2 * d + 1 the upper face in direction d). The ghost
+  // cell at distance k + 1 from the face is set to f(x, i, args...),
+  // where x is the cell at distance k from the face, i.e. the mirrored
+  // cell. The container needs to provide element access.
+  template <typename F, typename... Args>
+  void fill_ghosts(std::ptrdiff_t i, F &&f, Args &&... args) {
+    static_assert(
+        std::is_same<std::decay_t<cxx::invoke_of_t<F, T, std::ptrdiff_t,
+                                                   Args...>>,
+                     T>::value,
+        "");
+    const std::ptrdiff_t d = i / 2;
+    cxx_assert(shape()[d] >= nghosts);
+    const std::ptrdiff_t di = (i % 2 == 0 ? -1 : 1) * indexing.stride(d);
+    face_loop(i, [&](const index_type &j) {
+      const std::ptrdiff_t lin = indexing.linear(j);
+      for (std::ptrdiff_t k = 0; k < nghosts; ++k)
+        data[lin + (k + 1) * di] =
+            cxx::invoke(f, fun::getIndex(data, lin - k * di), i, args...);
+    });
+  }
+
+  // Fill the ghost layers beyond face i in place from the neighbouring
+  // block nb on the other side of that face. The ghost cell at
+  // distance k + 1 from the face is set to the cell of nb at distance k
+  // from its opposite face. With nb = *this, this implements periodic
+  // boundaries.
+  void copy_ghosts(std::ptrdiff_t i, const grid &nb) {
+    const std::ptrdiff_t d = i / 2;
+    cxx_assert(adt::rmdir(nb.shape(), d) == adt::rmdir(shape(), d));
+    cxx_assert(nb.shape()[d] >= nghosts);
+    const std::ptrdiff_t di = (i % 2 == 0 ? -1 : 1) * indexing.stride(d);
+    const std::ptrdiff_t dj = (i % 2 == 0 ? -1 : 1) * nb.indexing.stride(d);
+    face_loop(i, [&](const index_type &j) {
+      const std::ptrdiff_t lin = indexing.linear(j);
+      index_type jnb = j;
+      jnb[d] = i % 2 == 0 ? nb.shape()[d] - 1 : 0;
+      const std::ptrdiff_t linnb = nb.indexing.linear(jnb);
+      for (std::ptrdiff_t k = 0; k < nghosts; ++k)
+        data[lin + (k + 1) * di] = fun::getIndex(nb.data, linnb + k * dj);
+    });
   }
 
   // iotaMap
@@ -310,7 +687,7 @@ public:
   template <typename F, typename... Args, std::size_t D2 = D,
             std::enable_if_t<D2 == 0> * = nullptr>
   grid(iotaMap, F &&f, const adt::irange_t &inds, Args &&... args)
-      : indexing(index_type{{}}),
+      : indexing(index_type{{}}), nghosts(0),
         data(fun::iotaMap<C>(std::forward<F>(f), inds,
                              std::forward<Args>(args)...)) {
     static_assert(
@@ -322,7 +699,7 @@ public:
   template <typename F, typename... Args, std::size_t D2 = D,
             std::enable_if_t<D2 == 1> * = nullptr>
   grid(iotaMap, F &&f, const adt::irange_t &inds, Args &&... args)
-      : indexing(index_type{{inds.shape()}}),
+      : indexing(index_type{{inds.shape()}}), nghosts(0),
         data(fun::iotaMap<C>(std::forward<F>(f), inds,
                              std::forward<Args>(args)...)) {
     static_assert(
@@ -335,29 +712,61 @@ public:
 
   template <typename F, typename... Args>
   grid(iotaMapMulti, F &&f, const adt::steprange_t<D> &inds, Args &&... args)
-      : indexing(inds.shape()) {
+      : grid(iotaMapMulti(), padded_indexing(inds.shape()), 0,
+             std::forward<F>(f), inds, std::forward<Args>(args)...) {}
+
+  // Choose the allocated shape (including padding) explicitly
+  template <typename F, typename... Args>
+  grid(iotaMapMulti, const index_type &allocated, F &&f,
+       const adt::steprange_t<D> &inds, Args &&... args)
+      : grid(iotaMapMulti(), index_space(inds.shape(), allocated), 0,
+             std::forward<F>(f), inds, std::forward<Args>(args)...) {}
+
+  // Surround the cells by ghost layers. f is evaluated for the ghost
+  // cells as well, i.e. at positions outside of inds.
+  template <typename F, typename... Args>
+  grid(iotaMapMulti, std::ptrdiff_t ghosts, F &&f,
+       const adt::steprange_t<D> &inds, Args &&... args)
+      : grid(iotaMapMulti(), padded_indexing(inds.shape(), ghosts), ghosts,
+             std::forward<F>(f), inds, std::forward<Args>(args)...) {}
+
+private:
+  template <typename F, typename... Args>
+  grid(iotaMapMulti, const index_space &indexing1, std::ptrdiff_t ghosts,
+       F &&f, const adt::steprange_t<D> &inds, Args &&... args)
+      : indexing(indexing1), nghosts(ghosts) {
     static_assert(
         std::is_same<cxx::invoke_of_t<F, index_type, Args...>, T>::value, "");
-    fun::accumulator<container_constructor<T>> acc(indexing.size());
-    indexing.loop([&](const index_type &i) {
-      acc[indexing.linear(i)] = cxx::invoke(f, i, args...);
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
+    const auto cells = ghost_indexing(nghosts);
+    const auto g = adt::set<index_type>(nghosts);
+    cells.loop([&](const index_type &j) {
+      acc[cells.linear(j)] = cxx::invoke(f, j - g, args...);
     });
     data = acc.finalize();
     cxx_assert(invariant());
   }
 
+public:
+
   // fmap
 
+  // The result has the ghost layers that all arguments have, and f is
+  // applied to the ghost cells as well
+
   struct fmap {};
 
   template <typename F, typename T1, typename... Args>
   grid(fmap, F &&f, const grid<C, T1, D> &xs, Args &&... args)
-      : indexing(xs.shape()) {
+      : indexing(padded_indexing(xs.shape(), xs.nghosts)),
+        nghosts(xs.nghosts) {
     static_assert(std::is_same<cxx::invoke_of_t<F, T1, Args...>, T>::value, "");
-    fun::accumulator<container_constructor<T>> acc(indexing.size());
-    indexing.loop([&](const index_type &i) {
-      acc[indexing.linear(i)] = cxx::invoke(
-          f, fun::getIndex(xs.data, xs.indexing.linear(i)), args...);
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
+    const auto cells = ghost_indexing(nghosts);
+    const auto xcells = xs.ghost_indexing(nghosts);
+    cells.loop([&](const index_type &j) {
+      acc[cells.linear(j)] =
+          cxx::invoke(f, fun::getIndex(xs.data, xcells.linear(j)), args...);
     });
     data = acc.finalize();
     cxx_assert(invariant());
@@ -368,15 +777,20 @@ public:
   template <typename F, typename T1, typename T2, typename... Args>
   grid(fmap2, F &&f, const grid<C, T1, D> &xs, const grid<C, T2, D> &ys,
        Args &&... args)
-      : indexing(xs.shape()) {
+      : indexing(padded_indexing(xs.shape(),
+                                 std::min(xs.nghosts, ys.nghosts))),
+        nghosts(std::min(xs.nghosts, ys.nghosts)) {
     static_assert(std::is_same<cxx::invoke_of_t<F, T1, T2, Args...>, T>::value,
                   "");
     cxx_assert(ys.shape() == xs.shape());
-    fun::accumulator<container_constructor<T>> acc(indexing.size());
-    indexing.loop([&](const index_type &i) {
-      acc[indexing.linear(i)] =
-          cxx::invoke(f, fun::getIndex(xs.data, xs.indexing.linear(i)),
-                      fun::getIndex(ys.data, ys.indexing.linear(i)), args...);
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
+    const auto cells = ghost_indexing(nghosts);
+    const auto xcells = xs.ghost_indexing(nghosts);
+    const auto ycells = ys.ghost_indexing(nghosts);
+    cells.loop([&](const index_type &j) {
+      acc[cells.linear(j)] =
+          cxx::invoke(f, fun::getIndex(xs.data, xcells.linear(j)),
+                      fun::getIndex(ys.data, ycells.linear(j)), args...);
     });
     data = acc.finalize();
     cxx_assert(invariant());
@@ -387,17 +801,23 @@ public:
   template <typename F, typename T1, typename T2, typename T3, typename... Args>
   grid(fmap3, F &&f, const grid<C, T1, D> &xs, const grid<C, T2, D> &ys,
        const grid<C, T3, D> &zs, Args &&... args)
-      : indexing(xs.shape()) {
+      : indexing(padded_indexing(
+            xs.shape(), std::min({xs.nghosts, ys.nghosts, zs.nghosts}))),
+        nghosts(std::min({xs.nghosts, ys.nghosts, zs.nghosts})) {
     static_assert(
         std::is_same<cxx::invoke_of_t<F, T1, T2, T3, Args...>, T>::value, "");
     cxx_assert(ys.shape() == xs.shape());
     cxx_assert(zs.shape() == xs.shape());
-    fun::accumulator<container_constructor<T>> acc(indexing.size());
-    indexing.loop([&](const index_type &i) {
-      acc[indexing.linear(i)] =
-          cxx::invoke(f, fun::getIndex(xs.data, xs.indexing.linear(i)),
-                      fun::getIndex(ys.data, ys.indexing.linear(i)),
-                      fun::getIndex(zs.data, zs.indexing.linear(i)), args...);
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
+    const auto cells = ghost_indexing(nghosts);
+    const auto xcells = xs.ghost_indexing(nghosts);
+    const auto ycells = ys.ghost_indexing(nghosts);
+    const auto zcells = zs.ghost_indexing(nghosts);
+    cells.loop([&](const index_type &j) {
+      acc[cells.linear(j)] =
+          cxx::invoke(f, fun::getIndex(xs.data, xcells.linear(j)),
+                      fun::getIndex(ys.data, ycells.linear(j)),
+                      fun::getIndex(zs.data, zcells.linear(j)), args...);
     });
     data = acc.finalize();
     cxx_assert(invariant());
@@ -407,9 +827,25 @@ public:
 
   struct boundary {};
 
+  // Boundaries share the storage if possible, else they are copied.
+  // They have no ghost layers.
   grid(boundary, const grid<C, T, D + 1> &xs, std::ptrdiff_t i)
-      : indexing(typename index_space::boundary(), xs.indexing, i),
-        data(xs.data) {
+      : indexing(index_space::boundary_is_contiguous(i)
+                     ? index_space(typename index_space::boundary(),
+                                   xs.indexing, i)
+                     : index_space(
+                           detail::strided_view<D>(xs.indexing, i).shape())),
+        nghosts(0) {
+    if (index_space::boundary_is_contiguous(i)) {
+      data = xs.data;
+    } else {
+      const detail::strided_view<D> view(xs.indexing, i);
+      fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
+      indexing.loop([&](const index_type &j) {
+        acc[indexing.linear(j)] = fun::getIndex(xs.data, view.linear(j));
+      });
+      data = acc.finalize();
+    }
     cxx_assert(invariant());
   }
 
@@ -420,14 +856,14 @@ public:
   template <typename F, typename G, typename T1, typename... Args>
   grid(fmapStencilMulti, F &&f, G &&g, const grid<C, T1, 0> &xs,
        std::size_t bmask, Args &&... args)
-      : indexing(xs.shape()) {
+      : indexing(padded_indexing(xs.shape())), nghosts(0) {
     static_assert(D == 0, "");
     typedef cxx::invoke_of_t<G, T1, std::ptrdiff_t> B
         __attribute__((__unused__));
     static_assert(
         std::is_same<cxx::invoke_of_t<F, T1, std::size_t, Args...>, T>::value,
         "");
-    fun::accumulator<container_constructor<T>> acc(indexing.size());
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
     indexing.loop([&](const index_type &i) {
       std::size_t bdirs = 0;
       acc[indexing.linear(i)] = cxx::invoke(
@@ -444,28 +880,32 @@ public:
       typename BCB = typename fun::fun_traits<BC>::template constructor<B>>
   grid(fmapStencilMulti, F &&f, G &&g, const grid<C, T1, 1> &xs,
        std::size_t bmask, const BCB &bm0, const BCB &bp0, Args &&... args)
-      : indexing(xs.shape()) {
+      : indexing(padded_indexing(xs.shape(), xs.nghosts)),
+        nghosts(xs.nghosts) {
     static_assert(D == 1, "");
     typedef cxx::invoke_of_t<F, T1, std::size_t, B, B, Args...> R;
     static_assert(std::is_same<R, T>::value, "");
-    fun::accumulator<container_constructor<T>> acc(indexing.size());
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
     auto di = xs.indexing.linear(array_dir<std::ptrdiff_t, D, 0>());
-    indexing.loop([&](const index_type &i) {
+    const auto point = [&](const index_type &i) {
       bool isbm0 = i[0] == 0;
       bool isbp0 = i[0] == xs.indexing.shape()[0] - 1;
       std::size_t bdirs = bmask & ((isbm0 << 0) | (isbp0 << 1));
-      const B &cm0 =
+      // Neighbours are passed as read, e.g. lazily for soa storage
+      const auto &cm0 =
           isbm0 ? fun::getIndex(bm0.data, bm0.indexing.linear(rmdir<0>(i)))
                 : cxx::invoke(
                       g, fun::getIndex(xs.data, xs.indexing.linear(i - di)), 1);
-      const B &cp0 =
+      const auto &cp0 =
           isbp0 ? fun::getIndex(bp0.data, bp0.indexing.linear(rmdir<0>(i)))
                 : cxx::invoke(
                       g, fun::getIndex(xs.data, xs.indexing.linear(i + di)), 0);
       acc[indexing.linear(i)] =
           cxx::invoke(f, fun::getIndex(xs.data, xs.indexing.linear(i)), bdirs,
                       cm0, cp0, args...);
-    });
+    };
+    stencil_loop(acc, f, g, xs, ~std::size_t(0), point, args...);
+    clear_ghosts(acc);
     data = acc.finalize();
     cxx_assert(invariant());
   }
@@ -478,36 +918,37 @@ public:
   grid(fmapStencilMulti, F &&f, G &&g, const grid<C, T1, 2> &xs,
        std::size_t bmask, const BCB &bm0, const BCB &bm1, const BCB &bp0,
        const BCB &bp1, Args &&... args)
-      : indexing(xs.shape()) {
+      : indexing(padded_indexing(xs.shape(), xs.nghosts)),
+        nghosts(xs.nghosts) {
     static_assert(D == 2, "");
     typedef cxx::invoke_of_t<F, T1, std::size_t, B, B, B, B, Args...> R;
     static_assert(std::is_same<R, T>::value, "");
-    fun::accumulator<container_constructor<T>> acc(indexing.size());
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
     auto di0 = array_dir<std::ptrdiff_t, D, 0>();
     auto di1 = array_dir<std::ptrdiff_t, D, 1>();
-    indexing.loop([&](const index_type &i) {
+    const auto point = [&](const index_type &i) {
       bool isbm0 = i[0] == 0;
       bool isbm1 = i[1] == 0;
       bool isbp0 = i[0] == xs.indexing.shape()[0] - 1;
       bool isbp1 = i[1] == xs.indexing.shape()[1] - 1;
       std::size_t bdirs =
           bmask & ((isbm0 << 0) | (isbm1 << 2) | (isbp0 << 1) | (isbp1 << 3));
-      const B &cm0 =
+      const auto &cm0 =
           isbm0
               ? fun::getIndex(bm0.data, bm0.indexing.linear(rmdir<0>(i)))
               : cxx::invoke(
                     g, fun::getIndex(xs.data, xs.indexing.linear(i - di0)), 1);
-      const B &cm1 =
+      const auto &cm1 =
           isbm1
               ? fun::getIndex(bm1.data, bm1.indexing.linear(rmdir<1>(i)))
               : cxx::invoke(
                     g, fun::getIndex(xs.data, xs.indexing.linear(i - di1)), 3);
-      const B &cp0 =
+      const auto &cp0 =
           isbp0
               ? fun::getIndex(bp0.data, bp0.indexing.linear(rmdir<0>(i)))
               : cxx::invoke(
                     g, fun::getIndex(xs.data, xs.indexing.linear(i + di0)), 0);
-      const B &cp1 =
+      const auto &cp1 =
           isbp1
               ? fun::getIndex(bp1.data, bp1.indexing.linear(rmdir<1>(i)))
               : cxx::invoke(
@@ -515,7 +956,108 @@ public:
       acc[indexing.linear(i)] =
           cxx::invoke(f, fun::getIndex(xs.data, xs.indexing.linear(i)), bdirs,
                       cm0, cm1, cp0, cp1, args...);
-    });
+    };
+    stencil_loop(acc, f, g, xs, ~std::size_t(0), point, args...);
+    clear_ghosts(acc);
+    data = acc.finalize();
+    cxx_assert(invariant());
+  }
+
+  template <
+      typename F, typename G, typename T1, typename... Args,
+      typename BC = grid<C, adt::dummy, 2>,
+      typename B = cxx::invoke_of_t<G, T, std::ptrdiff_t>,
+      typename BCB = typename fun::fun_traits<BC>::template constructor<B>>
+  grid(fmapStencilMulti, F &&f, G &&g, const grid<C, T1, 3> &xs,
+       std::size_t bmask, const BCB &bm0, const BCB &bm1, const BCB &bm2,
+       const BCB &bp0, const BCB &bp1, const BCB &bp2, Args &&... args)
+      : indexing(padded_indexing(xs.shape(), xs.nghosts)),
+        nghosts(xs.nghosts) {
+    static_assert(D == 3, "");
+    typedef cxx::invoke_of_t<F, T1, std::size_t, B, B, B, B, B, B, Args...> R;
+    static_assert(std::is_same<R, T>::value, "");
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
+    auto di0 = array_dir<std::ptrdiff_t, D, 0>();
+    auto di1 = array_dir<std::ptrdiff_t, D, 1>();
+    auto di2 = array_dir<std::ptrdiff_t, D, 2>();
+    const auto point = [&](const index_type &i) {
+      bool isbm0 = i[0] == 0;
+      bool isbm1 = i[1] == 0;
+      bool isbm2 = i[2] == 0;
+      bool isbp0 = i[0] == xs.indexing.shape()[0] - 1;
+      bool isbp1 = i[1] == xs.indexing.shape()[1] - 1;
+      bool isbp2 = i[2] == xs.indexing.shape()[2] - 1;
+      std::size_t bdirs =
+          bmask & ((isbm0 << 0) | (isbm1 << 2) | (isbm2 << 4) | (isbp0 << 1) |
+                   (isbp1 << 3) | (isbp2 << 5));
+      const auto &cm0 =
+          isbm0
+              ? fun::getIndex(bm0.data, bm0.indexing.linear(rmdir<0>(i)))
+              : cxx::invoke(
+                    g, fun::getIndex(xs.data, xs.indexing.linear(i - di0)), 1);
+      const auto &cm1 =
+          isbm1
+              ? fun::getIndex(bm1.data, bm1.indexing.linear(rmdir<1>(i)))
+              : cxx::invoke(
+                    g, fun::getIndex(xs.data, xs.indexing.linear(i - di1)), 3);
+      const auto &cm2 =
+          isbm2
+              ? fun::getIndex(bm2.data, bm2.indexing.linear(rmdir<2>(i)))
+              : cxx::invoke(
+                    g, fun::getIndex(xs.data, xs.indexing.linear(i - di2)), 5);
+      const auto &cp0 =
+          isbp0
+              ? fun::getIndex(bp0.data, bp0.indexing.linear(rmdir<0>(i)))
+              : cxx::invoke(
+                    g, fun::getIndex(xs.data, xs.indexing.linear(i + di0)), 0);
+      const auto &cp1 =
+          isbp1
+              ? fun::getIndex(bp1.data, bp1.indexing.linear(rmdir<1>(i)))
+              : cxx::invoke(
+                    g, fun::getIndex(xs.data, xs.indexing.linear(i + di1)), 2);
+      const auto &cp2 =
+          isbp2
+              ? fun::getIndex(bp2.data, bp2.indexing.linear(rmdir<2>(i)))
+              : cxx::invoke(
+                    g, fun::getIndex(xs.data, xs.indexing.linear(i + di2)), 4);
+      acc[indexing.linear(i)] =
+          cxx::invoke(f, fun::getIndex(xs.data, xs.indexing.linear(i)), bdirs,
+                      cm0, cm1, cm2, cp0, cp1, cp2, args...);
+    };
+    stencil_loop(acc, f, g, xs, ~std::size_t(0), point, args...);
+    clear_ghosts(acc);
+    data = acc.finalize();
+    cxx_assert(invariant());
+  }
+
+  // Without boundary arguments, the neighbours of the boundary cells
+  // are read from the innermost ghost layer of xs (see fill_ghosts and
+  // copy_ghosts). As with boundary arguments, bdirs tells f which of
+  // the faces in bmask the cell is adjacent to. The ghost cells of the
+  // result are value-initialized.
+  template <typename F, typename G, typename T1, std::size_t D1 = D,
+            std::enable_if_t<(D1 > 0)> * = nullptr>
+  grid(fmapStencilMulti, F &&f, G &&g, const grid<C, T1, D> &xs,
+       std::size_t bmask)
+      : indexing(padded_indexing(xs.shape(), xs.nghosts)),
+        nghosts(xs.nghosts) {
+    cxx_assert(xs.nghosts >= 1);
+    fun::accumulator<container_constructor<T>> acc(indexing.allocated_size());
+    const index_type &shape = xs.indexing.shape();
+    std::array<std::ptrdiff_t, D> di;
+    for (std::size_t d = 0; d < D; ++d)
+      di[d] = xs.indexing.stride(d);
+    const auto point = [&](const index_type &i) {
+      std::size_t bdirs = 0;
+      for (std::size_t d = 0; d < D; ++d)
+        bdirs |= std::size_t(i[d] == 0) << (2 * d) |
+                 std::size_t(i[d] == shape[d] - 1) << (2 * d + 1);
+      acc[indexing.linear(i)] =
+          ghost_stencil_point(f, g, xs, xs.indexing.linear(i), bmask & bdirs,
+                              di, std::make_index_sequence<D>());
+    };
+    stencil_loop(acc, f, g, xs, bmask, point);
+    clear_ghosts(acc);
     data = acc.finalize();
     cxx_assert(invariant());
   }
@@ -8,7 +8,10 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
 TEST(adt_grid, basic) {
   auto g0 = adt::grid<std::vector<adt::dummy>, double, 0>();
@@ -242,6 +245,116 @@ TEST(adt_grid, fmapStencil) {
   EXPECT_EQ(0.0, maxabs2);
 }
 
+TEST(adt_grid, boundary) {
+  typedef adt::grid<std::vector<adt::dummy>, double, 2> grid2;
+  typedef adt::grid<std::vector<adt::dummy>, double, 1> grid1;
+  auto g = grid2(typename grid2::iotaMapMulti(),
+                 [](auto i) { return double(i[0] + 10 * i[1]); },
+                 adt::index_t<2>{{3, 4}});
+  auto sum = [](const grid1 &b) {
+    return b.foldMap([](auto x) { return x; },
+                     [](auto x, auto y) { return x + y; }, 0.0);
+  };
+  // Boundaries in dimension 0 are strided and are copied
+  auto bm0 = grid1(typename grid1::boundary(), g, 0);
+  EXPECT_EQ(4, bm0.size());
+  EXPECT_EQ(60.0, sum(bm0));
+  auto bp0 = grid1(typename grid1::boundary(), g, 1);
+  EXPECT_EQ(68.0, sum(bp0));
+  EXPECT_EQ(32.0, bp0.last());
+  auto bm1 = grid1(typename grid1::boundary(), g, 2);
+  EXPECT_EQ(3, bm1.size());
+  EXPECT_EQ(3.0, sum(bm1));
+  auto bp1 = grid1(typename grid1::boundary(), g, 3);
+  EXPECT_EQ(93.0, sum(bp1));
+  EXPECT_EQ(30.0, bp1.head());
+}
+
+TEST(adt_grid, padding) {
+  typedef adt::grid<std::vector<adt::dummy>, double, 2> grid2;
+  auto sum = [](const grid2 &g) {
+    return g.foldMap([](auto x) { return x; },
+                     [](auto x, auto y) { return x + y; }, 0.0);
+  };
+  // Short rows are not padded
+  auto g0 = grid2(typename grid2::iotaMapMulti(),
+                  [](auto i) { return double(i[0] + i[1]); },
+                  adt::index_t<2>{{10, 3}});
+  EXPECT_EQ((adt::index_t<2>{{10, 3}}), g0.allocated());
+  // Rows start at cache line boundaries
+  auto g1 = grid2(typename grid2::iotaMapMulti(),
+                  [](auto i) { return double(i[0] + i[1]); },
+                  adt::index_t<2>{{33, 3}});
+  EXPECT_EQ((adt::index_t<2>{{40, 3}}), g1.allocated());
+  EXPECT_EQ(33 * 32 * 3 / 2 + 33 * 3, sum(g1));
+  // Rows of 4096 bytes are padded further
+  auto g2 = grid2(typename grid2::iotaMapMulti(),
+                  [](auto i) { return double(i[0] + i[1]); },
+                  adt::index_t<2>{{512, 2}});
+  EXPECT_EQ((adt::index_t<2>{{520, 2}}), g2.allocated());
+  // The padding is explicit
+  auto g3 = grid2(typename grid2::iotaMapMulti(), adt::index_t<2>{{16, 4}},
+                  [](auto i) { return double(i[0] + i[1]); },
+                  adt::index_t<2>{{10, 3}});
+  EXPECT_EQ((adt::index_t<2>{{16, 4}}), g3.allocated());
+  EXPECT_EQ(sum(g0), sum(g3));
+  // Operations respect the padding
+  auto h1 = grid2(typename grid2::fmap2(),
+                  [](auto x, auto y) { return x - y; }, g0, g3);
+  EXPECT_EQ(0.0, sum(h1));
+  auto b3 = adt::grid<std::vector<adt::dummy>, double, 1>(
+      typename adt::grid<std::vector<adt::dummy>, double, 1>::boundary(), g3,
+      3);
+  EXPECT_EQ(2.0, b3.head());
+  EXPECT_EQ(11.0, b3.last());
+}
+
+TEST(adt_grid, tiling) {
+  typedef adt::detail::index_space<3> index_space3;
+  // Small grids are a single tile
+  EXPECT_EQ((adt::index_t<3>{{10, 10, 10}}),
+            index_space3::tile_shape({{10, 10, 10}}, 8, 65536));
+  // Tiles keep whole rows, and span the outermost dimension
+  EXPECT_EQ((adt::index_t<3>{{64, 128, 64}}),
+            index_space3::tile_shape({{64, 256, 64}}, 8, 65536));
+  // Long rows are split
+  EXPECT_EQ((adt::index_t<3>{{8192, 1, 2}}),
+            index_space3::tile_shape({{10000, 2, 2}}, 8, 65536));
+  EXPECT_EQ((adt::index_t<3>{{64, 64, 64}}),
+            index_space3::tile_shape({{64, 64, 64}}, 8, 0));
+
+  // Tiled loops visit each point once
+  const index_space3 is(adt::index_t<3>{{9, 7, 5}});
+  std::vector<int> count(is.size(), 0);
+  is.loop_tiled({{4, 3, 2}},
+                [&](const adt::index_t<3> &i) { ++count[is.linear(i)]; });
+  EXPECT_TRUE(std::all_of(count.begin(), count.end(),
+                          [](int c) { return c == 1; }));
+
+  typedef adt::grid<std::vector<adt::dummy>, double, 3> grid3;
+  auto sum = [](const grid3 &g) {
+    return g.foldMap([](auto x) { return x; },
+                     [](auto x, auto y) { return x + y; }, 0.0);
+  };
+  const auto tile_bytes = adt::get_grid_tile_bytes();
+  adt::set_grid_tile_bytes(0);
+  auto g0 = grid3(typename grid3::iotaMapMulti(),
+                  [](auto i) { return double(i[0] + 10 * i[1] + 100 * i[2]); },
+                  adt::index_t<3>{{40, 9, 7}});
+  // Pointwise maps are not tiled, whatever the tile size
+  adt::set_grid_tile_bytes(4 * 40 * sizeof(double));
+  auto g1 = grid3(typename grid3::iotaMapMulti(),
+                  [](auto i) { return double(i[0] + 10 * i[1] + 100 * i[2]); },
+                  adt::index_t<3>{{40, 9, 7}});
+  auto h1 = grid3(typename grid3::fmap2(),
+                  [](auto x, auto y) { return x - y; }, g0, g1);
+  adt::set_grid_tile_bytes(tile_bytes);
+  EXPECT_EQ(0.0, sum(h1));
+  EXPECT_EQ(sum(g0), sum(g1));
+  EXPECT_EQ(0.0, g1.head());
+  EXPECT_EQ(39.0 + 80.0 + 600.0, g1.last());
+}
+
 TEST(adt_grid, foldMap) {
   std::ptrdiff_t s = 10;
   auto g0 = adt::grid<std::vector<adt::dummy>, double, 0>(
@@ -286,3 +399,189 @@ TEST(adt_grid, foldMap) {
   EXPECT_TRUE((std::is_same<decltype(r10), double>::value));
   EXPECT_EQ(5120.0, r10);
 }
+
+TEST(adt_grid, aligned_rows) {
+  typedef adt::grid<std::vector<adt::dummy, adt::grid_allocator<adt::dummy>>,
+                    double, 2>
+      grid2;
+  auto g = grid2(typename grid2::iotaMapMulti(), 1,
+                 [](auto i) { return double(i[0] + i[1]); },
+                 adt::steprange_t<2>(adt::index_t<2>{{33, 3}}));
+  // The lower ghost layer is widened to a cache line
+  EXPECT_EQ((adt::index_t<2>{{48, 5}}), g.allocated());
+  // The first cell of each row is aligned
+  EXPECT_EQ(0, std::uintptr_t(&g.head()) % 64);
+  EXPECT_EQ(0, std::uintptr_t(&g.last() - 32) % 64);
+  EXPECT_EQ(34.0, g.last());
+}
+
+namespace {
+template <std::size_t D>
+using ghost_grid_t = adt::grid<std::vector<adt::dummy>, double, D>;
+
+template <std::size_t D>
+ghost_grid_t<D> make_ghost_grid(std::ptrdiff_t ghosts,
+                                const adt::index_t<D> &shape,
+                                const adt::index_t<D> &offset) {
+  typedef ghost_grid_t<D> grid_t;
+  return grid_t(typename grid_t::iotaMapMulti(), ghosts,
+                [&](const adt::index_t<D> &i) {
+                  double r = 0.0;
+                  for (std::size_t d = 0; d < D; ++d)
+                    r = 10.0 * r + (i[d] + offset[d]) * (i[d] + offset[d]);
+                  return r;
+                },
+                adt::steprange_t<D>(shape));
+}
+
+// A stencil that reads all neighbours from the ghost layers
+template <std::size_t D>
+ghost_grid_t<D> diff(const ghost_grid_t<D> &xs, std::size_t bmask = 0) {
+  typedef ghost_grid_t<D> grid_t;
+  return grid_t(typename grid_t::fmapStencilMulti(),
+                [](double x, std::size_t bdirs, auto... bs) {
+                  double r = 0.0;
+                  for (double b : {bs...})
+                    r = 2.0 * r + b;
+                  return r + 1000.0 * bdirs;
+                },
+                [](double x, std::ptrdiff_t i) { return x; }, xs, bmask);
+}
+
+double negate(double x, std::ptrdiff_t i) { return -x; }
+} // namespace
+
+TEST(adt_grid, ghosts) {
+  auto xs = make_ghost_grid<2>(1, {{3, 4}}, {{0, 0}});
+  EXPECT_TRUE(xs.invariant());
+  EXPECT_EQ(1, xs.ghosts());
+  EXPECT_EQ(12, xs.size());
+  // The storage holds one ghost layer on either side
+  EXPECT_LE(3 + 2, xs.allocated()[0]);
+  EXPECT_LE(4 + 2, xs.allocated()[1]);
+  EXPECT_EQ(0.0, xs.head());
+  EXPECT_EQ(10.0 * 4.0 + 9.0, xs.last());
+
+  // Ghost cells are evaluated and mapped as well: xs[-1, 0] = 10
+  auto ys = diff(xs);
+  EXPECT_EQ(8.0 * 10.0 + 4.0 * 1.0 + 2.0 * 10.0 + 1.0, ys.head());
+  typedef ghost_grid_t<2> grid_t;
+  auto zs = grid_t(typename grid_t::fmap(), [](double x) { return -x; }, xs);
+  EXPECT_EQ(1, zs.ghosts());
+  EXPECT_EQ(-ys.head(), diff(zs).head());
+  EXPECT_EQ(-ys.last(), diff(zs).last());
+  // ... as far as all arguments have ghost layers
+  auto ws = grid_t(typename grid_t::fmap2(),
+                   [](double x, double y) { return x + y; }, xs, ys);
+  EXPECT_EQ(1, ws.ghosts());
+  auto vs = make_ghost_grid<2>(0, {{3, 4}}, {{0, 0}});
+  auto us = grid_t(typename grid_t::fmap2(),
+                   [](double x, double y) { return x - y; }, xs, vs);
+  EXPECT_EQ(0, us.ghosts());
+  EXPECT_EQ(0.0, us.foldMap([](double x) { return std::fabs(x); },
+                            [](double x, double y) { return x + y; }, 0.0));
+
+  // Boundaries have no ghost layers
+  typedef ghost_grid_t<1> boundary_t;
+  boundary_t bs(typename boundary_t::boundary(), xs, 1);
+  EXPECT_EQ(0, bs.ghosts());
+  EXPECT_EQ(4, bs.size());
+  EXPECT_EQ(10.0 * 4.0 + 0.0, bs.head());
+  EXPECT_EQ(10.0 * 4.0 + 9.0, bs.last());
+  boundary_t cs(typename boundary_t::boundary(), xs, 3);
+  EXPECT_EQ(9.0, cs.head());
+  EXPECT_EQ(10.0 * 4.0 + 9.0, cs.last());
+}
+
+TEST(adt_grid, fill_ghosts) {
+  std::ptrdiff_t s = 10;
+  auto xs = make_ghost_grid<1>(1, {{s}}, {{0}});
+  xs.fill_ghosts(0, negate);
+  xs.fill_ghosts(1, negate);
+  auto ys = diff(xs);
+  // ys[i] = 2 * xs[i - 1] + xs[i + 1]
+  EXPECT_EQ(2.0 * -0.0 + 1.0, ys.head());
+  EXPECT_EQ(2.0 * 64.0 - 81.0, ys.last());
+  // The ghost cells of the result are value-initialized
+  EXPECT_EQ(2.0 * 0.0 + 4.0, diff(ys).head());
+
+  // Only the innermost ghost layer is read by the stencil; the outer
+  // layers mirror the cells
+  auto xs2 = make_ghost_grid<1>(2, {{s}}, {{0}});
+  xs2.fill_ghosts(0, negate);
+  xs2.fill_ghosts(1, negate);
+  auto ys2 = diff(xs2);
+  EXPECT_EQ(ys.head(), ys2.head());
+  EXPECT_EQ(ys.last(), ys2.last());
+
+  // bdirs contains the faces in bmask that the cell is adjacent to
+  auto zs = diff(xs, ~std::size_t(0));
+  EXPECT_EQ(ys.head() + 1000.0, zs.head());
+  EXPECT_EQ(ys.last() + 2000.0, zs.last());
+  auto ws = diff(xs, 2);
+  EXPECT_EQ(ys.head(), ws.head());
+  EXPECT_EQ(ys.last() + 2000.0, ws.last());
+  EXPECT_EQ(ys.foldMap([](double x) { return x; },
+                       [](double x, double y) { return x + y; }, 0.0) +
+                2000.0,
+            ws.foldMap([](double x) { return x; },
+                       [](double x, double y) { return x + y; }, 0.0));
+}
+
+TEST(adt_grid, copy_ghosts) {
+  // A 2D grid, and the same grid split into two blocks in direction 1
+  const adt::index_t<2> shape{{5, 6}};
+  auto xs = make_ghost_grid<2>(1, shape, {{0, 0}});
+  auto as = make_ghost_grid<2>(1, {{5, 2}}, {{0, 0}});
+  auto bs = make_ghost_grid<2>(1, {{5, 4}}, {{0, 2}});
+  for (std::ptrdiff_t i = 0; i < 4; ++i) {
+    xs.fill_ghosts(i, negate);
+    if (i != 3)
+      as.fill_ghosts(i, negate);
+    if (i != 2)
+      bs.fill_ghosts(i, negate);
+  }
+  as.copy_ghosts(3, bs);
+  bs.copy_ghosts(2, as);
+
+  // The expected result of diff, with reflecting boundaries
+  const auto value = [&](adt::index_t<2> i) {
+    double sign = 1.0;
+    for (std::size_t d = 0; d < 2; ++d) {
+      if (i[d] < 0) {
+        i[d] = -1 - i[d];
+        sign = -sign;
+      } else if (i[d] >= shape[d]) {
+        i[d] = 2 * shape[d] - 1 - i[d];
+        sign = -sign;
+      }
+    }
+    return sign * (10.0 * i[0] * i[0] + i[1] * i[1]);
+  };
+  const auto check = [&](const ghost_grid_t<2> &ys,
+                         const adt::index_t<2> &offset) {
+    typedef ghost_grid_t<2> grid_t;
+    grid_t zs(typename grid_t::iotaMapMulti(),
+              [&](adt::index_t<2> i) {
+                i += offset;
+                const adt::index_t<2> e0{{1, 0}}, e1{{0, 1}};
+                return 8.0 * value(i - e0) + 4.0 * value(i - e1) +
+                       2.0 * value(i + e0) + value(i + e1);
+              },
+              adt::steprange_t<2>(ys.shape()));
+    return ys.foldMap2([](double y, double z) { return int(y != z); },
+                       [](int x, int y) { return x + y; }, 0, zs);
+  };
+  EXPECT_EQ(0, check(diff(xs), {{0, 0}}));
+  EXPECT_EQ(0, check(diff(as), {{0, 0}}));
+  EXPECT_EQ(0, check(diff(bs), {{0, 2}}));
+
+  // Copying from the grid itself makes the boundaries periodic
+  std::ptrdiff_t s = 10;
+  auto ps = make_ghost_grid<1>(1, {{s}}, {{0}});
+  ps.copy_ghosts(0, ps);
+  ps.copy_ghosts(1, ps);
+  auto qs = diff(ps);
+  EXPECT_EQ(2.0 * 81.0 + 1.0, qs.head());
+  EXPECT_EQ(2.0 * 64.0 + 0.0, qs.last());
+}
@@ -6,6 +6,7 @@ namespace adt {
 namespace detail {
 template <typename T> struct nested_default_policy;
 }
+template <typename T> struct nested_domain_policy;
 
 template <typename P, typename A, typename T,
           typename Policy = detail::nested_default_policy<T>>
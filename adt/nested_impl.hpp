@@ -8,6 +8,7 @@
 #include <cereal/access.hpp>
 #include <cereal/types/tuple.hpp>
 
+#include <atomic>
 #include <cstddef>
 #include <type_traits>
 
@@ -33,8 +34,42 @@ template <typename T> struct nested_default_policy : std::tuple<> {
   template <typename U>
   nested_default_policy(const nested_default_policy<U> &other) {}
 };
+
+inline int next_nested_domain() {
+  static std::atomic<unsigned> next{0};
+  return next++ & 0x7fffffffU;
+}
 } // namespace detail
 
+// A policy that assigns newly created nested containers to locality
+// domains round-robin (see qthread::async_on); containers derived from
+// another one (e.g. via fmap) stay in the same domain. The domain
+// number is taken modulo the number of domains when it is used.
+template <typename T> struct nested_domain_policy {
+  constexpr std::size_t min_outer_size() const noexcept { return 0; }
+  constexpr std::size_t max_outer_size() const noexcept { return -1; }
+  constexpr std::size_t min_inner_size() const noexcept { return 0; }
+  constexpr std::size_t max_inner_size() const noexcept { return -1; }
+  template <typename U> struct rebind {
+    typedef nested_domain_policy<U> other;
+  };
+
+  int the_domain;
+  int domain() const noexcept { return the_domain; }
+
+  template <typename Archive> void serialize(Archive &ar) { ar(the_domain); }
+
+  nested_domain_policy() : the_domain(detail::next_nested_domain()) {}
+  explicit nested_domain_policy(int domain) : the_domain(domain) {}
+  nested_domain_policy(const nested_domain_policy &other) = default;
+  nested_domain_policy(nested_domain_policy &&other) = default;
+  nested_domain_policy &operator=(const nested_domain_policy &other) = default;
+  nested_domain_policy &operator=(nested_domain_policy &&other) = default;
+  template <typename U>
+  nested_domain_policy(const nested_domain_policy<U> &other)
+      : the_domain(other.domain()) {}
+};
+
 template <typename P, typename A, typename T, typename Policy> struct nested {
   // nested<P,A,T> = P<A<T>>
 
@@ -0,0 +1,16 @@
+#ifndef ADT_SOA_DECL_HPP
+#define ADT_SOA_DECL_HPP
+
+namespace adt {
+
+template <typename T> struct soa_fields;
+
+template <typename C, typename T> class soa;
+template <typename C, typename T> void swap(soa<C, T> &x, soa<C, T> &y);
+} // namespace adt
+
+#define ADT_SOA_DECL_HPP_DONE
+#endif // #ifdef ADT_SOA_DECL_HPP
+#ifndef ADT_SOA_DECL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
@@ -0,0 +1,103 @@
+#ifndef ADT_SOA_FIELDS_HPP
+#define ADT_SOA_FIELDS_HPP
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+
+namespace adt {
+
+namespace detail {
+// The field of a type that is stored as a whole
+struct soa_self {};
+} // namespace detail
+
+// soa_fields
+
+// The fields in which an adt::soa container stores its elements, and
+// which fun::simd_stencil transposes into SIMD packs. Specializations
+// define members(), returning a tuple of pointers to all data members
+// in declaration order, e.g.
+//
+//   template <> struct adt::soa_fields<cell_t> {
+//     static constexpr auto members() {
+//       return std::make_tuple(&cell_t::x, &cell_t::u, &cell_t::rho);
+//     }
+//   };
+//
+// Elements are assembled from their fields when they are converted. Since
+// members that are not listed would be lost, T must be an aggregate
+// with exactly the listed members, which must lay out to sizeof(T).
+// By default, a type is stored as a single field.
+template <typename T> struct soa_fields {
+  static constexpr auto members() {
+    return std::make_tuple(detail::soa_self());
+  }
+};
+
+namespace detail {
+template <typename T, typename M> struct soa_field;
+template <typename T> struct soa_field<T, soa_self> {
+  typedef T type;
+  static const T &get(const T &x, soa_self) { return x; }
+  static T &ref(T &x, soa_self) { return x; }
+};
+template <typename T, typename U> struct soa_field<T, U T::*> {
+  typedef U type;
+  static const U &get(const T &x, U T::*m) { return x.*m; }
+  static U &ref(T &x, U T::*m) { return x.*m; }
+};
+
+// The size of a struct with the fields Ms of T, in this order
+template <typename T, typename... Ms> constexpr std::size_t soa_layout_size() {
+  const std::size_t sizes[] = {sizeof(typename soa_field<T, Ms>::type)...};
+  const std::size_t aligns[] = {alignof(typename soa_field<T, Ms>::type)...};
+  std::size_t size = 0, align = 1;
+  for (std::size_t i = 0; i < sizeof...(Ms); ++i) {
+    size = (size + aligns[i] - 1) / aligns[i] * aligns[i] + sizes[i];
+    align = aligns[i] > align ? aligns[i] : align;
+  }
+  return (size + align - 1) / align * align;
+}
+
+// Whether T can be aggregate-initialized from N values
+struct soa_any {
+  template <typename U> operator U() const;
+};
+template <typename T, typename Is, typename = void>
+struct soa_initializable : std::false_type {};
+template <typename T, std::size_t... Is>
+struct soa_initializable<T, std::index_sequence<Is...>,
+                         decltype((void)T{((void)Is, soa_any())...})>
+    : std::true_type {};
+template <typename T, std::size_t N>
+using soa_initializable_n = soa_initializable<T, std::make_index_sequence<N>>;
+
+template <typename T, typename Ms> struct soa_members;
+template <typename T> struct soa_members<T, std::tuple<soa_self>> {
+  typedef std::tuple<soa_self> type;
+};
+template <typename T, typename... Ms>
+struct soa_members<T, std::tuple<Ms...>> {
+  typedef std::tuple<Ms...> type;
+  static_assert(soa_initializable_n<T, sizeof...(Ms)>::value &&
+                    !soa_initializable_n<T, sizeof...(Ms) + 1>::value &&
+                    soa_layout_size<T, std::decay_t<Ms>...>() == sizeof(T),
+                "adt::soa_fields must list all data members of a type, in "
+                "declaration order");
+};
+
+template <typename T>
+using soa_members_t =
+    typename soa_members<T, decltype(soa_fields<T>::members())>::type;
+template <typename T, std::size_t I>
+using soa_field_t =
+    soa_field<T, std::decay_t<std::tuple_element_t<I, soa_members_t<T>>>>;
+} // namespace detail
+} // namespace adt
+
+#define ADT_SOA_FIELDS_HPP_DONE
+#endif // #ifdef ADT_SOA_FIELDS_HPP
+#ifndef ADT_SOA_FIELDS_HPP_DONE
+#error "Cyclic include dependency"
+#endif
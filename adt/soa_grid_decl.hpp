@@ -0,0 +1,23 @@
+#ifndef ADT_SOA_GRID_DECL_HPP
+#define ADT_SOA_GRID_DECL_HPP
+
+#include <adt/dummy.hpp>
+#include <adt/grid_decl.hpp>
+#include <adt/soa_decl.hpp>
+
+#include <cstddef>
+
+namespace adt {
+
+// A grid that stores each field of its cells in a separate container
+// (structure of arrays, see adt::soa), so that loops over cells access
+// each field with unit stride
+template <typename C, typename T, std::size_t D>
+using soa_grid = grid<soa<C, dummy>, T, D>;
+} // namespace adt
+
+#define ADT_SOA_GRID_DECL_HPP_DONE
+#endif // #ifdef ADT_SOA_GRID_DECL_HPP
+#ifndef ADT_SOA_GRID_DECL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
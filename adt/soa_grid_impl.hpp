@@ -0,0 +1,13 @@
+#ifndef ADT_SOA_GRID_IMPL_HPP
+#define ADT_SOA_GRID_IMPL_HPP
+
+#include "soa_grid_decl.hpp"
+
+#include <adt/grid_impl.hpp>
+#include <adt/soa_impl.hpp>
+
+#define ADT_SOA_GRID_IMPL_HPP_DONE
+#endif // #ifdef ADT_SOA_GRID_IMPL_HPP
+#ifndef ADT_SOA_GRID_IMPL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
@@ -0,0 +1,99 @@
+#include <adt/soa_grid_decl.hpp>
+
+#include <adt/dummy.hpp>
+#include <adt/index.hpp>
+#include <fun/soa_decl.hpp>
+#include <fun/vector.hpp>
+
+#include <adt/soa_grid_impl.hpp>
+#include <fun/soa_impl.hpp>
+
+#include <gtest/gtest.h>
+
+#include <tuple>
+#include <vector>
+
+namespace {
+struct particle_t {
+  double x;
+  float m;
+  int id;
+};
+} // namespace
+
+namespace adt {
+template <> struct soa_fields<particle_t> {
+  static constexpr auto members() {
+    return std::make_tuple(&particle_t::x, &particle_t::m, &particle_t::id);
+  }
+};
+} // namespace adt
+
+namespace {
+typedef adt::soa_grid<std::vector<adt::dummy>, particle_t, 2> particle_grid;
+typedef adt::soa_grid<std::vector<adt::dummy>, double, 2> double_grid;
+
+particle_grid make_particles(const adt::index_t<2> &shape) {
+  return particle_grid(typename particle_grid::iotaMapMulti(),
+                       [](const adt::index_t<2> &i) {
+                         return particle_t{double(i[0]), float(i[1]),
+                                           int(10 * i[1] + i[0])};
+                       },
+                       shape);
+}
+} // namespace
+
+TEST(adt_soa_grid, basic) {
+  particle_grid ps;
+  EXPECT_TRUE(ps.invariant());
+  EXPECT_TRUE(ps.empty());
+
+  auto qs = make_particles({{3, 4}});
+  EXPECT_FALSE(qs.empty());
+  EXPECT_EQ(12, qs.size());
+  EXPECT_EQ(0, qs.head().id);
+  EXPECT_EQ(2.0, qs.last().x);
+  EXPECT_EQ(3.0f, qs.last().m);
+  EXPECT_EQ(32, qs.last().id);
+
+  double_grid xs(typename double_grid::iotaMapMulti(),
+                 [](const adt::index_t<2> &i) { return 1.5; },
+                 adt::steprange_t<2>(adt::index_t<2>{{2, 2}}));
+  EXPECT_EQ(4 * 1.5, xs.foldMap([](double x) { return x; },
+                                [](double x, double y) { return x + y; }, 0.0));
+}
+
+TEST(adt_soa_grid, fmap) {
+  auto ps = make_particles({{70, 3}});
+  // Rows of all fields are padded alike
+  EXPECT_EQ((adt::index_t<2>{{80, 3}}), ps.allocated());
+  auto xs = double_grid(typename double_grid::fmap(),
+                        [](const particle_t &p) { return p.x + p.m; }, ps);
+  EXPECT_EQ(69.0 + 2.0, xs.last());
+  auto qs = particle_grid(
+      typename particle_grid::fmap2(),
+      [](const particle_t &p, double x) {
+        return particle_t{x, p.m, -p.id};
+      },
+      ps, xs);
+  EXPECT_EQ(-(20 + 69), qs.last().id);
+  auto sum = qs.foldMap2(
+      [](const particle_t &q, const particle_t &p) { return q.x - p.x - p.m; },
+      [](double x, double y) { return x + y; }, 0.0, ps);
+  EXPECT_EQ(0.0, sum);
+}
+
+TEST(adt_soa_grid, boundary) {
+  auto ps = make_particles({{5, 4}});
+  typedef adt::soa_grid<std::vector<adt::dummy>, particle_t, 1> boundary_t;
+  for (std::ptrdiff_t i = 0; i < 4; ++i) {
+    auto f = i % 2, d = i / 2;
+    boundary_t bs(typename boundary_t::boundary(), ps, i);
+    EXPECT_EQ(ps.shape()[1 - d], bs.size());
+    auto b = bs.last();
+    if (d == 0)
+      EXPECT_EQ(!f ? 0.0 : 4.0, b.x);
+    else
+      EXPECT_EQ(!f ? 0.0f : 3.0f, b.m);
+  }
+}
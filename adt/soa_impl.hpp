@@ -0,0 +1,163 @@
+#ifndef ADT_SOA_IMPL_HPP
+#define ADT_SOA_IMPL_HPP
+
+#include "soa_decl.hpp"
+
+#include <adt/dummy.hpp>
+#include <adt/grid_decl.hpp>
+#include <adt/soa_fields.hpp>
+#include <fun/fun_decl.hpp>
+
+#include <cereal/access.hpp>
+#include <cereal/types/array.hpp>
+#include <cereal/types/tuple.hpp>
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace adt {
+
+namespace detail {
+// The columns of a field of type U: a container of U, or for a
+// std::array, one column per component
+template <typename C, typename U> struct soa_column {
+  typedef typename fun::fun_traits<C>::template constructor<U> type;
+  static constexpr std::size_t elem_size = sizeof(U);
+};
+
+template <typename Col, std::size_t N> struct soa_columns {
+  std::array<Col, N> cols;
+  template <typename Archive> void serialize(Archive &ar) { ar(cols); }
+};
+
+template <typename C, typename S, std::size_t N>
+struct soa_column<C, std::array<S, N>> {
+  typedef soa_columns<typename soa_column<C, S>::type, N> type;
+  static constexpr std::size_t elem_size = soa_column<C, S>::elem_size;
+};
+
+// Pointers to the first element of each column
+template <typename Col> auto soa_column_pointer(const Col &col) {
+  return &fun::getIndex(col, 0);
+}
+template <typename Col, std::size_t N>
+auto soa_column_pointer(const soa_columns<Col, N> &cs) {
+  std::array<decltype(soa_column_pointer(cs.cols[0])), N> ps;
+  for (std::size_t n = 0; n < N; ++n)
+    ps[n] = soa_column_pointer(cs.cols[n]);
+  return ps;
+}
+} // namespace detail
+
+// soa
+
+// A container that stores each field (see soa_fields) of its elements
+// in a separate container C (structure of arrays), so that loops over
+// the elements access each field with unit stride. Fields that are
+// std::arrays are stored as one container per component. Elements are
+// read as references (see fun::soa_element) that load a field only
+// when it is accessed, and are assembled from all fields when they
+// are converted to T. As storage of an adt::grid (see soa_grid), all
+// fields share the layout of the grid.
+template <typename C, typename T> class soa {
+public:
+  static_assert(
+      std::is_same<typename fun::fun_traits<C>::value_type, adt::dummy>::value,
+      "");
+
+  typedef C container_dummy;
+  template <typename U>
+  using container_constructor =
+      typename fun::fun_traits<C>::template constructor<U>;
+  typedef T value_type;
+
+  static constexpr std::size_t nfields =
+      std::tuple_size<detail::soa_members_t<T>>::value;
+  template <std::size_t I>
+  using field_type = typename detail::soa_field_t<T, I>::type;
+  template <std::size_t I>
+  using column_type = typename detail::soa_column<C, field_type<I>>::type;
+
+private:
+  template <typename Is> struct fields;
+  template <std::size_t... Is> struct fields<std::index_sequence<Is...>> {
+    typedef std::tuple<column_type<Is>...> type;
+  };
+
+public:
+  typedef typename fields<std::make_index_sequence<nfields>>::type
+      fields_type;
+
+private:
+  fields_type data;
+
+  friend class cereal::access;
+  template <typename Archive> void serialize(Archive &ar) { ar(data); }
+
+public:
+  soa() = default;
+  explicit soa(fields_type data) : data(std::move(data)) {}
+
+  soa(const soa &) = default;
+  soa(soa &&) = default;
+  soa &operator=(const soa &) = default;
+  soa &operator=(soa &&) = default;
+  void swap(soa &other) {
+    using std::swap;
+    swap(data, other.data);
+  }
+
+  // The columns holding field I of all elements
+  template <std::size_t I> const column_type<I> &field() const noexcept {
+    return std::get<I>(data);
+  }
+
+private:
+  template <std::size_t... Is> auto pointers(std::index_sequence<Is...>) const {
+    return std::make_tuple(detail::soa_column_pointer(field<Is>())...);
+  }
+
+public:
+  // non-standard: Pointers to the first element of each field (a
+  // std::array of pointers for std::array fields), e.g. to load SIMD
+  // packs. The container must not be empty.
+  auto pointers() const {
+    return pointers(std::make_index_sequence<nfields>());
+  }
+};
+template <typename C, typename T> void swap(soa<C, T> &x, soa<C, T> &y) {
+  x.swap(y);
+}
+
+namespace detail {
+constexpr std::size_t soa_gcd(std::size_t a, std::size_t b) {
+  return b == 0 ? a : soa_gcd(b, a % b);
+}
+template <typename C, typename T, std::size_t... Is>
+constexpr std::size_t soa_elem_size(std::index_sequence<Is...>) {
+  const std::size_t sizes[] = {
+      soa_column<C, typename soa_field_t<T, Is>::type>::elem_size...};
+  std::size_t size = 0;
+  for (std::size_t s : sizes)
+    size = soa_gcd(size, s);
+  return size;
+}
+
+// Padding rows for the greatest common divisor of the column element
+// sizes aligns the rows of every column
+template <typename C, typename T> struct grid_storage<soa<C, dummy>, T> {
+  static constexpr std::size_t elem_size = soa_elem_size<C, T>(
+      std::make_index_sequence<soa<C, T>::nfields>());
+  typedef std::true_type structure_of_arrays;
+};
+} // namespace detail
+} // namespace adt
+
+#define ADT_SOA_IMPL_HPP_DONE
+#endif // #ifdef ADT_SOA_IMPL_HPP
+#ifndef ADT_SOA_IMPL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
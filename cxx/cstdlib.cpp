@@ -25,4 +25,16 @@ long envtol(const char *var, const char *defaultvalue) {
   }
   return res;
 }
+
+std::string envtostr(const char *var, const char *defaultvalue) {
+  assert(var);
+  const char *str = std::getenv(var);
+  if (!str)
+    str = defaultvalue;
+  if (!str) {
+    std::cerr << "Could not getenv(\"" << var << "\")\n";
+    std::exit(EXIT_FAILURE);
+  }
+  return str;
+}
 } // namespace cxx
@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <string>
 #include <type_traits>
 #include <utility>
 
@@ -106,6 +107,7 @@ template <typename T, typename U> constexpr T ipow(T x, U y) {
 }
 
 long envtol(const char *var, const char *defaultvalue = nullptr);
+std::string envtostr(const char *var, const char *defaultvalue = nullptr);
 } // namespace cxx
 
 #define CXX_CSTDLIB_HPP_DONE
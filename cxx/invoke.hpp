@@ -276,7 +276,8 @@ auto invoke(_Fp &&__f, _Args &&... __args)
 
 template <class _Fp, class... _Args>
 struct invokable_imp : private check_complete<_Fp> {
-  typedef decltype(invoke(std::declval<_Fp>(), std::declval<_Args>()...)) type;
+  typedef decltype(
+      cxx::invoke(std::declval<_Fp>(), std::declval<_Args>()...)) type;
   static const bool value = !std::is_same<type, __nat>::value;
 };
 
@@ -0,0 +1,260 @@
+#ifndef CXX_SIMD_HPP
+#define CXX_SIMD_HPP
+
+#include <cxx/cassert.hpp>
+
+#if defined __AVX512F__ || defined __AVX__ || defined __SSE2__
+#include <immintrin.h>
+#elif defined __ARM_NEON && defined __aarch64__
+#include <arm_neon.h>
+#endif
+
+#include <cstddef>
+
+namespace cxx {
+
+namespace detail {
+// Generic lane-by-lane gather, for targets without gather instructions
+template <typename I, typename T>
+typename I::reg_t simd_gather_lanes(const T *p, std::ptrdiff_t stride) {
+  T xs[I::size];
+  for (std::size_t i = 0; i < I::size; ++i)
+    xs[i] = p[std::ptrdiff_t(i) * stride];
+  return I::loadu(xs);
+}
+
+// Scalar fallback: Each pack holds a single element
+template <typename T> struct simd_impl {
+  typedef T reg_t;
+  static constexpr std::size_t size = 1;
+  static reg_t set1(T x) { return x; }
+  static reg_t loadu(const T *p) { return *p; }
+  static void storeu(T *p, reg_t x) { *p = x; }
+  static reg_t gather(const T *p, std::ptrdiff_t stride) {
+    return simd_gather_lanes<simd_impl>(p, stride);
+  }
+  static reg_t add(reg_t x, reg_t y) { return x + y; }
+  static reg_t sub(reg_t x, reg_t y) { return x - y; }
+  static reg_t mul(reg_t x, reg_t y) { return x * y; }
+  static reg_t div(reg_t x, reg_t y) { return x / y; }
+};
+
+#if defined __AVX512F__
+
+template <> struct simd_impl<double> {
+  typedef __m512d reg_t;
+  static constexpr std::size_t size = 8;
+  static reg_t set1(double x) { return _mm512_set1_pd(x); }
+  static reg_t loadu(const double *p) { return _mm512_loadu_pd(p); }
+  static void storeu(double *p, reg_t x) { _mm512_storeu_pd(p, x); }
+  static reg_t gather(const double *p, std::ptrdiff_t stride) {
+    const __m512i idx = _mm512_set_epi64(7 * stride, 6 * stride, 5 * stride,
+                                         4 * stride, 3 * stride, 2 * stride,
+                                         stride, 0);
+    return _mm512_i64gather_pd(idx, p, sizeof(double));
+  }
+  static reg_t add(reg_t x, reg_t y) { return _mm512_add_pd(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return _mm512_sub_pd(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return _mm512_mul_pd(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return _mm512_div_pd(x, y); }
+};
+
+template <> struct simd_impl<float> {
+  typedef __m512 reg_t;
+  static constexpr std::size_t size = 16;
+  static reg_t set1(float x) { return _mm512_set1_ps(x); }
+  static reg_t loadu(const float *p) { return _mm512_loadu_ps(p); }
+  static void storeu(float *p, reg_t x) { _mm512_storeu_ps(p, x); }
+  static reg_t gather(const float *p, std::ptrdiff_t stride) {
+    const __m512i idx =
+        _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7,
+                                            6, 5, 4, 3, 2, 1, 0),
+                           _mm512_set1_epi32(int(stride)));
+    return _mm512_i32gather_ps(idx, p, sizeof(float));
+  }
+  static reg_t add(reg_t x, reg_t y) { return _mm512_add_ps(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return _mm512_sub_ps(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return _mm512_mul_ps(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return _mm512_div_ps(x, y); }
+};
+
+#elif defined __AVX__
+
+template <> struct simd_impl<double> {
+  typedef __m256d reg_t;
+  static constexpr std::size_t size = 4;
+  static reg_t set1(double x) { return _mm256_set1_pd(x); }
+  static reg_t loadu(const double *p) { return _mm256_loadu_pd(p); }
+  static void storeu(double *p, reg_t x) { _mm256_storeu_pd(p, x); }
+  static reg_t gather(const double *p, std::ptrdiff_t stride) {
+#ifdef __AVX2__
+    const __m256i idx = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+    return _mm256_i64gather_pd(p, idx, sizeof(double));
+#else
+    return simd_gather_lanes<simd_impl>(p, stride);
+#endif
+  }
+  static reg_t add(reg_t x, reg_t y) { return _mm256_add_pd(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return _mm256_sub_pd(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return _mm256_mul_pd(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return _mm256_div_pd(x, y); }
+};
+
+template <> struct simd_impl<float> {
+  typedef __m256 reg_t;
+  static constexpr std::size_t size = 8;
+  static reg_t set1(float x) { return _mm256_set1_ps(x); }
+  static reg_t loadu(const float *p) { return _mm256_loadu_ps(p); }
+  static void storeu(float *p, reg_t x) { _mm256_storeu_ps(p, x); }
+  static reg_t gather(const float *p, std::ptrdiff_t stride) {
+#ifdef __AVX2__
+    const __m256i idx =
+        _mm256_mullo_epi32(_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0),
+                           _mm256_set1_epi32(int(stride)));
+    return _mm256_i32gather_ps(p, idx, sizeof(float));
+#else
+    return simd_gather_lanes<simd_impl>(p, stride);
+#endif
+  }
+  static reg_t add(reg_t x, reg_t y) { return _mm256_add_ps(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return _mm256_sub_ps(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return _mm256_mul_ps(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return _mm256_div_ps(x, y); }
+};
+
+#elif defined __SSE2__
+
+template <> struct simd_impl<double> {
+  typedef __m128d reg_t;
+  static constexpr std::size_t size = 2;
+  static reg_t set1(double x) { return _mm_set1_pd(x); }
+  static reg_t loadu(const double *p) { return _mm_loadu_pd(p); }
+  static void storeu(double *p, reg_t x) { _mm_storeu_pd(p, x); }
+  static reg_t gather(const double *p, std::ptrdiff_t stride) {
+    return _mm_set_pd(p[stride], p[0]);
+  }
+  static reg_t add(reg_t x, reg_t y) { return _mm_add_pd(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return _mm_sub_pd(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return _mm_mul_pd(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return _mm_div_pd(x, y); }
+};
+
+template <> struct simd_impl<float> {
+  typedef __m128 reg_t;
+  static constexpr std::size_t size = 4;
+  static reg_t set1(float x) { return _mm_set1_ps(x); }
+  static reg_t loadu(const float *p) { return _mm_loadu_ps(p); }
+  static void storeu(float *p, reg_t x) { _mm_storeu_ps(p, x); }
+  static reg_t gather(const float *p, std::ptrdiff_t stride) {
+    return simd_gather_lanes<simd_impl>(p, stride);
+  }
+  static reg_t add(reg_t x, reg_t y) { return _mm_add_ps(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return _mm_sub_ps(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return _mm_mul_ps(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return _mm_div_ps(x, y); }
+};
+
+#elif defined __ARM_NEON && defined __aarch64__
+
+template <> struct simd_impl<double> {
+  typedef float64x2_t reg_t;
+  static constexpr std::size_t size = 2;
+  static reg_t set1(double x) { return vdupq_n_f64(x); }
+  static reg_t loadu(const double *p) { return vld1q_f64(p); }
+  static void storeu(double *p, reg_t x) { vst1q_f64(p, x); }
+  static reg_t gather(const double *p, std::ptrdiff_t stride) {
+    return simd_gather_lanes<simd_impl>(p, stride);
+  }
+  static reg_t add(reg_t x, reg_t y) { return vaddq_f64(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return vsubq_f64(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return vmulq_f64(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return vdivq_f64(x, y); }
+};
+
+template <> struct simd_impl<float> {
+  typedef float32x4_t reg_t;
+  static constexpr std::size_t size = 4;
+  static reg_t set1(float x) { return vdupq_n_f32(x); }
+  static reg_t loadu(const float *p) { return vld1q_f32(p); }
+  static void storeu(float *p, reg_t x) { vst1q_f32(p, x); }
+  static reg_t gather(const float *p, std::ptrdiff_t stride) {
+    return simd_gather_lanes<simd_impl>(p, stride);
+  }
+  static reg_t add(reg_t x, reg_t y) { return vaddq_f32(x, y); }
+  static reg_t sub(reg_t x, reg_t y) { return vsubq_f32(x, y); }
+  static reg_t mul(reg_t x, reg_t y) { return vmulq_f32(x, y); }
+  static reg_t div(reg_t x, reg_t y) { return vdivq_f32(x, y); }
+};
+
+#endif
+} // namespace detail
+
+// A pack of elements of type T that fills one vector register of the
+// target architecture (AVX-512, AVX/AVX2, SSE2, or NEON). Other types, or
+// targets without a vector backend, use packs of a single element.
+// Arithmetic mixes packs and scalars; scalars are broadcast.
+template <typename T> class simd {
+  typedef detail::simd_impl<T> impl;
+  typedef typename impl::reg_t reg_t;
+  struct reg_tag {};
+  reg_t v;
+  simd(reg_tag, reg_t v) : v(v) {}
+
+public:
+  typedef T value_type;
+  static constexpr std::size_t size() { return impl::size; }
+
+  // Value-initialization (simd<T>{}) sets all elements to zero
+  simd() = default;
+  simd(T x) : v(impl::set1(x)) {}
+
+  static simd loadu(const T *p) { return simd(reg_tag(), impl::loadu(p)); }
+  void storeu(T *p) const { impl::storeu(p, v); }
+  // Load the elements p[0], p[stride], p[2 * stride], ...
+  static simd gather(const T *p, std::ptrdiff_t stride) {
+    return simd(reg_tag(), impl::gather(p, stride));
+  }
+  void scatter(T *p, std::ptrdiff_t stride) const {
+    T xs[size()];
+    storeu(xs);
+    for (std::size_t i = 0; i < size(); ++i)
+      p[std::ptrdiff_t(i) * stride] = xs[i];
+  }
+
+  T operator[](std::size_t i) const {
+    cxx_assert(i < size());
+    T xs[size()];
+    storeu(xs);
+    return xs[i];
+  }
+
+  simd operator+() const { return *this; }
+  simd operator-() const {
+    return simd(reg_tag(), impl::sub(impl::set1(T(0)), v));
+  }
+
+  friend simd operator+(const simd &x, const simd &y) {
+    return simd(reg_tag(), impl::add(x.v, y.v));
+  }
+  friend simd operator-(const simd &x, const simd &y) {
+    return simd(reg_tag(), impl::sub(x.v, y.v));
+  }
+  friend simd operator*(const simd &x, const simd &y) {
+    return simd(reg_tag(), impl::mul(x.v, y.v));
+  }
+  friend simd operator/(const simd &x, const simd &y) {
+    return simd(reg_tag(), impl::div(x.v, y.v));
+  }
+
+  simd &operator+=(const simd &y) { return *this = *this + y; }
+  simd &operator-=(const simd &y) { return *this = *this - y; }
+  simd &operator*=(const simd &y) { return *this = *this * y; }
+  simd &operator/=(const simd &y) { return *this = *this / y; }
+};
+} // namespace cxx
+
+#define CXX_SIMD_HPP_DONE
+#endif // #ifdef CXX_SIMD_HPP
+#ifndef CXX_SIMD_HPP_DONE
+#error "Cyclic include dependency"
+#endif
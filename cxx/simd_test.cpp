@@ -0,0 +1,58 @@
+#include <cxx/simd.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace {
+template <typename T> void test_simd() {
+  typedef cxx::simd<T> S;
+  const std::size_t n = S::size();
+  EXPECT_GE(n, 1);
+
+  const S z{};
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(T(0), z[i]);
+
+  std::vector<T> xs(n), ys(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    xs[i] = T(i + 1);
+    ys[i] = T(2 * i + 3);
+  }
+  const S x = S::loadu(xs.data());
+  const S y = S::loadu(ys.data());
+  const S r = T(2) * x + y / T(2) - -x * y;
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(2 * xs[i] + ys[i] / 2 + xs[i] * ys[i], r[i]);
+
+  S a = x;
+  a += y;
+  a *= T(3);
+  a -= T(1);
+  a /= T(2);
+  std::vector<T> as(n);
+  a.storeu(as.data());
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ((3 * (xs[i] + ys[i]) - 1) / 2, as[i]);
+
+  const std::ptrdiff_t stride = 3;
+  std::vector<T> zs(n * stride, T(-1));
+  x.scatter(zs.data() + 1, stride);
+  for (std::size_t i = 0; i < n * stride; ++i)
+    EXPECT_EQ(i % stride == 1 ? xs[i / stride] : T(-1), zs[i]);
+  const S g = S::gather(zs.data() + 1, stride);
+  for (std::size_t i = 0; i < n; ++i)
+    EXPECT_EQ(xs[i], g[i]);
+}
+} // namespace
+
+TEST(cxx_simd, double) { test_simd<double>(); }
+
+TEST(cxx_simd, float) { test_simd<float>(); }
+
+TEST(cxx_simd, int) {
+  // Types without a vector backend use packs of a single element
+  EXPECT_EQ(1, cxx::simd<int>::size());
+  test_simd<int>();
+}
@@ -0,0 +1,95 @@
+// Benchmark cache-blocked traversal of 3D grids: A 7-point Laplacian
+// is evaluated via fmapStencilMulti and combined with its input via
+// fmap2, once traversing the grids in lexicographic order and once
+// tile by tile. Only the stencil is tiled; tiles span the outermost
+// dimension, so that the neighbouring planes of a tile stay in cache.
+// The tile size is taken from FUNHPC_GRID_TILE_BYTES, or defaults to
+// half of a typical L2 cache.
+
+#include <adt/grid_decl.hpp>
+
+#include <adt/dummy.hpp>
+#include <adt/index.hpp>
+#include <fun/vector.hpp>
+#include <funhpc/main.hpp>
+
+#include <adt/grid_impl.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <sys/time.h>
+#include <vector>
+
+namespace {
+double gettime() {
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return tv.tv_sec + tv.tv_usec / 1.0e+6;
+}
+
+typedef adt::grid<std::vector<adt::dummy>, double, 2> grid2;
+typedef adt::grid<std::vector<adt::dummy>, double, 3> grid3;
+
+double sum(const grid3 &g) {
+  return g.foldMap([](double x) { return x; },
+                   [](double x, double y) { return x + y; }, 0.0);
+}
+
+// Returns the time per grid point in nanoseconds
+double bench(std::ptrdiff_t n, std::size_t tile_bytes, double &result) {
+  adt::set_grid_tile_bytes(tile_bytes);
+  const auto laplace = [](double u, std::size_t bdirs, double um0, double um1,
+                          double um2, double up0, double up1, double up2) {
+    return um0 + up0 + um1 + up1 + um2 + up2 - 6 * u;
+  };
+  const auto get_face = [](double u, std::ptrdiff_t face) { return u; };
+  const adt::index_t<3> shape{{n, n, n}};
+  const auto x = grid3(grid3::iotaMapMulti(),
+                       [](const adt::index_t<3> &i) {
+                         return double((i[0] + 3 * i[1] + 5 * i[2]) % 17);
+                       },
+                       shape);
+  // Dirichlet boundaries
+  const auto b = grid2(grid2::iotaMapMulti(),
+                       [](const adt::index_t<2> &i) { return 0.0; },
+                       adt::index_t<2>{{n, n}});
+  // Repeat so that each measurement covers about 10^8 points
+  const std::ptrdiff_t iters =
+      std::max(std::ptrdiff_t(1), 100000000 / (n * n * n));
+  const double t0 = gettime();
+  result = 0;
+  for (std::ptrdiff_t iter = 0; iter < iters; ++iter) {
+    const auto y = grid3(grid3::fmapStencilMulti(), laplace, get_face, x, ~0,
+                         b, b, b, b, b, b);
+    const auto z = grid3(grid3::fmap2(),
+                         [](double x, double y) { return x + 0.1 * y; }, x, y);
+    result += z.head();
+  }
+  const double t1 = gettime();
+  result += sum(x);
+  return (t1 - t0) / iters / (n * n * n) * 1.0e+9;
+}
+} // namespace
+
+int funhpc_main(int argc, char **argv) {
+  std::cout << "Grid Tiling Benchmark\n";
+  const std::size_t tile_bytes0 = adt::get_grid_tile_bytes();
+  const std::size_t tile_bytes = tile_bytes0 ? tile_bytes0 : 131072;
+  std::cout << "Tile size: " << tile_bytes << " bytes\n";
+  std::cout << std::setw(8) << "n" << std::setw(16) << "untiled [ns]"
+            << std::setw(16) << "tiled [ns]" << "\n";
+  for (std::ptrdiff_t n = 16; n <= 256; n *= 2) {
+    double r0, r1;
+    const double t0 = bench(n, 0, r0);
+    const double t1 = bench(n, tile_bytes, r1);
+    if (r0 != r1)
+      std::cout << "Error: results differ\n";
+    std::cout << std::setw(8) << n << std::setw(16) << t0 << std::setw(16)
+              << t1 << "\n";
+  }
+  adt::set_grid_tile_bytes(tile_bytes0);
+  std::cout << "Done.\n";
+  return 0;
+}
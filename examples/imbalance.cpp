@@ -0,0 +1,79 @@
+#include <cxx/cstdlib.hpp>
+#include <funhpc/async.hpp>
+#include <funhpc/main.hpp>
+#include <qthread/future.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sys/time.h>
+#include <vector>
+
+// Compare static task placement with work stealing for an imbalanced
+// workload: with static placement, all expensive tasks land on the
+// same process.
+
+double gettime() {
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return tv.tv_sec + tv.tv_usec / 1.0e+6;
+}
+
+double do_work(double x, std::int64_t items) {
+  for (std::int64_t i = 0; i < items; ++i)
+    x = std::sqrt(x);
+  return x;
+}
+
+const std::int64_t ntasks = 1000;
+const std::int64_t light_items = 1000;
+const std::int64_t heavy_items = 1000000;
+
+std::int64_t task_items(std::int64_t i) {
+  return cxx::div_floor(i, funhpc::size()).rem == 0 ? heavy_items
+                                                    : light_items;
+}
+
+double run_static() {
+  std::vector<qthread::future<double>> fs(ntasks);
+  for (std::int64_t i = 0; i < ntasks; ++i) {
+    int p = cxx::div_floor(i, funhpc::size()).rem;
+    fs[i] = funhpc::async(funhpc::rlaunch::async, p, do_work, 1.0,
+                          task_items(i));
+  }
+  double sum = 0.0;
+  for (auto &f : fs)
+    sum += f.get();
+  return sum;
+}
+
+double run_anywhere() {
+  std::vector<qthread::future<double>> fs(ntasks);
+  for (std::int64_t i = 0; i < ntasks; ++i)
+    fs[i] = funhpc::async(funhpc::rlaunch::async | funhpc::rlaunch::anywhere,
+                          do_work, 1.0, task_items(i));
+  double sum = 0.0;
+  for (auto &f : fs)
+    sum += f.get();
+  return sum;
+}
+
+template <typename F> void runbench(const char *name, F &&f) {
+  auto t0 = gettime();
+  auto sum = f();
+  auto t1 = gettime();
+  std::cout << "   " << std::left << std::setw(16) << name << (t1 - t0)
+            << " sec   (" << sum << ")\n";
+}
+
+int funhpc_main(int argc, char **argv) {
+  std::cout << "Imbalanced Workload Benchmark\n"
+            << "\n";
+
+  runbench("static", run_static);
+  runbench("anywhere", run_anywhere);
+
+  std::cout << "Done.\n";
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <funhpc/async.hpp>
 #include <funhpc/main.hpp>
 #include <funhpc/rexec.hpp>
 #include <qthread/future.hpp>
@@ -17,6 +18,16 @@ void pong() { p->set_value(); }
 
 void ping() { funhpc::rexec(0, pong); }
 
+int echo(int x) { return x; }
+
+// Return a result via a general task, as async did before it used
+// reply messages
+std::unique_ptr<qthread::promise<int>> pi;
+
+void set_echo(int x) { pi->set_value(x); }
+
+void echo_task(int x) { funhpc::rexec(0, set_echo, x); }
+
 int funhpc_main(int argc, char **argv) {
   std::cout << "Ping-Pong\n";
   std::size_t count = 1000;
@@ -33,6 +44,39 @@ int funhpc_main(int argc, char **argv) {
                        .count() /
                    count
             << " μs)\n";
+
+  // The result of a remote async call is returned via a reply
+  // message, which is cheaper than a general task
+  int sum = 0;
+  auto t4 = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < count; ++i) {
+    pi = std::make_unique<qthread::promise<int>>();
+    funhpc::rexec(1 % funhpc::size(), echo_task, 1);
+    sum += pi->get_future().get();
+    pi.reset();
+  }
+  auto t5 = std::chrono::high_resolution_clock::now();
+  if (sum != int(count))
+    std::cout << "   error: wrong result\n";
+  std::cout << "   task round-trip time: ("
+            << std::chrono::duration_cast<std::chrono::microseconds>(t5 - t4)
+                       .count() /
+                   count
+            << " μs)\n";
+
+  sum = 0;
+  auto t2 = std::chrono::high_resolution_clock::now();
+  for (std::size_t i = 0; i < count; ++i)
+    sum += funhpc::async(funhpc::rlaunch::async, 1 % funhpc::size(), echo, 1)
+               .get();
+  auto t3 = std::chrono::high_resolution_clock::now();
+  if (sum != int(count))
+    std::cout << "   error: wrong result\n";
+  std::cout << "   async round-trip time: ("
+            << std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2)
+                       .count() /
+                   count
+            << " μs)\n";
   std::cout << "Done.\n";
   return 0;
 }
@@ -1,11 +1,13 @@
 #include <adt/dummy.hpp>
-#include <cxx/funobj.hpp>
+#include <adt/soa_fields.hpp>
+#include <cxx/simd.hpp>
 #include <fun/fun_decl.hpp>
 #include <fun/maxarray.hpp>
 #include <fun/nested_decl.hpp>
 #include <fun/proxy.hpp>
 #include <fun/shared_future.hpp>
 #include <fun/shared_ptr.hpp>
+#include <fun/simd_stencil.hpp>
 #include <fun/tree_decl.hpp>
 #include <fun/vector.hpp>
 #include <funhpc/main.hpp>
@@ -19,6 +21,7 @@
 #include <cereal/types/vector.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <functional>
@@ -26,6 +29,7 @@
 #include <limits>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <utility>
 
 // Types
@@ -51,6 +55,11 @@ struct parameters_t {
   int_t outfile_every;
   std::string outfile_name;
 
+  // Evaluate the RHS in SIMD packs of cells. The cells are stored as a
+  // whole, so that packs are gathered from them, which is not faster
+  // than evaluating one cell at a time.
+  bool simd_rhs = false;
+
   void setup() {
     dx = (xmax - xmin) / ncells;
     dx_1 = 1.0 / dx;
@@ -100,12 +109,25 @@ auto norm_zero() { return norm_t(); }
 
 // Cell
 
-struct cell_t {
-  real_t x;
-  real_t u, rho, v;
+template <typename R> struct cell_tmpl {
+  R x;
+  R u, rho, v;
   template <typename Archive> void serialize(Archive &ar) { ar(x, u, rho, v); }
 };
 
+typedef cell_tmpl<real_t> cell_t;
+// A pack of cells, for evaluating the RHS with SIMD instructions
+typedef cell_tmpl<cxx::simd<real_t>> cell_simd_t;
+
+namespace adt {
+template <typename R> struct soa_fields<cell_tmpl<R>> {
+  static constexpr auto members() {
+    return std::make_tuple(&cell_tmpl<R>::x, &cell_tmpl<R>::u,
+                           &cell_tmpl<R>::rho, &cell_tmpl<R>::v);
+  }
+};
+} // namespace adt
+
 std::ostream &operator<<(std::ostream &os, const cell_t &c) {
   return os << "cell_t{x=" << c.x << " u=" << c.u << " rho=" << c.rho
             << " v=" << c.v << "}";
@@ -151,14 +173,18 @@ auto cell_boundary_reflecting(const cell_t &c, int_t i) {
                 -c.u, -c.rho, c.v};
 }
 
-auto cell_rhs(const cell_t &c, size_t bdirs, const cell_t &bm,
-              const cell_t &bp) {
-  auto dx_1 = parameters.dx_1;
-  auto u_rhs = c.rho;
-  auto rho_rhs = (-0.5 * bm.v + 0.5 * bp.v) * dx_1;
-  auto v_rhs = (-0.5 * bm.rho + 0.5 * bp.rho) * dx_1;
-  return cell_t{0.0, u_rhs, rho_rhs, v_rhs};
-}
+// The RHS is generic so that it can be evaluated on cells as well as on
+// packs of cells
+struct cell_rhs : std::tuple<> {
+  template <typename C>
+  C operator()(const C &c, size_t bdirs, const C &bm, const C &bp) const {
+    auto dx_1 = parameters.dx_1;
+    auto u_rhs = c.rho;
+    auto rho_rhs = (-0.5 * bm.v + 0.5 * bp.v) * dx_1;
+    auto v_rhs = (-0.5 * bm.rho + 0.5 * bp.rho) * dx_1;
+    return C{0.0, u_rhs, rho_rhs, v_rhs};
+  }
+};
 
 // Grid
 
@@ -230,11 +256,13 @@ auto grid_error(const grid_t &g) {
 }
 
 auto grid_norm(const grid_t &g) {
-  return fun::foldMap(cell_norm, norm_add, norm_zero(), g.cells);
+  // The blocks are reduced on their owning processes
+  return fun::foldMapAsync(cell_norm, norm_add, norm_zero(), g.cells).get();
 }
 
 auto grid_energy(const grid_t &g) {
-  return fun::foldMap(cell_energy, std::plus<real_t>(), 0.0, g.cells);
+  return fun::foldMapAsync(cell_energy, std::plus<real_t>(), 0.0, g.cells)
+      .get();
 }
 
 auto grid_boundary(const grid_t &g, int_t i) {
@@ -243,12 +271,18 @@ auto grid_boundary(const grid_t &g, int_t i) {
       i == 0 ? fun::head(g.cells) : fun::last(g.cells), i);
 }
 
-auto cell_get_face(const cell_t &c, int_t i) { return c; }
+struct cell_get_face : std::tuple<> {
+  template <typename C> C operator()(const C &c, int_t i) const { return c; }
+};
 auto grid_rhs(const grid_t &g) {
-  return grid_t{1.0,
-                fun::fmapStencil(CXX_FUNOBJ(cell_rhs),
-                                 CXX_FUNOBJ(cell_get_face), g.cells, 0b11,
-                                 grid_boundary(g, 0), grid_boundary(g, 1))};
+  if (parameters.simd_rhs)
+    return grid_t{
+        1.0, fun::fmapStencil(fun::make_simd_stencil<cell_simd_t>(cell_rhs()),
+                              cell_get_face(), g.cells, 0b11,
+                              grid_boundary(g, 0), grid_boundary(g, 1))};
+  return grid_t{1.0, fun::fmapStencil(cell_rhs(), cell_get_face(), g.cells,
+                                      0b11, grid_boundary(g, 0),
+                                      grid_boundary(g, 1))};
 }
 
 // Schedule
@@ -326,7 +360,17 @@ int funhpc_main(int argc, char **argv) {
   parameters.outinfo_every = parameters.nsteps / 10;
   parameters.outfile_every = parameters.nsteps / 20;
   parameters.outfile_name = "wave1d.tsv";
+  // Pass --simd-rhs to evaluate the RHS in SIMD packs instead
+  for (int i = 1; i < argc; ++i)
+    if (std::string(argv[i]) == "--simd-rhs")
+      parameters.simd_rhs = true;
   parameters.setup();
+  if (parameters.simd_rhs)
+    std::cout << "RHS: SIMD packs of " << cxx::simd<real_t>::size()
+              << " cells\n";
+  else
+    std::cout << "RHS: scalar\n";
+  auto t0 = std::chrono::steady_clock::now();
   qthread::shared_future<int> info_token = qthread::make_ready_future(0);
   qthread::shared_future<int> file_token = qthread::make_ready_future(0);
   schedule_t s(0, grid_init(parameters.tmin));
@@ -339,6 +383,9 @@ int funhpc_main(int argc, char **argv) {
   }
   info_token.wait();
   file_token.wait();
+  auto t1 = std::chrono::steady_clock::now();
+  std::cout << "Time: " << std::chrono::duration<double>(t1 - t0).count()
+            << " s\n";
   std::cout << "Done.\n";
   return 0;
 }
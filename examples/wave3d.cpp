@@ -1,7 +1,9 @@
 #include <adt/dummy.hpp>
 #include <adt/index.hpp>
+#include <adt/soa_fields.hpp>
 #include <cxx/apply.hpp>
 #include <cxx/funobj.hpp>
+#include <cxx/simd.hpp>
 #include <cxx/tuple.hpp>
 #include <cxx/utility.hpp>
 #include <fun/array.hpp>
@@ -12,6 +14,8 @@
 #include <fun/proxy.hpp>
 #include <fun/shared_future.hpp>
 #include <fun/shared_ptr.hpp>
+#include <fun/simd_stencil.hpp>
+#include <fun/soa_grid_decl.hpp>
 #include <fun/tree_decl.hpp>
 #include <fun/vector.hpp>
 #include <funhpc/main.hpp>
@@ -20,12 +24,14 @@
 #include <fun/fun_impl.hpp>
 #include <fun/grid_impl.hpp>
 #include <fun/nested_impl.hpp>
+#include <fun/soa_grid_impl.hpp>
 #include <fun/tree_impl.hpp>
 
 #include <cereal/types/memory.hpp>
 #include <cereal/types/vector.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <functional>
@@ -74,6 +80,15 @@ struct parameters_t {
   int_t outfile_every;
   std::string outfile_name;
 
+  // Evaluate the RHS in SIMD packs of cells. The cells are stored as a
+  // whole, so that packs are gathered from them, which is not faster
+  // than evaluating one cell at a time.
+  bool simd_rhs = false;
+
+  // The standing wave is periodic on [xmin, xmax], so that the
+  // boundaries can be reflecting or periodic
+  bool periodic = false;
+
   void setup() {
     dx = (xmax - xmin) / ncells;
     dx_1 = 1.0 / dx;
@@ -128,13 +143,31 @@ struct norm_t {
 
 // Cell
 
-struct cell_t {
-  vreal_t x;
-  real_t u, rho;
-  vreal_t v;
+template <typename R> struct cell_tmpl {
+  std::array<R, dim> x;
+  R u, rho;
+  std::array<R, dim> v;
   template <typename Archive> void serialize(Archive &ar) { ar(x, u, rho, v); }
 };
 
+typedef cell_tmpl<real_t> cell_t;
+// A pack of cells, for evaluating the RHS with SIMD instructions
+typedef cell_tmpl<cxx::simd<real_t>> cell_simd_t;
+
+// Fields for structure-of-arrays storage (see soa_maxarray_grid) and
+// for SIMD packs
+namespace adt {
+template <typename R> struct soa_fields<cell_tmpl<R>> {
+  static constexpr auto members() {
+    return std::make_tuple(&cell_tmpl<R>::x, &cell_tmpl<R>::u,
+                           &cell_tmpl<R>::rho, &cell_tmpl<R>::v);
+  }
+};
+} // namespace adt
+
+// The indices of these fields, e.g. for fun::getField
+enum cell_field : std::size_t { cell_x, cell_u, cell_rho, cell_v };
+
 std::ostream &operator<<(std::ostream &os, const cell_t &c) {
   return os << "cell_t{x=" << c.x << " u=" << c.u << " rho=" << c.rho
             << " v=" << c.v << "}";
@@ -191,28 +224,40 @@ auto cell_boundary_reflecting(const cell_t &c, int_t i) {
   return cell_t{xbnd, -c.u, -c.rho, adt::update(-c.v, d, c.v[d])};
 }
 
-auto cell_get_face(const cell_t &c, int_t i) { return c; }
+struct cell_get_face : std::tuple<> {
+  template <typename C> C operator()(const C &c, int_t i) const { return c; }
+};
 
-template <typename... Bnds>
-auto cell_rhs(const cell_t &c, std::size_t bdirs, Bnds &&... bnds) {
-  static_assert(sizeof...(Bnds) == 2 * dim, "");
-  static_assert(cxx::all_of_type<
-                    std::is_same<std::decay_t<Bnds>, cell_t>::value...>::value,
-                "");
-  auto bs = std::forward_as_tuple(bnds...);
-  auto bm = cxx::to_array(cxx::tuple_section<0, dim>(bs));
-  auto bp = cxx::to_array(cxx::tuple_section<dim, dim>(bs));
-
-  auto dx_1 = parameters.dx_1;
-  auto u_rhs = c.rho;
-  real_t rho_rhs = 0.0;
-  for (int_t j = 0; j < dim; ++j)
-    rho_rhs += (-0.5 * bm[j].v[j] + 0.5 * bp[j].v[j]) * dx_1[j];
-  vreal_t v_rhs;
-  for (int_t i = 0; i < dim; ++i)
-    v_rhs[i] = (-0.5 * bm[i].rho + 0.5 * bp[i].rho) * dx_1[i];
-  return cell_t{vzero, u_rhs, rho_rhs, v_rhs};
-}
+// The RHS is generic so that it can be evaluated on cells as well as on
+// packs of cells. It reads the fields it needs via fun::getField, so
+// that cells of structure-of-arrays storage load only these columns.
+struct cell_rhs : std::tuple<> {
+  template <typename C, typename... Bnds>
+  fun::soa_value_t<C> operator()(const C &c, std::size_t bdirs,
+                                 const Bnds &... bnds) const {
+    static_assert(sizeof...(Bnds) == 2 * dim, "");
+    static_assert(cxx::all_of_type<std::is_same<Bnds, C>::value...>::value,
+                  "");
+    typedef fun::soa_value_t<C> cell;
+    auto bs = std::forward_as_tuple(bnds...);
+    auto bm = cxx::to_array(cxx::tuple_section<0, dim>(bs));
+    auto bp = cxx::to_array(cxx::tuple_section<dim, dim>(bs));
+
+    auto dx_1 = parameters.dx_1;
+    auto u_rhs = fun::getField<cell_rho>(c);
+    decltype(u_rhs) rho_rhs = 0.0;
+    for (int_t j = 0; j < dim; ++j)
+      rho_rhs += (-0.5 * fun::getField<cell_v>(bm[j])[j] +
+                  0.5 * fun::getField<cell_v>(bp[j])[j]) *
+                 dx_1[j];
+    decltype(cell::v) v_rhs;
+    for (int_t i = 0; i < dim; ++i)
+      v_rhs[i] = (-0.5 * fun::getField<cell_rho>(bm[i]) +
+                  0.5 * fun::getField<cell_rho>(bp[i])) *
+                 dx_1[i];
+    return cell{{}, u_rhs, rho_rhs, v_rhs};
+  }
+};
 
 template <typename... Bnds>
 auto get_cell_rhs(const std::tuple<Bnds...> &)
@@ -227,6 +272,18 @@ constexpr std::size_t max_size = 16;
 template <typename T>
 using maxarray_grid = adt::grid<adt::maxarray<adt::dummy, max_size>, T, dim>;
 
+// Each field of the cells is stored contiguously
+template <typename T>
+using soa_maxarray_grid =
+    adt::soa_grid<adt::maxarray<adt::dummy, max_size>, T, dim>;
+
+// The boundaries are stored as ghost layers next to the cells; the
+// storage is aligned so that rows start at cache line boundaries
+template <typename T>
+using vector_grid =
+    adt::grid<std::vector<adt::dummy, adt::grid_allocator<adt::dummy>>, T,
+              dim>;
+
 template <typename T>
 using shared_grid =
     adt::nested<std::shared_ptr<adt::dummy>, maxarray_grid<adt::dummy>, T>;
@@ -260,7 +317,9 @@ using proxy_grid_tree =
 
 // TOOD: Correct handling of boundaries (?) for adt::nested to make
 // the other storage types work
-template <typename T> using storage_t = maxarray_grid<T>;
+template <typename T> using storage_t = vector_grid<T>;
+// template <typename T> using storage_t = maxarray_grid<T>;
+// template <typename T> using storage_t = soa_maxarray_grid<T>;
 
 // template <typename T> using storage_t = shared_grid<T>;
 // template <typename T> using storage_t = future_grid<T>;
@@ -293,14 +352,46 @@ std::ostream &operator<<(std::ostream &os, const grid_t &g) {
   return os;
 }
 
+// Grids with ghost layers apply the boundary conditions to the ghost
+// cells after each step; other storage types evaluate the boundaries
+// in grid_rhs instead
+template <typename S> struct cells_ghosts {
+  template <typename F>
+  static S iotaMapMulti(const F &f, const adt::steprange_t<dim> &inds) {
+    return fun::iotaMapMulti<S>(f, inds);
+  }
+  static void fill(S &cells) {}
+};
+
+template <> struct cells_ghosts<vector_grid<cell_t>> {
+  typedef vector_grid<cell_t> S;
+  template <typename F>
+  static S iotaMapMulti(const F &f, const adt::steprange_t<dim> &inds) {
+    return S(typename S::iotaMapMulti(), 1, f, inds);
+  }
+  static void fill(S &cells) {
+    for (int_t i = 0; i < 2 * dim; ++i)
+      if (parameters.periodic)
+        cells.copy_ghosts(i, cells);
+      else
+        cells.fill_ghosts(i, cell_boundary_reflecting);
+  }
+};
+
+template <typename S> void cells_fill_ghosts(S &cells) {
+  cells_ghosts<S>::fill(cells);
+}
+
 auto grid_axpy(const grid_t &y, const grid_t &x, real_t alpha) {
-  return grid_t{alpha * x.time + y.time,
-                fun::fmap2(cell_axpy, y.cells, x.cells, alpha)};
+  grid_t r{alpha * x.time + y.time,
+           fun::fmap2(cell_axpy, y.cells, x.cells, alpha)};
+  cells_fill_ghosts(r.cells);
+  return r;
 }
 
 auto grid_init(real_t t) {
-  return grid_t{
-      t, fun::iotaMapMulti<storage_t<adt::dummy>>(
+  grid_t r{
+      t, cells_ghosts<storage_t<cell_t>>::iotaMapMulti(
              [t](vint_t i) {
                vreal_t x =
                    parameters.xmin +
@@ -309,6 +400,8 @@ auto grid_init(real_t t) {
                return cell_init(t, x);
              },
              adt::steprange_t<dim>(parameters.ncells))};
+  cells_fill_ghosts(r.cells);
+  return r;
 }
 
 auto grid_error(const grid_t &g) {
@@ -316,15 +409,19 @@ auto grid_error(const grid_t &g) {
 }
 
 auto grid_norm(const grid_t &g) {
-  return fun::foldMap(cell_norm, norm_t::plus, norm_t::zero(), g.cells);
+  return fun::foldMapAsync(cell_norm, norm_t::plus, norm_t::zero(), g.cells)
+      .get();
 }
 
 auto grid_energy(const grid_t &g) {
-  return fun::foldMap(cell_energy, std::plus<real_t>(), 0.0, g.cells);
+  return fun::foldMapAsync(cell_energy, std::plus<real_t>(), 0.0, g.cells)
+      .get();
 }
 
 auto grid_boundary(const grid_t &g, int_t i) {
   // return fun::boundaryMap(cell_boundary_dirichlet, g.cells, i, g.time);
+  if (parameters.periodic)
+    return fun::boundary(g.cells, i ^ 1);
   return fun::boundaryMap(cell_boundary_reflecting, g.cells, i);
 }
 
@@ -338,7 +435,8 @@ auto wrap_fmapStencil(F &&f, G &&g, TS &&xs, BS &&bs,
       std::get<Indices>(std::forward<BS>(bs))..., std::forward<Args>(args)...);
 }
 
-auto grid_rhs(const grid_t &g) {
+template <typename F, typename S>
+auto cells_rhs(const F &f, const grid_t &g, const S &cells) {
   std::array<boundary_t<cell_t>, dim> bms, bps;
   for (std::ptrdiff_t d = 0; d < dim; ++d) {
     bms[d] = grid_boundary(g, 2 * d + 0);
@@ -361,12 +459,25 @@ auto grid_rhs(const grid_t &g) {
   //                        CXX_FUNOBJ(cell_get_face), g.cells, bmask,
   //                        std::get<0>(bs), std::get<1>(bs))};
   static_assert(dim == 2, "");
-  return grid_t{1.0,
-                fun::fmapStencilMulti<dim>(
-                    CXX_FUNOBJ(cell_rhs<const cell_t &, const cell_t &,
-                                        const cell_t &, const cell_t &>),
-                    CXX_FUNOBJ(cell_get_face), g.cells, bmask, std::get<0>(bs),
-                    std::get<1>(bs), std::get<2>(bs), std::get<3>(bs))};
+  return fun::fmapStencilMulti<dim>(f, cell_get_face(), cells, bmask,
+                                    std::get<0>(bs), std::get<1>(bs),
+                                    std::get<2>(bs), std::get<3>(bs));
+}
+
+// The neighbours of the boundary cells are read from the ghost layers
+// filled by cells_fill_ghosts; no boundaries need to be built
+template <typename F>
+auto cells_rhs(const F &f, const grid_t &g, const vector_grid<cell_t> &cells) {
+  std::size_t bmask = ~0;
+  return fun::fmapStencilMulti<dim>(f, cell_get_face(), cells, bmask);
+}
+
+auto grid_rhs(const grid_t &g) {
+  if (parameters.simd_rhs)
+    return grid_t{
+        1.0, cells_rhs(fun::make_simd_stencil<cell_simd_t>(cell_rhs()), g,
+                       g.cells)};
+  return grid_t{1.0, cells_rhs(cell_rhs(), g, g.cells)};
 }
 
 // State
@@ -473,7 +584,21 @@ int funhpc_main(int argc, char **argv) {
   parameters.outinfo_every = parameters.nsteps / 10;
   parameters.outfile_every = -1; // TODO parameters.nsteps / 20;
   parameters.outfile_name = "wave3d.tsv";
+  // Pass --simd-rhs to evaluate the RHS in SIMD packs instead, and
+  // --periodic for periodic boundaries
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--simd-rhs")
+      parameters.simd_rhs = true;
+    if (std::string(argv[i]) == "--periodic")
+      parameters.periodic = true;
+  }
   parameters.setup();
+  if (parameters.simd_rhs)
+    std::cout << "RHS: SIMD packs of " << cxx::simd<real_t>::size()
+              << " cells\n";
+  else
+    std::cout << "RHS: scalar\n";
+  auto t0 = std::chrono::steady_clock::now();
   qthread::shared_future<int> info_token = qthread::make_ready_future(0);
   qthread::shared_future<int> file_token = qthread::make_ready_future(0);
   auto s = std::make_shared<schedule_t>(0, grid_init(parameters.tmin));
@@ -491,6 +616,9 @@ int funhpc_main(int argc, char **argv) {
   }
   info_token.wait();
   file_token.wait();
+  auto t1 = std::chrono::steady_clock::now();
+  std::cout << "Time: " << std::chrono::duration<double>(t1 - t0).count()
+            << " s\n";
   std::cout << "Done.\n";
   return 0;
 }
@@ -1,8 +1,14 @@
 #ifndef FUN_FUN_DECL_HPP
 #define FUN_FUN_DECL_HPP
 
+#include <cxx/cassert.hpp>
+#include <cxx/invoke.hpp>
+#include <qthread/future.hpp>
+
 #include <cereal/types/tuple.hpp>
 
+#include <atomic>
+#include <cstddef>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -10,7 +16,18 @@
 #include <sstream>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+namespace adt {
+template <typename P, typename A, typename T, typename Policy> struct nested;
+template <typename A, typename T> struct tree;
+}
+
+namespace funhpc {
+template <typename T> class proxy;
+}
 
 namespace fun {
 
@@ -26,6 +43,115 @@ bool empty(const CT &xs);
 template <typename CT, typename T = typename fun::fun_traits<CT>::value_type>
 std::size_t size(const CT &xs);
 
+// prefetch
+
+// Start copying remote data into the local process, so that it is
+// available when it is needed later. This does nothing for containers
+// that hold their data locally.
+//
+// Containers prefetch their elements recursively. All overloads are
+// declared here, so that these recursive calls find them independent
+// of the order in which the headers are included.
+
+template <typename CT> void prefetch(const CT &) {}
+template <typename T, typename Allocator>
+void prefetch(const std::vector<T, Allocator> &xs);
+template <typename T> void prefetch(const qthread::shared_future<T> &xs);
+template <typename T> void prefetch(const funhpc::proxy<T> &xs);
+template <typename A, typename T> void prefetch(const adt::tree<A, T> &xs);
+template <typename P, typename A, typename T, typename Policy>
+void prefetch(const adt::nested<P, A, T, Policy> &xss);
+
+// foldMapAsync
+
+// Within foldMapAsync, the functors for containers of containers
+// return shared futures instead of values, so that the parts of a
+// container can be reduced concurrently (see fun_impl.hpp). Partial
+// results are combined when they become ready, without a thread
+// waiting for them.
+
+namespace detail {
+template <typename T> struct fold_result { typedef T type; };
+template <typename T> struct fold_result<qthread::shared_future<T>> {
+  typedef T type;
+};
+template <typename T> using fold_result_t = typename fold_result<T>::type;
+
+template <typename T> qthread::future<T> fold_future(T x) {
+  return qthread::make_ready_future(std::move(x));
+}
+template <typename T>
+qthread::future<T> fold_future(qthread::shared_future<T> x) {
+  if (x.ready())
+    return qthread::make_ready_future(x.get());
+  return qthread::detail::unshare(std::move(x));
+}
+template <typename T>
+qthread::future<T> fold_future(qthread::future<qthread::future<T>> x) {
+  qthread::promise<T> p;
+  auto r = p.get_future();
+  qthread::detail::when_ready(
+      std::move(x),
+      [p = std::move(p)](qthread::future<qthread::future<T>> &x) mutable {
+        qthread::detail::when_ready(
+            x.get(), [p = std::move(p)](qthread::future<T> &x) mutable {
+              p.set_value(x.get());
+            });
+      });
+  return r;
+}
+
+// Combine the results once all are ready. The results are combined in
+// order, so that the result does not depend on the order in which
+// they become ready.
+template <typename Op, typename T>
+qthread::future<T> fold_all(const Op &op, const T &z,
+                            std::vector<qthread::shared_future<T>> xs) {
+  struct join_t {
+    std::decay_t<Op> op;
+    T z;
+    std::vector<qthread::shared_future<T>> xs;
+    qthread::promise<T> res;
+    std::atomic<std::size_t> pending;
+    void arrive() {
+      if (--pending != 0)
+        return;
+      T r(z);
+      for (const auto &x : xs)
+        r = cxx::invoke(op, std::move(r), x.get());
+      res.set_value(std::move(r));
+    }
+  };
+  const std::size_t pending = xs.size() + 1;
+  auto join = std::shared_ptr<join_t>(
+      new join_t{op, z, std::move(xs), qthread::promise<T>(), {pending}});
+  auto r = join->res.get_future();
+  for (const auto &x : join->xs)
+    qthread::detail::when_ready(
+        x, [join](const qthread::shared_future<T> &) { join->arrive(); });
+  join->arrive();
+  return r;
+}
+
+// Where the elements of a container are reduced. Elements are usually
+// reduced where the container is. Proxies (and containers that consist
+// of proxies) are grouped by their owning processes and are reduced
+// there (see fun/proxy.hpp).
+template <typename T> struct fold_placement {
+  // The process that owns an element, or -1 for this process
+  static std::ptrdiff_t owner(const T &x) { return -1; }
+  // Reduce groups of elements (by owner) on their owners
+  template <typename U, typename F, typename Op, typename R, typename... Args>
+  static qthread::shared_future<R>
+  reduce_groups(std::vector<std::pair<std::ptrdiff_t, std::vector<U>>> groups,
+                const F &f, const Op &op, const R &z, const Args &... args) {
+    // There are no groups since all elements are local
+    cxx_assert(groups.empty());
+    return qthread::make_ready_future(z);
+  }
+};
+} // namespace detail
+
 // convert
 
 template <typename C1, typename C2T,
@@ -3,15 +3,21 @@
 
 #include "fun_decl.hpp"
 
+#include <cxx/invoke.hpp>
 #include <fun/maybe.hpp>
+#include <qthread/future.hpp>
 
 #include <cereal/types/tuple.hpp>
 
 #include <functional>
+#include <iterator>
+#include <map>
 #include <sstream>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace fun {
 
@@ -39,6 +45,70 @@ template <typename CT, typename T> std::size_t size(const CT &xs) {
   return foldMap(f(), op(), 0, xs);
 }
 
+// foldMapAsync
+
+// An asynchronous foldMap. Parts of a container that live on other
+// processes are reduced there, and independent parts are reduced
+// concurrently. Partial results are combined as they become ready, so
+// that the reduction follows the structure of the container instead
+// of visiting its parts one after the other. Elements that live on
+// other processes are grouped by their owners, so that each owner
+// receives a single request and returns a single result; these
+// requests are forwarded along a binomial tree of the owners. This
+// reorders the elements, so that op needs to be commutative.
+//
+// This generic version handles containers that hold their elements
+// locally; proxies, nested containers, and trees have their own
+// versions.
+
+template <typename F, typename Op, typename Z, typename CT, typename... Args,
+          typename T = typename fun_traits<CT>::value_type,
+          typename R = std::decay_t<cxx::invoke_of_t<F, T, Args...>>,
+          std::enable_if_t<std::is_same<detail::fold_result_t<R>, R>::value>
+              * = nullptr>
+qthread::future<R> foldMapAsync(F &&f, Op &&op, Z &&z, const CT &xs,
+                                Args &&... args) {
+  return qthread::make_ready_future(
+      foldMap(std::forward<F>(f), std::forward<Op>(op), std::forward<Z>(z), xs,
+              std::forward<Args>(args)...));
+}
+
+// The elements' results are futures, which are combined asynchronously
+template <typename F, typename Op, typename Z, typename CT, typename... Args,
+          typename T = typename fun_traits<CT>::value_type,
+          typename R = std::decay_t<cxx::invoke_of_t<F, T, Args...>>,
+          std::enable_if_t<!std::is_same<detail::fold_result_t<R>, R>::value>
+              * = nullptr,
+          typename R1 = detail::fold_result_t<R>>
+qthread::future<R1> foldMapAsync(F &&f, Op &&op, Z &&z, const CT &xs,
+                                 Args &&... args) {
+  static_assert(std::is_same<cxx::invoke_of_t<Op, R1, R1>, R1>::value, "");
+  typedef detail::fold_placement<T> placement;
+  const R1 z1(std::forward<Z>(z));
+  // Reduce local elements right away, and collect the others by owner
+  // (foldMap visits the elements of a local container sequentially)
+  std::vector<qthread::shared_future<R1>> rs;
+  std::map<std::ptrdiff_t, std::vector<T>> owned;
+  foldMap(
+      [&](const T &x) {
+        const auto p = placement::owner(x);
+        if (p < 0)
+          rs.push_back(cxx::invoke(f, x, args...));
+        else
+          owned[p].push_back(x);
+        return std::tuple<>();
+      },
+      [](std::tuple<>, std::tuple<>) { return std::tuple<>(); },
+      std::tuple<>(), xs);
+  if (!owned.empty())
+    rs.push_back(placement::reduce_groups(
+        std::vector<std::pair<std::ptrdiff_t, std::vector<T>>>(
+            std::make_move_iterator(owned.begin()),
+            std::make_move_iterator(owned.end())),
+        f, op, z1, args...));
+  return detail::fold_all(op, z1, std::move(rs));
+}
+
 // convert
 
 template <typename C1, typename C2T, typename T, typename C1T>
@@ -8,7 +8,9 @@
 #include <cxx/invoke.hpp>
 #include <fun/fun_decl.hpp>
 
+#include <cstddef>
 #include <type_traits>
+#include <utility>
 
 namespace fun {
 
@@ -109,6 +111,48 @@ CR fmapStencilMulti(F &&f, G &&g, const adt::grid<C, T, D> &xs,
                     const std::decay_t<BCB> &bm1, const std::decay_t<BCB> &bp0,
                     const std::decay_t<BCB> &bp1, Args &&... args);
 
+template <std::size_t D, typename F, typename G, typename C, typename T,
+          typename... Args, std::enable_if_t<D == 3> * = nullptr,
+          typename CT = adt::grid<C, T, D>,
+          typename BC = typename fun_traits<CT>::boundary_dummy,
+          typename B = std::decay_t<cxx::invoke_of_t<G, T, std::ptrdiff_t>>,
+          typename BCB = typename fun_traits<BC>::template constructor<B>,
+          typename R = cxx::invoke_of_t<F, T, std::size_t, B, B, B, B, B, B,
+                                        Args...>,
+          typename CR = typename fun_traits<CT>::template constructor<R>>
+CR fmapStencilMulti(F &&f, G &&g, const adt::grid<C, T, D> &xs,
+                    std::size_t bmask, const std::decay_t<BCB> &bm0,
+                    const std::decay_t<BCB> &bm1, const std::decay_t<BCB> &bm2,
+                    const std::decay_t<BCB> &bp0, const std::decay_t<BCB> &bp1,
+                    const std::decay_t<BCB> &bp2, Args &&... args);
+
+// Without boundaries, the neighbours of the boundary cells are read
+// from the ghost layers of xs (see adt::grid::fill_ghosts)
+namespace detail {
+template <std::size_t, typename B> struct stencil_neighbour {
+  typedef B type;
+};
+// The result of f(x, bdirs, b...), with the 2 * D neighbours b of type B
+template <typename F, typename T, typename B, typename Is>
+struct stencil_result;
+template <typename F, typename T, typename B, std::size_t... Is>
+struct stencil_result<F, T, B, std::index_sequence<Is...>> {
+  typedef cxx::invoke_of_t<F, T, std::size_t,
+                           typename stencil_neighbour<Is, B>::type...>
+      type;
+};
+} // namespace detail
+
+template <std::size_t D, typename F, typename G, typename C, typename T,
+          std::enable_if_t<D != 0> * = nullptr,
+          typename CT = adt::grid<C, T, D>,
+          typename B = std::decay_t<cxx::invoke_of_t<G, T, std::ptrdiff_t>>,
+          typename R = typename detail::stencil_result<
+              F, T, B, std::make_index_sequence<2 * D>>::type,
+          typename CR = typename fun_traits<CT>::template constructor<R>>
+CR fmapStencilMulti(F &&f, G &&g, const adt::grid<C, T, D> &xs,
+                    std::size_t bmask);
+
 // head, last
 
 template <typename C, typename T, std::size_t D,
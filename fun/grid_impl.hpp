@@ -93,6 +93,28 @@ CR fmapStencilMulti(F &&f, G &&g, const adt::grid<C, T, D> &xs,
             std::forward<Args>(args)...);
 }
 
+template <std::size_t D, typename F, typename G, typename C, typename T,
+          typename... Args, std::enable_if_t<D == 3> *, typename CT,
+          typename BC, typename B, typename BCB, typename R, typename CR>
+CR fmapStencilMulti(F &&f, G &&g, const adt::grid<C, T, D> &xs,
+                    std::size_t bmask, const std::decay_t<BCB> &bm0,
+                    const std::decay_t<BCB> &bm1, const std::decay_t<BCB> &bm2,
+                    const std::decay_t<BCB> &bp0, const std::decay_t<BCB> &bp1,
+                    const std::decay_t<BCB> &bp2, Args &&... args) {
+  return CR(typename CR::fmapStencilMulti(), std::forward<F>(f),
+            std::forward<G>(g), xs, bmask, bm0, bm1, bm2, bp0, bp1, bp2,
+            std::forward<Args>(args)...);
+}
+
+template <std::size_t D, typename F, typename G, typename C, typename T,
+          std::enable_if_t<D != 0> *, typename CT, typename B, typename R,
+          typename CR>
+CR fmapStencilMulti(F &&f, G &&g, const adt::grid<C, T, D> &xs,
+                    std::size_t bmask) {
+  return CR(typename CR::fmapStencilMulti(), std::forward<F>(f),
+            std::forward<G>(g), xs, bmask);
+}
+
 // head, last
 
 template <typename C, typename T, std::size_t D, std::enable_if_t<D == 1> *>
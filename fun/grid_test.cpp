@@ -1,5 +1,6 @@
 #include <fun/grid_decl.hpp>
 
+#include <cxx/simd.hpp>
 #include <fun/array.hpp>
 #include <fun/idtype.hpp>
 #include <fun/nested_decl.hpp>
@@ -12,6 +13,9 @@
 
 #include <gtest/gtest.h>
 
+#include <array>
+#include <functional>
+
 using namespace fun;
 
 namespace {
@@ -177,6 +181,89 @@ TEST(fun_grid, fmapStencil) {
   auto sum2 = foldMap([](auto x) { return x; },
                       [](auto x, auto y) { return x + y; }, 0, ys2);
   EXPECT_EQ(400, sum2);
+
+  auto xs3 = iotaMapMulti<grid3<adt::dummy>>(
+      [](const auto &x) { return int(adt::sum(x * x)); },
+      adt::steprange_t<3>(adt::index_t<3>{{s, s, s}}));
+  auto bms3 = iotaMapMulti<grid2<adt::dummy>>(
+      [](const auto &x) { return int(-1 * -1 + adt::sum(x * x)); },
+      adt::steprange_t<2>(adt::index_t<2>{{s, s}}));
+  auto bps3 = iotaMapMulti<grid2<adt::dummy>>(
+      [s](const auto &x) { return int(s * s + adt::sum(x * x)); },
+      adt::steprange_t<2>(adt::index_t<2>{{s, s}}));
+  const auto rhs3 = [](auto x, auto bdirs, int bm0, int bm1, int bm2, int bp0,
+                       int bp1, int bp2) {
+    return (bm0 - 2 * x + bp0) + (bm1 - 2 * x + bp1) + (bm2 - 2 * x + bp2);
+  };
+  auto ys3 = fmapStencilMulti<3>(rhs3, [](auto x, auto i) { return x; }, xs3,
+                                 ~0, bms3, bms3, bms3, bps3, bps3, bps3);
+  auto sum3 = foldMap([](auto x) { return x; },
+                      [](auto x, auto y) { return x + y; }, 0, ys3);
+  EXPECT_EQ(6000, sum3);
+  // Tiling does not change the result
+  const auto tile_bytes = adt::get_grid_tile_bytes();
+  adt::set_grid_tile_bytes(0);
+  auto zs3 = fmapStencilMulti<3>(rhs3, [](auto x, auto i) { return x; }, xs3,
+                                 ~0, bms3, bms3, bms3, bps3, bps3, bps3);
+  adt::set_grid_tile_bytes(64);
+  auto ws3 = fmapStencilMulti<3>(rhs3, [](auto x, auto i) { return x; }, xs3,
+                                 ~0, bms3, bms3, bms3, bps3, bps3, bps3);
+  adt::set_grid_tile_bytes(tile_bytes);
+  const auto equal = [](const auto &xs, const auto &ys) {
+    return foldMap2([](auto x, auto y) { return x == y; },
+                    [](auto x, auto y) { return x && y; }, true, xs, ys);
+  };
+  EXPECT_TRUE(equal(ys3, zs3));
+  EXPECT_TRUE(equal(ys3, ws3));
+}
+
+TEST(fun_grid, fmapStencilGhosts) {
+  // An odd size, so that the rows do not fill whole SIMD packs
+  const std::ptrdiff_t s = 13;
+  const adt::steprange_t<2> inds(adt::index_t<2>{{s, s}});
+  const auto init = [](const adt::index_t<2> &i) {
+    return double(i[0] * i[0] + 3 * i[1]);
+  };
+  const auto negate = [](double x, std::ptrdiff_t i) { return -x; };
+  const auto get_face = [](auto x, std::ptrdiff_t i) { return x; };
+  const auto rhs = [](auto x, std::size_t bdirs, auto bm0, auto bm1, auto bp0,
+                      auto bp1) {
+    return 8 * bm0 + 4 * bm1 + 2 * bp0 + bp1 - x + double(100 * bdirs);
+  };
+  const auto sum = [](const auto &zs) {
+    return foldMap([](double x) { return x; }, std::plus<double>(), 0.0, zs);
+  };
+  const auto equal = [](const auto &xs, const auto &ys) {
+    return foldMap2([](double x, double y) { return x == y; },
+                    std::logical_and<bool>(), true, xs, ys);
+  };
+
+  // Reference: separate boundaries
+  const auto xs = iotaMapMulti<grid2<adt::dummy>>(init, inds);
+  std::array<grid1<double>, 4> bs;
+  for (std::ptrdiff_t i = 0; i < 4; ++i)
+    bs[i] = boundaryMap(negate, xs, i);
+
+  // The same boundary condition, applied in place to the ghost cells
+  auto gxs = grid2<double>(typename grid2<double>::iotaMapMulti(), 1, init,
+                           inds);
+  for (std::ptrdiff_t i = 0; i < 4; ++i)
+    gxs.fill_ghosts(i, negate);
+
+  for (std::size_t bmask : {std::size_t(0), std::size_t(6), ~std::size_t(0)}) {
+    const auto ys = fmapStencilMulti<2>(rhs, get_face, xs, bmask, bs[0],
+                                        bs[2], bs[1], bs[3]);
+    const auto gys = fmapStencilMulti<2>(rhs, get_face, gxs, bmask);
+    const auto gzs = fmapStencilMulti<2>(
+        make_simd_stencil<cxx::simd<double>>(rhs), get_face, gxs, bmask);
+    EXPECT_EQ(1, gys.ghosts());
+    EXPECT_EQ(s * s, msize(gzs));
+    EXPECT_EQ(sum(ys), sum(gys));
+    EXPECT_TRUE(equal(ys, gys));
+    EXPECT_TRUE(equal(gys, gzs));
+    EXPECT_EQ(ys.head(), gys.head());
+    EXPECT_EQ(ys.last(), gzs.last());
+  }
 }
 
 TEST(fun_grid, foldMap) {
@@ -8,6 +8,7 @@
 #include <cxx/cassert.hpp>
 #include <fun/fun_decl.hpp>
 #include <fun/idtype.hpp>
+#include <fun/simd_stencil.hpp>
 
 #include <algorithm>
 #include <array>
@@ -162,8 +163,11 @@ CR fmapStencil(F &&f, G &&g, const adt::maxarray<T, N> &xs, std::size_t bmask,
   } else if (__builtin_expect(s > 1, true)) {
     rs[0] = cxx::invoke(f, xs[0], bmask & 0b01, std::forward<BM>(bm),
                         cxx::invoke(g, xs[1], 0), args...);
+    const std::ptrdiff_t imin = detail::simd_stencil_loop(
+        f, g, xs.data(), rs.data(), 1, s - 1,
+        std::array<std::ptrdiff_t, 1>{{1}}, args...);
 #pragma omp simd
-    for (std::ptrdiff_t i = 1; i < s - 1; ++i)
+    for (std::ptrdiff_t i = imin; i < s - 1; ++i)
       rs[i] = cxx::invoke(f, xs[i], 0b00, cxx::invoke(g, xs[i - 1], 1),
                           cxx::invoke(g, xs[i + 1], 0), args...);
     rs[s - 1] =
@@ -194,8 +198,10 @@ CR fmapStencilMulti(F &&f, G &&g, const adt::maxarray<T, N> &xs,
   } else if (s > 1) {
     rp[0] = cxx::invoke(f, xp[0], bmask & 0b01, mextract(bm),
                         cxx::invoke(g, xp[1], 0), args...);
+    const std::ptrdiff_t imin = detail::simd_stencil_loop(
+        f, g, xp, rp, 1, s - 1, std::array<std::ptrdiff_t, 1>{{1}}, args...);
 #pragma omp simd
-    for (std::ptrdiff_t i = 1; i < s - 1; ++i)
+    for (std::ptrdiff_t i = imin; i < s - 1; ++i)
       rp[i] = cxx::invoke(f, xp[i], 0b00, cxx::invoke(g, xp[i - 1], 1),
                           cxx::invoke(g, xp[i + 1], 0), args...);
     rp[s - 1] =
@@ -212,6 +212,21 @@ template <typename F, typename Op, typename Z, typename P, typename A,
 R foldMap2(F &&f, Op &&op, Z &&z, const adt::nested<P, A, T, Policy> &xss,
            const adt::nested<P, A, T2, Policy2> &yss, Args &&... args);
 
+// foldMapAsync
+
+template <typename F, typename Op, typename Z, typename P, typename A,
+          typename T, typename Policy, typename... Args,
+          typename R = std::decay_t<cxx::invoke_of_t<F, T, Args...>>,
+          typename R1 = detail::fold_result_t<R>>
+qthread::future<R1> foldMapAsync(F &&f, Op &&op, Z &&z,
+                                 const adt::nested<P, A, T, Policy> &xss,
+                                 Args &&... args);
+
+// prefetch
+
+template <typename P, typename A, typename T, typename Policy>
+void prefetch(const adt::nested<P, A, T, Policy> &xss);
+
 // dump
 
 template <typename P, typename A, typename T, typename Policy>
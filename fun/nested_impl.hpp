@@ -7,6 +7,8 @@
 #include <adt/index.hpp>
 #include <cxx/cassert.hpp>
 #include <cxx/cstdlib.hpp>
+#include <cxx/invoke.hpp>
+#include <qthread/thread.hpp>
 
 #include <adt/nested_impl.hpp>
 #include <fun/fun_impl.hpp>
@@ -14,9 +16,73 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <utility>
+#include <vector>
 
 namespace fun {
 
+// domains
+
+namespace detail {
+// The locality domain of a container, or -1 if its policy does not
+// choose one
+template <typename Policy>
+auto nested_domain(const Policy &policy, int)
+    -> decltype(int(policy.domain())) {
+  return policy.domain();
+}
+template <typename Policy> int nested_domain(const Policy &policy, long) {
+  return -1;
+}
+
+// Bind a block's memory to a locality domain. Contiguous blocks are
+// found via data() and size() (e.g. std::vector), grids via their
+// storage(); other blocks stay where they were first touched.
+template <typename C> void nested_bind(const C &block, int domain, ...) {}
+template <typename C>
+auto nested_bind(const C &block, int domain, long)
+    -> decltype(void(block.data() + block.size())) {
+  qthread::bind_memory(block.data(), block.size() * sizeof *block.data(),
+                       domain);
+}
+template <typename C>
+auto nested_bind(const C &block, int domain, int)
+    -> decltype(void(block.storage())) {
+  nested_bind(block.storage(), domain, 0);
+}
+
+// Compute a block in its locality domain. The domain travels with the
+// functor, so that pointer types that start a task for the block
+// start it in that domain (see task_domain in shared_future.hpp), and
+// the block's memory is first touched there. Blocks that are computed
+// elsewhere (e.g. synchronously by the caller) are bound to the domain
+// afterwards.
+template <typename F> struct nested_on_domain {
+  int domain;
+  F f;
+  template <typename Archive> void serialize(Archive &ar) { ar(domain, f); }
+  template <typename... Args> auto operator()(Args &&... args) const {
+    const bool elsewhere =
+        domain >= 0 && qthread::num_domains() > 1 &&
+        qthread::this_thread::get_domain() !=
+            cxx::div_floor(domain, qthread::num_domains()).rem;
+    auto block = cxx::invoke(f, std::forward<Args>(args)...);
+    if (elsewhere)
+      nested_bind(block, domain, 0);
+    return block;
+  }
+};
+
+template <typename F> int task_domain(const nested_on_domain<F> &f) {
+  return f.domain;
+}
+
+template <typename Policy, typename F>
+nested_on_domain<std::decay_t<F>> nested_place(const Policy &policy, F &&f) {
+  return {nested_domain(policy, 0), std::forward<F>(f)};
+}
+} // namespace detail
+
 // iotaMap
 
 namespace detail {
@@ -218,8 +284,10 @@ CR iotaMap(const typename CR::policy_type &policy, F &&f,
   typedef typename C::pointer_dummy P;
   typedef typename C::array_dummy A;
   auto oinds = detail::nested_calc_outer_inds<P, A>(inds);
-  return CR{iotaMap<P>(detail::nested_iotaMap<CR>(), oinds, inds, oinds,
-                       std::forward<F>(f), std::forward<Args>(args)...),
+  return CR{iotaMap<P>(
+                detail::nested_place(policy, detail::nested_iotaMap<CR>()),
+                oinds, inds, oinds, std::forward<F>(f),
+                std::forward<Args>(args)...),
             policy};
 }
 
@@ -340,9 +408,10 @@ CR iotaMapMulti(const typename CR::policy_type &policy, F &&f,
   typedef typename C::pointer_dummy P;
   typedef typename C::array_dummy A;
   auto oinds = detail::nested_calc_outer_range<P, A>(inds);
-  return CR{iotaMapMulti<P>(detail::nested_iotaMapMulti<CR>(), oinds, inds,
-                            oinds, std::forward<F>(f),
-                            std::forward<Args>(args)...),
+  return CR{iotaMapMulti<P>(
+                detail::nested_place(policy, detail::nested_iotaMapMulti<CR>()),
+                oinds, inds, oinds, std::forward<F>(f),
+                std::forward<Args>(args)...),
             policy};
 }
 
@@ -361,8 +430,8 @@ struct nested_fmap : std::tuple<> {
 template <typename F, typename P, typename A, typename T, typename Policy,
           typename... Args, typename C, typename R, typename CR>
 CR fmap(F &&f, const adt::nested<P, A, T, Policy> &xss, Args &&... args) {
-  return CR{fmap(detail::nested_fmap(), xss.data, std::forward<F>(f),
-                 std::forward<Args>(args)...),
+  return CR{fmap(detail::nested_place(xss.get_policy(), detail::nested_fmap()),
+                 xss.data, std::forward<F>(f), std::forward<Args>(args)...),
             typename CR::policy_type(xss.get_policy())};
 }
 
@@ -381,8 +450,10 @@ template <typename F, typename P, typename A, typename T, typename Policy,
           typename R, typename CR>
 CR fmap2(F &&f, const adt::nested<P, A, T, Policy> &xss,
          const adt::nested<P, A, T2, Policy2> &yss, Args &&... args) {
-  return CR{fmap2(detail::nested_fmap2(), xss.data, yss.data,
-                  std::forward<F>(f), std::forward<Args>(args)...),
+  return CR{fmap2(
+                detail::nested_place(xss.get_policy(), detail::nested_fmap2()),
+                xss.data, yss.data, std::forward<F>(f),
+                std::forward<Args>(args)...),
             typename CR::policy_type(xss.get_policy())};
 }
 
@@ -404,8 +475,10 @@ template <typename F, typename P, typename A, typename T, typename Policy,
 CR fmap3(F &&f, const adt::nested<P, A, T, Policy> &xss,
          const adt::nested<P, A, T2, Policy2> &yss,
          const adt::nested<P, A, T3, Policy3> &zss, Args &&... args) {
-  return CR{fmap3(detail::nested_fmap3(), xss.data, yss.data, zss.data,
-                  std::forward<F>(f), std::forward<Args>(args)...),
+  return CR{fmap3(
+                detail::nested_place(xss.get_policy(), detail::nested_fmap3()),
+                xss.data, yss.data, zss.data, std::forward<F>(f),
+                std::forward<Args>(args)...),
             typename CR::policy_type(xss.get_policy())};
 }
 
@@ -440,7 +513,8 @@ CR fmapStencil(F &&f, G &&g, const adt::nested<P, A, T, Policy> &xss,
                std::size_t bmask, BM &&bm, BP &&bp, Args &&... args) {
   static_assert(std::is_same<std::decay_t<BM>, B>::value, "");
   static_assert(std::is_same<std::decay_t<BP>, B>::value, "");
-  return CR{fmapStencil(detail::nested_fmapStencil_f(),
+  return CR{fmapStencil(detail::nested_place(xss.get_policy(),
+                                             detail::nested_fmapStencil_f()),
                         detail::nested_fmapStencil_g<std::decay_t<G>>{g},
                         xss.data, bmask, std::forward<BM>(bm),
                         std::forward<BP>(bp), std::forward<F>(f), g,
@@ -473,8 +547,9 @@ CR fmapStencilMulti(F &&f, G &&g, const adt::nested<P, A, T, Policy> &xss,
                     std::size_t bmask, Args &&... args) {
   // cannot call fmap here
   cxx_assert(msize(xss.data) <= 1);
-  return CR{fmap(detail::nested_fmapStencilMulti<D>(), xss.data,
-                 std::forward<F>(f), std::forward<G>(g), bmask,
+  return CR{fmap(detail::nested_place(xss.get_policy(),
+                                      detail::nested_fmapStencilMulti<D>()),
+                 xss.data, std::forward<F>(f), std::forward<G>(g), bmask,
                  std::forward<Args>(args)...),
             typename CR::policy_type(xss.get_policy())};
 }
@@ -508,7 +583,8 @@ CR fmapStencilMulti(F &&f, G &&g, const adt::nested<P, A, T, Policy> &xss,
                     std::size_t bmask, const std::decay_t<BCB> &bm0,
                     const std::decay_t<BCB> &bp0, Args &&... args) {
   return CR{fmapStencilMulti<D>(
-                detail::nested_fmapStencilMulti_f<D>(),
+                detail::nested_place(xss.get_policy(),
+                                     detail::nested_fmapStencilMulti_f<D>()),
                 detail::nested_fmapStencilMulti_g<D, std::decay_t<G>>{g},
                 xss.data, bmask, bm0.data, bp0.data, std::forward<F>(f), g,
                 std::forward<Args>(args)...),
@@ -545,7 +621,8 @@ CR fmapStencilMulti(F &&f, G &&g, const adt::nested<P, A, T, Policy> &xss,
                     const std::decay_t<BCB> &bm1, const std::decay_t<BCB> &bp0,
                     const std::decay_t<BCB> &bp1, Args &&... args) {
   return CR{fmapStencilMulti<D>(
-                detail::nested_fmapStencilMulti_f<D>(),
+                detail::nested_place(xss.get_policy(),
+                                     detail::nested_fmapStencilMulti_f<D>()),
                 detail::nested_fmapStencilMulti_g<D, std::decay_t<G>>{g},
                 xss.data, bmask, bm0.data, bm1.data, bp0.data, bp1.data,
                 std::forward<F>(f), g, std::forward<Args>(args)...),
@@ -694,6 +771,55 @@ R foldMap2(F &&f, Op &&op, Z &&z, const adt::nested<P, A, T, Policy> &xss,
                   std::forward<F>(f), op, z, std::forward<Args>(args)...);
 }
 
+// foldMapAsync
+
+namespace detail {
+struct nested_foldMapAsync : std::tuple<> {
+  template <typename AT, typename F, typename Op, typename Z, typename... Args>
+  auto operator()(const AT &xs, F &&f, Op &&op, Z &&z, Args &&... args) const {
+    return foldMapAsync(std::forward<F>(f), std::forward<Op>(op),
+                        std::forward<Z>(z), xs, std::forward<Args>(args)...)
+        .share();
+  }
+};
+} // namespace detail
+
+template <typename F, typename Op, typename Z, typename P, typename A,
+          typename T, typename Policy, typename... Args, typename R,
+          typename R1>
+qthread::future<R1> foldMapAsync(F &&f, Op &&op, Z &&z,
+                                 const adt::nested<P, A, T, Policy> &xss,
+                                 Args &&... args) {
+  static_assert(std::is_same<cxx::invoke_of_t<Op, R1, R1>, R1>::value, "");
+  return foldMapAsync(detail::nested_foldMapAsync(), op, z, xss.data,
+                      std::forward<F>(f), op, z, std::forward<Args>(args)...);
+}
+
+namespace detail {
+// A nested container is reduced where its pointer lives
+template <typename P, typename A, typename T, typename Policy>
+struct fold_placement<adt::nested<P, A, T, Policy>> {
+  typedef decltype(std::declval<adt::nested<P, A, T, Policy>>().data) data_t;
+  static std::ptrdiff_t owner(const adt::nested<P, A, T, Policy> &xss) {
+    return fold_placement<data_t>::owner(xss.data);
+  }
+  template <typename U, typename F, typename Op, typename R, typename... Args>
+  static qthread::shared_future<R>
+  reduce_groups(std::vector<std::pair<std::ptrdiff_t, std::vector<U>>> groups,
+                const F &f, const Op &op, const R &z, const Args &... args) {
+    return fold_placement<data_t>::reduce_groups(std::move(groups), f, op, z,
+                                                 args...);
+  }
+};
+} // namespace detail
+
+// prefetch
+
+template <typename P, typename A, typename T, typename Policy>
+void prefetch(const adt::nested<P, A, T, Policy> &xss) {
+  prefetch(xss.data);
+}
+
 // dump
 
 template <typename P, typename A, typename T, typename Policy>
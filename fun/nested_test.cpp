@@ -10,6 +10,7 @@
 #include <fun/fun_impl.hpp>
 
 #include <qthread/future.hpp>
+#include <qthread/thread.hpp>
 
 #include <cereal/archives/binary.hpp>
 #include <cereal/types/memory.hpp>
@@ -28,6 +29,10 @@ using nested1 =
 template <typename T>
 using nested2 =
     adt::nested<qthread::shared_future<adt::dummy>, std::vector<adt::dummy>, T>;
+template <typename T>
+using nested3 =
+    adt::nested<qthread::shared_future<adt::dummy>, std::vector<adt::dummy>, T,
+                adt::nested_domain_policy<T>>;
 } // namespace
 
 // TODO: Test more types
@@ -140,6 +145,36 @@ TEST(fun_nested, foldMap2) {
   EXPECT_EQ(45.0, r);
 }
 
+TEST(fun_nested, foldMapAsync) {
+  auto xs = iotaMap<nested1<adt::dummy>>([](auto x) { return double(x); }, 10);
+  auto r = foldMapAsync([](auto x) { return x; },
+                        [](auto x, auto y) { return x + y; }, 0.0, xs);
+  static_assert(std::is_same<decltype(r), qthread::future<double>>::value, "");
+  EXPECT_EQ(45.0, r.get());
+
+  auto ys = iotaMap<nested2<adt::dummy>>([](auto x) { return double(x); }, 10);
+  auto r2 = foldMapAsync([](auto x) { return x; },
+                         [](auto x, auto y) { return x + y; }, 0.0, ys);
+  EXPECT_EQ(45.0, r2.get());
+}
+
+TEST(fun_nested, domain) {
+  auto xs = iotaMap<nested3<adt::dummy>>([](auto x) { return double(x); }, 10);
+  auto xs2 = iotaMap<nested3<adt::dummy>>([](auto x) { return double(x); }, 10);
+  // New containers are assigned to domains round-robin
+  EXPECT_EQ(xs.get_policy().domain() + 1, xs2.get_policy().domain());
+  auto ys = fmap([](auto x) { return x + 1.0; }, xs);
+  static_assert(std::is_same<decltype(ys), nested3<double>>::value, "");
+  EXPECT_EQ(xs.get_policy().domain(), ys.get_policy().domain());
+  EXPECT_EQ(6.0, ys.data.get().at(5));
+  auto zs = fmap2([](auto x, auto y) { return x + y; }, xs, ys);
+  EXPECT_EQ(11.0, zs.data.get().at(5));
+  // Blocks are computed in their container's domain
+  auto ds = fmap([](auto x) { return qthread::this_thread::get_domain(); }, xs);
+  EXPECT_EQ(xs.get_policy().domain() % qthread::num_domains(),
+            ds.data.get().at(5));
+}
+
 TEST(fun_nested, monad) {
   auto x1 = munit<nested1<adt::dummy>>(1);
   static_assert(std::is_same<decltype(x1), nested1<int>>::value, "");
@@ -10,13 +10,17 @@
 #include <fun/fun_decl.hpp>
 
 #include <cereal/types/tuple.hpp>
+#include <cereal/types/utility.hpp>
+#include <cereal/types/vector.hpp>
 
 #include <algorithm>
+#include <cstddef>
 #include <initializer_list>
 #include <iterator>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace fun {
 
@@ -403,6 +407,124 @@ R foldMap2(F &&f, Op &&op, Z &&z, const funhpc::proxy<T> &xs,
       .get();
 }
 
+// prefetch
+
+// This prefetches only the object itself, not any proxies it contains
+template <typename T> void prefetch(const funhpc::proxy<T> &xs) {
+  if (bool(xs))
+    xs.prefetch();
+}
+
+// foldMapAsync
+
+namespace detail {
+struct proxy_foldMapAsync : std::tuple<> {
+  template <typename F, typename T, typename... Args>
+  auto operator()(F &&f, const funhpc::proxy<T> &xs, Args &&... args) const {
+    cxx_assert(bool(xs) && xs.proc_ready() && xs.local());
+    return fold_future(
+        cxx::invoke(std::forward<F>(f), *xs, std::forward<Args>(args)...));
+  }
+};
+} // namespace detail
+
+// The object is reduced on its owning process, which replies when the
+// result is ready
+template <typename F, typename Op, typename Z, typename T, typename... Args,
+          typename R = std::decay_t<cxx::invoke_of_t<F, T, Args...>>,
+          typename R1 = detail::fold_result_t<R>>
+qthread::future<R1> foldMapAsync(F &&f, Op &&op, Z &&z,
+                                 const funhpc::proxy<T> &xs, Args &&... args) {
+  static_assert(std::is_same<cxx::invoke_of_t<Op, R1, R1>, R1>::value, "");
+  cxx_assert(bool(xs));
+  if (!xs.proc_ready()) {
+    // The owner is not known yet
+    qthread::promise<R1> p;
+    auto r = p.get_future();
+    qthread::detail::when_ready(
+        xs.get_proc_future(),
+        [=, p = std::move(p)](qthread::future<std::ptrdiff_t> &) mutable {
+          qthread::detail::when_ready(
+              foldMapAsync(f, op, z, xs, args...),
+              [p = std::move(p)](qthread::future<R1> &r) mutable {
+                p.set_value(r.get());
+              });
+        });
+    return r;
+  }
+  if (xs.local())
+    // Start the reduction in a new thread, so that several local
+    // objects are reduced concurrently
+    return detail::fold_future(qthread::async(
+        qthread::launch::async, detail::proxy_foldMapAsync(),
+        std::forward<F>(f), xs, std::forward<Args>(args)...));
+  return funhpc::async_unwrap(xs.get_proc(), detail::proxy_foldMapAsync(),
+                              std::forward<F>(f), xs,
+                              std::forward<Args>(args)...);
+}
+
+// Proxies that are elements of a container are grouped by their
+// owners (see fun_impl.hpp). The groups are distributed along a
+// binomial tree: each process hands the upper half of its remaining
+// groups to the owner of the first group in that half, and then
+// continues with the lower half. Each owner reduces its group and
+// combines the results it receives.
+
+namespace detail {
+template <typename U>
+using fold_groups_t = std::vector<std::pair<std::ptrdiff_t, std::vector<U>>>;
+
+struct proxy_fold_groups;
+
+template <typename U, typename F, typename Op, typename R, typename... Args>
+void send_fold_groups(std::vector<qthread::shared_future<R>> &rs,
+                      const fold_groups_t<U> &groups, std::size_t b,
+                      const F &f, const Op &op, const R &z,
+                      const Args &... args) {
+  std::size_t e = groups.size();
+  while (e > b) {
+    const std::size_t m = b + (e - b) / 2;
+    rs.push_back(funhpc::async_unwrap(groups[m].first, proxy_fold_groups(),
+                                      fold_groups_t<U>(groups.begin() + m,
+                                                       groups.begin() + e),
+                                      f, op, z, args...)
+                     .share());
+    e = m;
+  }
+}
+
+struct proxy_fold_groups : std::tuple<> {
+  template <typename U, typename F, typename Op, typename R, typename... Args>
+  qthread::future<R> operator()(const fold_groups_t<U> &groups, const F &f,
+                                const Op &op, const R &z,
+                                const Args &... args) const {
+    cxx_assert(!groups.empty() && groups.front().first == funhpc::rank());
+    std::vector<qthread::shared_future<R>> rs;
+    for (const auto &x : groups.front().second)
+      rs.push_back(cxx::invoke(f, x, args...));
+    send_fold_groups(rs, groups, 1, f, op, z, args...);
+    return fold_all(op, z, std::move(rs));
+  }
+};
+
+template <typename T> struct fold_placement<funhpc::proxy<T>> {
+  static std::ptrdiff_t owner(const funhpc::proxy<T> &xs) {
+    if (!bool(xs) || !xs.proc_ready())
+      return -1;
+    const auto p = xs.get_proc();
+    return p == funhpc::rank() ? -1 : p;
+  }
+  template <typename U, typename F, typename Op, typename R, typename... Args>
+  static qthread::shared_future<R>
+  reduce_groups(fold_groups_t<U> groups, const F &f, const Op &op, const R &z,
+                const Args &... args) {
+    std::vector<qthread::shared_future<R>> rs;
+    send_fold_groups(rs, groups, 0, f, op, z, args...);
+    return fold_all(op, z, std::move(rs)).share();
+  }
+};
+} // namespace detail
+
 // dump
 
 namespace detail {
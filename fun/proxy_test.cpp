@@ -1,8 +1,18 @@
+// Include vector.hpp before proxy.hpp, so that the prefetch test
+// checks that vector finds the proxy overload
+#include <fun/vector.hpp>
+
+#include <fun/fun_impl.hpp>
 #include <fun/proxy.hpp>
+#include <qthread/thread.hpp>
 
 #include <gtest/gtest.h>
 
 #include <atomic>
+#include <chrono>
+#include <numeric>
+#include <tuple>
+#include <vector>
 
 using namespace fun;
 
@@ -89,6 +99,58 @@ TEST(fun_proxy, foldMap) {
   EXPECT_EQ((s - 1) * s * (2 * s - 1) / 6, sum_sq);
 }
 
+TEST(fun_proxy, foldMapAsync) {
+  std::ptrdiff_t s = 1;
+  auto xs = iotaMap<funhpc::proxy<adt::dummy>>(id, s);
+  auto sum = foldMapAsync(id, add, 0, xs);
+  static_assert(std::is_same<decltype(sum), qthread::future<int>>::value, "");
+  EXPECT_EQ((s - 1) * s / 2, sum.get());
+
+  auto ys = funhpc::make_remote_proxy<int>(1 % funhpc::size(), 2);
+  EXPECT_EQ(4, foldMapAsync(sq, add, 0, ys).get());
+}
+
+namespace {
+struct sq_async : std::tuple<> {
+  auto operator()(int x) const {
+    return foldMapAsync(sq, add, 0, funhpc::make_local_proxy<int>(x)).share();
+  }
+};
+struct sq_proxy : std::tuple<> {
+  auto operator()(const funhpc::proxy<int> &xs) const {
+    return foldMapAsync(sq, add, 0, xs).share();
+  }
+};
+} // namespace
+
+TEST(fun_proxy, foldMapAsync_vector) {
+  // Proxies are reduced on their owners
+  std::vector<funhpc::proxy<int>> xs;
+  int s = 0;
+  for (int i = 0; i < 10; ++i) {
+    xs.push_back(funhpc::make_remote_proxy<int>(i % funhpc::size(), i));
+    s += i * i;
+  }
+  EXPECT_EQ(s, foldMapAsync(sq_proxy(), add, 0, xs).get());
+
+  std::vector<int> ys(10);
+  std::iota(ys.begin(), ys.end(), 0);
+  EXPECT_EQ(s, foldMapAsync(sq_async(), add, 0, ys).get());
+}
+
+TEST(fun_proxy, prefetch) {
+  std::vector<funhpc::proxy<int>> xs;
+  for (int p = 0; p < funhpc::size(); ++p)
+    xs.push_back(funhpc::make_remote_proxy<int>(p, p));
+  prefetch(xs);
+  // Prefetched objects arrive without being requested again
+  qthread::this_thread::sleep_for(std::chrono::milliseconds(100));
+  for (int p = 0; p < funhpc::size(); ++p)
+    EXPECT_TRUE(xs[p].make_local().ready());
+  for (int p = 0; p < funhpc::size(); ++p)
+    EXPECT_EQ(p, *xs[p].make_local());
+}
+
 namespace {
 auto mkproxy_add(int x, int y) {
   return munit<funhpc::proxy<adt::dummy>>(x + y);
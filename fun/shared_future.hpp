@@ -2,6 +2,7 @@
 #define FUN_SHARED_FUTURE_HPP
 
 #include <qthread/future.hpp>
+#include <qthread/thread.hpp>
 
 #include <adt/dummy.hpp>
 #include <adt/index.hpp>
@@ -23,6 +24,28 @@ namespace detail {
 template <typename> struct is_shared_future : std::false_type {};
 template <typename T>
 struct is_shared_future<qthread::shared_future<T>> : std::true_type {};
+
+// Functors that compute the blocks of a nested container carry the
+// block's locality domain (see nested_impl.hpp); the task that runs
+// them is started there. Other functors return -1.
+template <typename F> int task_domain(const F &f) { return -1; }
+
+template <typename F, typename... Args>
+auto async_in_domain(int domain, F &&f, Args &&... args) {
+  if (domain < 0)
+    return qthread::async(std::forward<F>(f), std::forward<Args>(args)...);
+  return qthread::async_on(domain, std::forward<F>(f),
+                           std::forward<Args>(args)...);
+}
+
+template <typename T, typename F>
+auto then_in_domain(int domain, const qthread::shared_future<T> &xs, F &&f) {
+  if (domain < 0)
+    return xs.then(std::forward<F>(f));
+  return qthread::async_on(domain, [xs, f = std::forward<F>(f)]() mutable {
+    return cxx::invoke(std::move(f), xs);
+  });
+}
 } // namespace detail
 
 // traits
@@ -55,8 +78,9 @@ CR iotaMap(F &&f, const adt::irange_t &inds, Args &&... args) {
   cxx_assert(s <= 1);
   if (__builtin_expect(s == 0, false))
     return CR();
-  return qthread::async(std::forward<F>(f), inds[0],
-                        std::forward<Args>(args)...)
+  const int domain = detail::task_domain(f);
+  return detail::async_in_domain(domain, std::forward<F>(f), inds[0],
+                                 std::forward<Args>(args)...)
       .share();
 }
 
@@ -72,8 +96,9 @@ CR iotaMapMulti(F &&f, const adt::steprange_t<D> &inds, Args &&... args) {
   cxx_assert(s <= 1);
   if (__builtin_expect(s == 0, false))
     return CR();
-  return qthread::async(std::forward<F>(f), inds.imin(),
-                        std::forward<Args>(args)...)
+  const int domain = detail::task_domain(f);
+  return detail::async_in_domain(domain, std::forward<F>(f), inds.imin(),
+                                 std::forward<Args>(args)...)
       .share();
 }
 
@@ -87,11 +112,13 @@ CR fmap(F &&f, const qthread::shared_future<T> &xs, Args &&... args) {
   bool s = xs.valid();
   if (!s)
     return CR();
-  return xs
-      .then([f = std::forward<F>(f),
-             args...](const qthread::shared_future<T> &xs) mutable {
-        return cxx::invoke(std::move(f), xs.get(), std::move(args)...);
-      })
+  const int domain = detail::task_domain(f);
+  return detail::then_in_domain(
+             domain, xs,
+             [f = std::forward<F>(f),
+              args...](const qthread::shared_future<T> &xs) mutable {
+               return cxx::invoke(std::move(f), xs.get(), std::move(args)...);
+             })
       .share();
 }
 
@@ -105,12 +132,14 @@ CR fmap2(F &&f, const qthread::shared_future<T> &xs,
   cxx_assert(ys.valid() == s);
   if (!s)
     return CR();
-  return xs
-      .then([f = std::forward<F>(f), ys,
-             args...](const qthread::shared_future<T> &xs) mutable {
-        return cxx::invoke(std::move(f), xs.get(), ys.get(),
-                           std::move(args)...);
-      })
+  const int domain = detail::task_domain(f);
+  return detail::then_in_domain(
+             domain, xs,
+             [f = std::forward<F>(f), ys,
+              args...](const qthread::shared_future<T> &xs) mutable {
+               return cxx::invoke(std::move(f), xs.get(), ys.get(),
+                                  std::move(args)...);
+             })
       .share();
 }
 
@@ -126,12 +155,14 @@ CR fmap3(F &&f, const qthread::shared_future<T> &xs,
   cxx_assert(zs.valid() == s);
   if (!s)
     return CR();
-  return xs
-      .then([f = std::forward<F>(f), ys, zs,
-             args...](const qthread::shared_future<T> &xs) mutable {
-        return cxx::invoke(std::move(f), xs.get(), ys.get(), zs.get(),
-                           std::move(args)...);
-      })
+  const int domain = detail::task_domain(f);
+  return detail::then_in_domain(
+             domain, xs,
+             [f = std::forward<F>(f), ys, zs,
+              args...](const qthread::shared_future<T> &xs) mutable {
+               return cxx::invoke(std::move(f), xs.get(), ys.get(), zs.get(),
+                                  std::move(args)...);
+             })
       .share();
 }
 
@@ -149,13 +180,15 @@ CR fmapStencil(F &&f, G &&g, const qthread::shared_future<T> &xs,
   bool s = xs.valid();
   if (__builtin_expect(!s, false))
     return CR();
-  return xs
-      .then([f = std::forward<F>(f), bmask, bm = std::forward<BM>(bm),
-             bp = std::forward<BP>(bp),
-             args...](const qthread::shared_future<T> &xs) mutable {
-        return cxx::invoke(std::move(f), xs.get(), bmask, std::move(bm),
-                           std::move(bp), std::move(args)...);
-      })
+  const int domain = detail::task_domain(f);
+  return detail::then_in_domain(
+             domain, xs,
+             [f = std::forward<F>(f), bmask, bm = std::forward<BM>(bm),
+              bp = std::forward<BP>(bp),
+              args...](const qthread::shared_future<T> &xs) mutable {
+               return cxx::invoke(std::move(f), xs.get(), bmask, std::move(bm),
+                                  std::move(bp), std::move(args)...);
+             })
       .share();
 }
 
@@ -175,12 +208,15 @@ CR fmapStencilMulti(F &&f, G &&g, const qthread::shared_future<T> &xs,
   bool s = xs.valid();
   if (__builtin_expect(!s, false))
     return CR();
-  return xs
-      .then([f = std::forward<F>(f), bmask, bm0, bp0,
-             args...](const qthread::shared_future<T> &xs) mutable {
-        return cxx::invoke(std::move(f), xs.get(), bmask, std::move(bm0).get(),
-                           std::move(bp0).get(), std::move(args)...);
-      })
+  const int domain = detail::task_domain(f);
+  return detail::then_in_domain(
+             domain, xs,
+             [f = std::forward<F>(f), bmask, bm0, bp0,
+              args...](const qthread::shared_future<T> &xs) mutable {
+               return cxx::invoke(std::move(f), xs.get(), bmask,
+                                  std::move(bm0).get(), std::move(bp0).get(),
+                                  std::move(args)...);
+             })
       .share();
 }
 
@@ -199,13 +235,16 @@ CR fmapStencilMulti(F &&f, G &&g, const qthread::shared_future<T> &xs,
   bool s = xs.valid();
   if (__builtin_expect(!s, false))
     return CR();
-  return xs
-      .then([f = std::forward<F>(f), bmask, bm0, bm1, bp0, bp1,
-             args...](const qthread::shared_future<T> &xs) mutable {
-        return cxx::invoke(std::move(f), xs.get(), bmask, std::move(bm0).get(),
-                           std::move(bm1).get(), std::move(bp0).get(),
-                           std::move(bp1).get(), std::move(args)...);
-      })
+  const int domain = detail::task_domain(f);
+  return detail::then_in_domain(
+             domain, xs,
+             [f = std::forward<F>(f), bmask, bm0, bm1, bp0, bp1,
+              args...](const qthread::shared_future<T> &xs) mutable {
+               return cxx::invoke(std::move(f), xs.get(), bmask,
+                                  std::move(bm0).get(), std::move(bm1).get(),
+                                  std::move(bp0).get(), std::move(bp1).get(),
+                                  std::move(args)...);
+             })
       .share();
 }
 
@@ -268,6 +307,15 @@ R foldMap2(F &&f, Op &&op, Z &&z, const qthread::shared_future<T> &xs,
                      std::forward<Args>(args)...);
 }
 
+// prefetch
+
+// Futures received from other processes fetch their values eagerly;
+// here we only prefetch the contents of ready futures
+template <typename T> void prefetch(const qthread::shared_future<T> &xs) {
+  if (xs.valid() && xs.ready())
+    prefetch(xs.get());
+}
+
 // dump
 
 template <typename T> ostreamer dump(const qthread::shared_future<T> &xs) {
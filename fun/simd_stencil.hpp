@@ -0,0 +1,302 @@
+#ifndef FUN_SIMD_STENCIL_HPP
+#define FUN_SIMD_STENCIL_HPP
+
+#include <adt/soa_fields.hpp>
+#include <cxx/cassert.hpp>
+#include <cxx/invoke.hpp>
+#include <cxx/simd.hpp>
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace fun {
+
+// simd_stencil
+
+// A stencil functor that is also evaluated on SIMD packs of cells. P is
+// the pack type for the cell type: Each field listed in
+// adt::soa_fields<P> is a cxx::simd (or a std::array of cxx::simd) for
+// the corresponding field listed in adt::soa_fields of the cell type.
+// The interior of a std::vector, adt::maxarray, or adt::grid is then
+// evaluated in packs of consecutive cells, calling
+//
+//   f(P c, 0, g(P bm, 1), g(P bp, 0))
+//
+// (with 2 * D neighbours in D dimensions), while cells next to a
+// boundary are evaluated one at a time. Both f and g thus need to
+// accept cells as well as packs, and for an adt::soa_grid also cells
+// that are read lazily (see soa_element and getField).
+//
+// Packs are loaded with unit stride from the columns of an
+// adt::soa_grid. Other containers store cells as a whole, so that each
+// field is gathered from consecutive cells and scattered back, which
+// is often slower than evaluating the cells one at a time.
+template <typename P, typename F> struct simd_stencil {
+  typedef P pack_type;
+  F f;
+  template <typename Archive> void serialize(Archive &ar) { ar(f); }
+  template <typename... Args>
+  decltype(auto) operator()(Args &&... args) const {
+    return cxx::invoke(f, std::forward<Args>(args)...);
+  }
+};
+
+template <typename P, typename F>
+simd_stencil<P, std::decay_t<F>> make_simd_stencil(F &&f) {
+  return {std::forward<F>(f)};
+}
+
+namespace detail {
+template <typename> struct is_simd_stencil : std::false_type {};
+template <typename P, typename F>
+struct is_simd_stencil<simd_stencil<P, F>> : std::true_type {};
+
+// Number of cells in a pack
+template <typename> struct simd_field_size;
+template <typename S>
+struct simd_field_size<cxx::simd<S>>
+    : std::integral_constant<std::size_t, cxx::simd<S>::size()> {};
+template <typename U, std::size_t N>
+struct simd_field_size<std::array<U, N>> : simd_field_size<U> {};
+template <typename P>
+using simd_pack_size =
+    simd_field_size<typename adt::detail::soa_field_t<P, 0>::type>;
+
+// Transpose a field between consecutive cells, which are stride bytes
+// apart, and a pack
+template <typename S>
+void simd_load_field(cxx::simd<S> &r, const S &x, std::size_t stride) {
+  cxx_assert(stride % sizeof(S) == 0);
+  r = cxx::simd<S>::gather(&x, stride / sizeof(S));
+}
+template <typename U, typename S, std::size_t N>
+void simd_load_field(std::array<U, N> &r, const std::array<S, N> &x,
+                     std::size_t stride) {
+  for (std::size_t n = 0; n < N; ++n)
+    simd_load_field(r[n], x[n], stride);
+}
+
+template <typename S>
+void simd_store_field(S &x, const cxx::simd<S> &r, std::size_t stride) {
+  cxx_assert(stride % sizeof(S) == 0);
+  r.scatter(&x, stride / sizeof(S));
+}
+template <typename S, typename U, std::size_t N>
+void simd_store_field(std::array<S, N> &x, const std::array<U, N> &r,
+                      std::size_t stride) {
+  for (std::size_t n = 0; n < N; ++n)
+    simd_store_field(x[n], r[n], stride);
+}
+
+template <typename P, typename T, std::size_t... Is>
+P simd_load(const T *xp, std::index_sequence<Is...>) {
+  static_assert(std::tuple_size<adt::detail::soa_members_t<P>>::value ==
+                    std::tuple_size<adt::detail::soa_members_t<T>>::value,
+                "");
+  P r{};
+  (void)std::initializer_list<int>{
+      (simd_load_field(adt::detail::soa_field_t<P, Is>::ref(
+                           r, std::get<Is>(adt::soa_fields<P>::members())),
+                       adt::detail::soa_field_t<T, Is>::get(
+                           *xp, std::get<Is>(adt::soa_fields<T>::members())),
+                       sizeof(T)),
+       0)...};
+  return r;
+}
+template <typename P, typename T> P simd_load(const T *xp) {
+  return simd_load<P>(
+      xp, std::make_index_sequence<
+              std::tuple_size<adt::detail::soa_members_t<T>>::value>());
+}
+
+template <typename T, typename P, std::size_t... Is>
+void simd_store(T *xp, const P &r, std::index_sequence<Is...>) {
+  static_assert(std::tuple_size<adt::detail::soa_members_t<P>>::value ==
+                    std::tuple_size<adt::detail::soa_members_t<T>>::value,
+                "");
+  (void)std::initializer_list<int>{
+      (simd_store_field(adt::detail::soa_field_t<T, Is>::ref(
+                            *xp, std::get<Is>(adt::soa_fields<T>::members())),
+                        adt::detail::soa_field_t<P, Is>::get(
+                            r, std::get<Is>(adt::soa_fields<P>::members())),
+                        sizeof(T)),
+       0)...};
+}
+template <typename T, typename P> void simd_store(T *xp, const P &r) {
+  simd_store(xp, r,
+             std::make_index_sequence<
+                 std::tuple_size<adt::detail::soa_members_t<T>>::value>());
+}
+
+template <typename P, typename F, typename G, typename T, std::size_t D,
+          std::size_t... Ds, typename... Args>
+decltype(auto) simd_stencil_call(const simd_stencil<P, F> &f, const G &g,
+                                 const T *xp,
+                                 const std::array<std::ptrdiff_t, D> &di,
+                                 std::index_sequence<Ds...>,
+                                 const Args &... args) {
+  return cxx::invoke(
+      f.f, simd_load<P>(xp), std::size_t(0),
+      cxx::invoke(g, simd_load<P>(xp - di[Ds]), std::ptrdiff_t(2 * Ds + 1))...,
+      cxx::invoke(g, simd_load<P>(xp + di[Ds]), std::ptrdiff_t(2 * Ds))...,
+      args...);
+}
+
+// Evaluate the stencil f for the interior cells xp[i], imin <= i <
+// imax, in SIMD packs, where the neighbours of xp[i] in dimension d are
+// xp[i - di[d]] and xp[i + di[d]], and store the results in rp[i].
+// Returns the first index that has not been evaluated; the remaining
+// cells are left to the caller. Functors other than simd_stencil are
+// not evaluated here at all.
+template <typename F, typename G, typename T, typename R, std::size_t D,
+          typename... Args,
+          std::enable_if_t<!is_simd_stencil<F>::value> * = nullptr>
+std::ptrdiff_t simd_stencil_loop(const F &f, const G &g, const T *xp, R *rp,
+                                 std::ptrdiff_t imin, std::ptrdiff_t imax,
+                                 const std::array<std::ptrdiff_t, D> &di,
+                                 const Args &... args) {
+  return imin;
+}
+
+template <typename F, typename G, typename T, typename R, std::size_t D,
+          typename... Args,
+          std::enable_if_t<is_simd_stencil<F>::value> * = nullptr>
+std::ptrdiff_t simd_stencil_loop(const F &f, const G &g, const T *xp, R *rp,
+                                 std::ptrdiff_t imin, std::ptrdiff_t imax,
+                                 const std::array<std::ptrdiff_t, D> &di,
+                                 const Args &... args) {
+  constexpr std::ptrdiff_t width =
+      simd_pack_size<typename F::pack_type>::value;
+  std::ptrdiff_t i = imin;
+  for (; i + width <= imax; i += width)
+    simd_store(rp + i, simd_stencil_call(f, g, xp + i, di,
+                                         std::make_index_sequence<D>(),
+                                         args...));
+  return i;
+}
+
+// Transpose a field between its columns (see adt::soa), which store
+// consecutive cells with unit stride, and a pack
+template <typename S>
+void simd_load_column(cxx::simd<S> &r, const S *p, std::ptrdiff_t i) {
+  r = cxx::simd<S>::loadu(p + i);
+}
+template <typename U, typename Ptr, std::size_t N>
+void simd_load_column(std::array<U, N> &r, const std::array<Ptr, N> &ps,
+                      std::ptrdiff_t i) {
+  for (std::size_t n = 0; n < N; ++n)
+    simd_load_column(r[n], ps[n], i);
+}
+
+template <typename S>
+void simd_store_column(S *p, std::ptrdiff_t i, const cxx::simd<S> &r) {
+  r.storeu(p + i);
+}
+template <typename Ptr, typename U, std::size_t N>
+void simd_store_column(const std::array<Ptr, N> &ps, std::ptrdiff_t i,
+                       const std::array<U, N> &r) {
+  for (std::size_t n = 0; n < N; ++n)
+    simd_store_column(ps[n], i, r[n]);
+}
+
+template <typename P, typename Ptrs, std::size_t... Is>
+P simd_load_soa(const Ptrs &ps, std::ptrdiff_t i,
+                std::index_sequence<Is...>) {
+  static_assert(std::tuple_size<adt::detail::soa_members_t<P>>::value ==
+                    std::tuple_size<Ptrs>::value,
+                "");
+  P r{};
+  (void)std::initializer_list<int>{
+      (simd_load_column(adt::detail::soa_field_t<P, Is>::ref(
+                            r, std::get<Is>(adt::soa_fields<P>::members())),
+                        std::get<Is>(ps), i),
+       0)...};
+  return r;
+}
+template <typename P, typename Ptrs>
+P simd_load_soa(const Ptrs &ps, std::ptrdiff_t i) {
+  return simd_load_soa<P>(
+      ps, i, std::make_index_sequence<std::tuple_size<Ptrs>::value>());
+}
+
+template <typename Ptrs, typename P, std::size_t... Is>
+void simd_store_soa(const Ptrs &ps, std::ptrdiff_t i, const P &r,
+                    std::index_sequence<Is...>) {
+  static_assert(std::tuple_size<adt::detail::soa_members_t<P>>::value ==
+                    std::tuple_size<Ptrs>::value,
+                "");
+  (void)std::initializer_list<int>{
+      (simd_store_column(std::get<Is>(ps), i,
+                         adt::detail::soa_field_t<P, Is>::get(
+                             r, std::get<Is>(adt::soa_fields<P>::members()))),
+       0)...};
+}
+template <typename Ptrs, typename P>
+void simd_store_soa(const Ptrs &ps, std::ptrdiff_t i, const P &r) {
+  simd_store_soa(ps, i, r,
+                 std::make_index_sequence<std::tuple_size<Ptrs>::value>());
+}
+
+template <typename P, typename F, typename G, typename Ptrs, std::size_t D,
+          std::size_t... Ds, typename... Args>
+decltype(auto) simd_soa_stencil_call(const simd_stencil<P, F> &f, const G &g,
+                                     const Ptrs &xps, std::ptrdiff_t i,
+                                     const std::array<std::ptrdiff_t, D> &di,
+                                     std::index_sequence<Ds...>,
+                                     const Args &... args) {
+  return cxx::invoke(
+      f.f, simd_load_soa<P>(xps, i), std::size_t(0),
+      cxx::invoke(g, simd_load_soa<P>(xps, i - di[Ds]),
+                  std::ptrdiff_t(2 * Ds + 1))...,
+      cxx::invoke(g, simd_load_soa<P>(xps, i + di[Ds]),
+                  std::ptrdiff_t(2 * Ds))...,
+      args...);
+}
+
+// As simd_stencil_loop, for cells whose fields are stored in columns
+// (see adt::soa::pointers). The cell i of the row is at index xi + i
+// in the columns xps, and its result at index ri + i in the columns
+// rps.
+template <typename F, typename G, typename XPtrs, typename RPtrs,
+          std::size_t D, typename... Args,
+          std::enable_if_t<!is_simd_stencil<F>::value> * = nullptr>
+std::ptrdiff_t
+simd_soa_stencil_loop(const F &f, const G &g, const XPtrs &xps,
+                      std::ptrdiff_t xi, const RPtrs &rps, std::ptrdiff_t ri,
+                      std::ptrdiff_t imin, std::ptrdiff_t imax,
+                      const std::array<std::ptrdiff_t, D> &di,
+                      const Args &... args) {
+  return imin;
+}
+
+template <typename F, typename G, typename XPtrs, typename RPtrs,
+          std::size_t D, typename... Args,
+          std::enable_if_t<is_simd_stencil<F>::value> * = nullptr>
+std::ptrdiff_t
+simd_soa_stencil_loop(const F &f, const G &g, const XPtrs &xps,
+                      std::ptrdiff_t xi, const RPtrs &rps, std::ptrdiff_t ri,
+                      std::ptrdiff_t imin, std::ptrdiff_t imax,
+                      const std::array<std::ptrdiff_t, D> &di,
+                      const Args &... args) {
+  constexpr std::ptrdiff_t width =
+      simd_pack_size<typename F::pack_type>::value;
+  std::ptrdiff_t i = imin;
+  for (; i + width <= imax; i += width)
+    simd_store_soa(rps, ri + i,
+                   simd_soa_stencil_call(f, g, xps, xi + i, di,
+                                         std::make_index_sequence<D>(),
+                                         args...));
+  return i;
+}
+} // namespace detail
+} // namespace fun
+
+#define FUN_SIMD_STENCIL_HPP_DONE
+#endif // #ifdef FUN_SIMD_STENCIL_HPP
+#ifndef FUN_SIMD_STENCIL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
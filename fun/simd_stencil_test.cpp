@@ -0,0 +1,174 @@
+#include <fun/simd_stencil.hpp>
+
+#include <adt/grid_decl.hpp>
+#include <cxx/simd.hpp>
+#include <fun/fun_decl.hpp>
+#include <fun/grid_decl.hpp>
+#include <fun/maxarray.hpp>
+#include <fun/soa_grid_decl.hpp>
+#include <fun/vector.hpp>
+
+#include <adt/grid_impl.hpp>
+#include <fun/fun_impl.hpp>
+#include <fun/grid_impl.hpp>
+#include <fun/soa_grid_impl.hpp>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+using namespace fun;
+
+namespace {
+template <typename R> struct cell_tmpl {
+  R u, v;
+};
+typedef cell_tmpl<double> cell_t;
+typedef cell_tmpl<cxx::simd<double>> cell_simd_t;
+
+template <typename R> struct vcell_tmpl {
+  R u;
+  std::array<R, 2> v;
+};
+typedef vcell_tmpl<double> vcell_t;
+typedef vcell_tmpl<cxx::simd<double>> vcell_simd_t;
+} // namespace
+
+namespace adt {
+template <typename R> struct soa_fields<cell_tmpl<R>> {
+  static constexpr auto members() {
+    return std::make_tuple(&cell_tmpl<R>::u, &cell_tmpl<R>::v);
+  }
+};
+template <typename R> struct soa_fields<vcell_tmpl<R>> {
+  static constexpr auto members() {
+    return std::make_tuple(&vcell_tmpl<R>::u, &vcell_tmpl<R>::v);
+  }
+};
+} // namespace adt
+
+namespace {
+// Kernels are generic so that they can be evaluated on packs
+struct cell_rhs : std::tuple<> {
+  template <typename C>
+  C operator()(const C &c, std::size_t bdirs, const C &bm, const C &bp) const {
+    return C{bp.v - bm.v + 2 * c.u, (bm.u + bp.u) * 0.5 - c.v};
+  }
+  template <typename C>
+  C operator()(const C &c, std::size_t bdirs, const C &bm0, const C &bm1,
+               const C &bp0, const C &bp1) const {
+    return C{bp0.v - bm0.v + 2 * c.u, (bm1.u + bp1.u) * 0.5 - c.v};
+  }
+};
+// Cells of soa grids are read lazily, so that this kernel accesses
+// their fields via getField
+struct vcell_rhs : std::tuple<> {
+  template <typename C>
+  soa_value_t<C> operator()(const C &c, std::size_t bdirs, const C &bm0,
+                            const C &bm1, const C &bp0, const C &bp1) const {
+    return soa_value_t<C>{
+        getField<0>(bp0) - getField<0>(bm0) + getField<1>(c)[1],
+        {{getField<1>(bm1)[0] + getField<1>(bp1)[0], getField<0>(c) * 0.5}}};
+  }
+};
+struct cell_get_face : std::tuple<> {
+  template <typename C> C operator()(const C &c, std::ptrdiff_t i) const {
+    return C{c.u + i, c.v - i};
+  }
+};
+
+bool cell_eq(const cell_t &x, const cell_t &y) {
+  return x.u == y.u && x.v == y.v;
+}
+cell_t cell_init(std::ptrdiff_t i) { return cell_t{double(i * i), double(-i)}; }
+
+template <typename T> using grid1 = adt::grid<std::vector<adt::dummy>, T, 1>;
+template <typename T> using grid2 = adt::grid<std::vector<adt::dummy>, T, 2>;
+template <typename T>
+using soa_grid1 = adt::soa_grid<std::vector<adt::dummy>, T, 1>;
+template <typename T>
+using soa_grid2 = adt::soa_grid<std::vector<adt::dummy>, T, 2>;
+
+template <typename C> void test_1d() {
+  // An odd size, so that the interior does not fill whole packs
+  const std::ptrdiff_t s = 37;
+  const auto xs = iotaMap<C>(cell_init, s);
+  const cell_t bm{-1.0, 1.0}, bp{100.0, 2.0};
+  const auto f = make_simd_stencil<cell_simd_t>(cell_rhs());
+  static_assert(detail::is_simd_stencil<std::decay_t<decltype(f)>>::value, "");
+  const auto ys = fmapStencil(cell_rhs(), cell_get_face(), xs, 0b11, bm, bp);
+  const auto zs = fmapStencil(f, cell_get_face(), xs, 0b11, bm, bp);
+  EXPECT_EQ(s, msize(zs));
+  EXPECT_TRUE(foldMap2(cell_eq, std::logical_and<bool>(), true, ys, zs));
+}
+} // namespace
+
+TEST(fun_simd_stencil, vector) { test_1d<std::vector<adt::dummy>>(); }
+
+TEST(fun_simd_stencil, maxarray) { test_1d<adt::maxarray<adt::dummy, 64>>(); }
+
+TEST(fun_simd_stencil, scalar) {
+  // Types without soa_fields are a single field
+  const std::ptrdiff_t s = 11;
+  const auto xs =
+      iotaMap<std::vector<adt::dummy>>([](int i) { return double(i * i); }, s);
+  const auto f = [](auto x, std::size_t bdirs, auto bm, auto bp) {
+    return bm - 2 * x + bp;
+  };
+  const auto g = [](auto x, std::ptrdiff_t i) { return x; };
+  const auto ys = fmapStencilMulti<1>(make_simd_stencil<cxx::simd<double>>(f),
+                                      g, xs, 0b11, 1.0, 100.0);
+  const auto sum = foldMap([](auto x) { return x; },
+                           [](auto x, auto y) { return x + y; }, 0.0, ys);
+  EXPECT_EQ(1, sum);
+}
+
+TEST(fun_simd_stencil, grid) {
+  const std::ptrdiff_t s = 13;
+  const auto init = [](const adt::index_t<2> &i) {
+    return cell_init(i[0] + 3 * i[1]);
+  };
+  const auto xs = iotaMapMulti<grid2<adt::dummy>>(
+      init, adt::steprange_t<2>(adt::index_t<2>{{s, s}}));
+  std::array<grid1<cell_t>, 4> bs;
+  for (std::ptrdiff_t d = 0; d < 4; ++d)
+    bs[d] = boundaryMap(cell_get_face(), xs, d);
+  const auto ys = fmapStencilMulti<2>(cell_rhs(), cell_get_face(), xs, ~0,
+                                      bs[0], bs[2], bs[1], bs[3]);
+  const auto zs = fmapStencilMulti<2>(
+      make_simd_stencil<cell_simd_t>(cell_rhs()), cell_get_face(), xs, ~0,
+      bs[0], bs[2], bs[1], bs[3]);
+  EXPECT_EQ(s * s, msize(zs));
+  EXPECT_TRUE(foldMap2(cell_eq, std::logical_and<bool>(), true, ys, zs));
+}
+
+TEST(fun_simd_stencil, soa_grid) {
+  // Packs are loaded from the columns of the fields, including the
+  // components of std::array fields
+  const std::ptrdiff_t s = 13;
+  const auto xs = iotaMapMulti<soa_grid2<adt::dummy>>(
+      [](const adt::index_t<2> &i) {
+        return vcell_t{double(i[0] * i[0]), {{double(-i[1]), double(i[0])}}};
+      },
+      adt::steprange_t<2>(adt::index_t<2>{{s, s}}));
+  const auto get = [](const auto &c, std::ptrdiff_t i) { return c; };
+  std::array<soa_grid1<vcell_t>, 4> bs;
+  for (std::ptrdiff_t d = 0; d < 4; ++d)
+    bs[d] = boundaryMap(get, xs, d);
+  const auto ys = fmapStencilMulti<2>(vcell_rhs(), get, xs, ~0, bs[0], bs[2],
+                                      bs[1], bs[3]);
+  const auto zs =
+      fmapStencilMulti<2>(make_simd_stencil<vcell_simd_t>(vcell_rhs()), get,
+                          xs, ~0, bs[0], bs[2], bs[1], bs[3]);
+  EXPECT_EQ(s * s, msize(zs));
+  EXPECT_TRUE(foldMap2(
+      [](const vcell_t &x, const vcell_t &y) {
+        return x.u == y.u && x.v == y.v;
+      },
+      std::logical_and<bool>(), true, ys, zs));
+}
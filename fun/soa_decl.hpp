@@ -0,0 +1,80 @@
+#ifndef FUN_SOA_DECL_HPP
+#define FUN_SOA_DECL_HPP
+
+#include <adt/soa_decl.hpp>
+
+#include <adt/dummy.hpp>
+#include <adt/index.hpp>
+#include <fun/fun_decl.hpp>
+
+#include <cstddef>
+#include <type_traits>
+
+namespace fun {
+
+// is_soa
+
+namespace detail {
+template <typename> struct is_soa : std::false_type {};
+template <typename C, typename T>
+struct is_soa<adt::soa<C, T>> : std::true_type {};
+} // namespace detail
+
+// traits
+
+template <typename> struct fun_traits;
+template <typename C, typename T> struct fun_traits<adt::soa<C, T>> {
+  template <typename U> using constructor = adt::soa<C, std::decay_t<U>>;
+  typedef constructor<adt::dummy> dummy;
+  typedef T value_type;
+
+  static constexpr std::ptrdiff_t rank = 1;
+  typedef adt::index_t<rank> index_type;
+
+  static constexpr std::size_t min_size() { return fun_traits<C>::min_size(); }
+  static constexpr std::size_t max_size() { return fun_traits<C>::max_size(); }
+};
+
+// indexing
+
+template <typename C, typename T> class soa_element;
+
+template <typename C, typename T>
+soa_element<C, T> getIndex(const adt::soa<C, T> &xs, std::ptrdiff_t i);
+
+// The value of an element, for elements returned as soa_element
+template <typename T> struct soa_value { typedef T type; };
+template <typename C, typename T> struct soa_value<soa_element<C, T>> {
+  typedef T type;
+};
+template <typename T> using soa_value_t = typename soa_value<T>::type;
+
+// getField
+
+template <std::size_t I, typename C, typename T>
+decltype(auto) getField(const adt::soa<C, T> &xs, std::ptrdiff_t i);
+template <std::size_t I, typename C, typename T>
+decltype(auto) getField(const soa_element<C, T> &x);
+template <std::size_t I, typename T> decltype(auto) getField(const T &x);
+
+template <typename> class accumulator;
+template <typename C, typename T> class accumulator<adt::soa<C, T>>;
+
+// munit
+
+template <typename C, typename T,
+          std::enable_if_t<detail::is_soa<C>::value> * = nullptr,
+          typename R = std::decay_t<T>,
+          typename CR = typename fun_traits<C>::template constructor<R>>
+CR munit(T &&x);
+
+// msize
+
+template <typename C, typename T> std::size_t msize(const adt::soa<C, T> &xs);
+} // namespace fun
+
+#define FUN_SOA_DECL_HPP_DONE
+#endif // #ifdef FUN_SOA_DECL_HPP
+#ifndef FUN_SOA_DECL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
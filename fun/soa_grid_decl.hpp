@@ -0,0 +1,13 @@
+#ifndef FUN_SOA_GRID_DECL_HPP
+#define FUN_SOA_GRID_DECL_HPP
+
+#include <adt/soa_grid_decl.hpp>
+
+#include <fun/grid_decl.hpp>
+#include <fun/soa_decl.hpp>
+
+#define FUN_SOA_GRID_DECL_HPP_DONE
+#endif // #ifdef FUN_SOA_GRID_DECL_HPP
+#ifndef FUN_SOA_GRID_DECL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
@@ -0,0 +1,15 @@
+#ifndef FUN_SOA_GRID_IMPL_HPP
+#define FUN_SOA_GRID_IMPL_HPP
+
+#include "soa_grid_decl.hpp"
+
+#include <adt/soa_grid_impl.hpp>
+
+#include <fun/grid_impl.hpp>
+#include <fun/soa_impl.hpp>
+
+#define FUN_SOA_GRID_IMPL_HPP_DONE
+#endif // #ifdef FUN_SOA_GRID_IMPL_HPP
+#ifndef FUN_SOA_GRID_IMPL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
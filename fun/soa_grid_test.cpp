@@ -0,0 +1,151 @@
+#include <fun/soa_grid_decl.hpp>
+
+#include <fun/grid_decl.hpp>
+#include <fun/vector.hpp>
+
+#include <fun/soa_grid_impl.hpp>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+
+using namespace fun;
+
+namespace {
+struct cell_t {
+  double u, rho;
+  std::array<double, 2> v;
+};
+} // namespace
+
+namespace adt {
+template <> struct soa_fields<cell_t> {
+  static constexpr auto members() {
+    return std::make_tuple(&cell_t::u, &cell_t::rho, &cell_t::v);
+  }
+};
+} // namespace adt
+
+namespace {
+template <typename T>
+using soa_grid1 = adt::soa_grid<std::vector<adt::dummy>, T, 1>;
+template <typename T>
+using soa_grid2 = adt::soa_grid<std::vector<adt::dummy>, T, 2>;
+template <typename T>
+using soa_grid3 = adt::soa_grid<std::vector<adt::dummy>, T, 3>;
+template <typename T> using grid3 = adt::grid<std::vector<adt::dummy>, T, 3>;
+} // namespace
+
+TEST(fun_soa_grid, fmap) {
+  std::ptrdiff_t s = 10;
+  auto cs = iotaMapMulti<soa_grid2<adt::dummy>>(
+      [](const adt::index_t<2> &i) {
+        return cell_t{double(i[0]), double(i[1]), {{0.0, 1.0}}};
+      },
+      adt::steprange_t<2>(adt::index_t<2>{{s, s}}));
+  static_assert(std::is_same<decltype(cs), soa_grid2<cell_t>>::value, "");
+  EXPECT_EQ(s * s, msize(cs));
+
+  auto us = fmap([](const cell_t &c) { return c.u + c.v[1]; }, cs);
+  static_assert(std::is_same<decltype(us), soa_grid2<double>>::value, "");
+  EXPECT_EQ(s, us.last());
+
+  auto sum = foldMap([](const cell_t &c) { return c.u + c.rho; },
+                     [](double x, double y) { return x + y; }, 0.0, cs);
+  EXPECT_EQ(s * s * (s - 1), sum);
+}
+
+TEST(fun_soa_grid, fmapStencil) {
+  std::ptrdiff_t s = 10;
+  auto cs = iotaMapMulti<soa_grid1<adt::dummy>>(
+      [](const adt::index_t<1> &i) {
+        return cell_t{double(i[0] * i[0]), 0.0, {{0.0, 0.0}}};
+      },
+      adt::steprange_t<1>(adt::index_t<1>{{s}}));
+  auto bm = boundaryMap([](const cell_t &c, std::ptrdiff_t i) { return c; },
+                        cs, 0);
+  auto bp = boundaryMap([](const cell_t &c, std::ptrdiff_t i) { return c; },
+                        cs, 1);
+  auto ds = fmapStencilMulti<1>(
+      [](const cell_t &c, std::size_t bdirs, const cell_t &cm,
+         const cell_t &cp) {
+        return cell_t{cp.u - cm.u, double(bdirs), c.v};
+      },
+      [](const cell_t &c, std::ptrdiff_t i) { return c; }, cs, ~std::size_t(0),
+      bm, bp);
+  EXPECT_EQ(1.0, ds.head().rho);
+  EXPECT_EQ(1.0, ds.head().u);
+  EXPECT_EQ(2.0, ds.last().rho);
+  EXPECT_EQ(81.0 - 64.0, ds.last().u);
+  EXPECT_EQ(1.0 + 4.0 * 36 + 17.0,
+            foldMap([](const cell_t &c) { return c.u; },
+                    [](double x, double y) { return x + y; }, 0.0, ds));
+}
+
+TEST(fun_soa_grid, fmapStencil3) {
+  std::ptrdiff_t s = 6;
+  const auto init = [](const adt::index_t<3> &i) {
+    return cell_t{double(adt::sum(i * i)), double(i[0]), {{0.0, 1.0}}};
+  };
+  const auto rhs = [](const cell_t &c, std::size_t bdirs, const cell_t &cm0,
+                      const cell_t &cm1, const cell_t &cm2, const cell_t &cp0,
+                      const cell_t &cp1, const cell_t &cp2) {
+    return cell_t{cm0.u + cm1.u + cm2.u - 6 * c.u + cp0.u + cp1.u + cp2.u,
+                  double(bdirs), {{cp0.rho - cm0.rho, c.v[1]}}};
+  };
+  const auto get = [](const cell_t &c, std::ptrdiff_t i) { return c; };
+  const auto stencil = [&](const auto &cs) {
+    return fmapStencilMulti<3>(rhs, get, cs, ~std::size_t(0), boundary(cs, 0),
+                               boundary(cs, 2), boundary(cs, 4),
+                               boundary(cs, 1), boundary(cs, 3),
+                               boundary(cs, 5));
+  };
+  const adt::steprange_t<3> inds(adt::index_t<3>{{s, s, s}});
+  auto ds = stencil(iotaMapMulti<soa_grid3<adt::dummy>>(init, inds));
+  static_assert(std::is_same<decltype(ds), soa_grid3<cell_t>>::value, "");
+  auto es = stencil(iotaMapMulti<grid3<adt::dummy>>(init, inds));
+  // The structure-of-arrays layout does not change the result
+  const auto sum = [](const auto &cs) {
+    return foldMap(
+        [](const cell_t &c) { return c.u + 10 * c.rho + 100 * c.v[0]; },
+        [](double x, double y) { return x + y; }, 0.0, cs);
+  };
+  EXPECT_EQ(sum(es), sum(ds));
+  EXPECT_EQ(3.0, ds.head().u);
+  EXPECT_EQ(1.0, ds.head().v[0]);
+  EXPECT_EQ(double((1 << 1) | (1 << 3) | (1 << 5)), ds.last().rho);
+}
+
+TEST(fun_soa_grid, munit) {
+  auto cs = munit<soa_grid2<adt::dummy>>(cell_t{1.0, 2.0, {{3.0, 4.0}}});
+  EXPECT_EQ(1, msize(cs));
+  EXPECT_EQ(4.0, mextract(cs).v[1]);
+}
+
+TEST(fun_soa_grid, getField) {
+  std::ptrdiff_t s = 10;
+  auto cs = iotaMapMulti<soa_grid1<adt::dummy>>(
+      [](const adt::index_t<1> &i) {
+        return cell_t{double(i[0] * i[0]), double(i[0]), {{1.0, 2.0}}};
+      },
+      adt::steprange_t<1>(adt::index_t<1>{{s}}));
+  // Elements are read lazily, field by field
+  auto c = getIndex(cs.storage(), 3);
+  static_assert(std::is_same<soa_value_t<decltype(c)>, cell_t>::value, "");
+  EXPECT_EQ(9.0, getField<0>(c));
+  EXPECT_EQ(2.0, (getField<2>(cs.storage(), 3)[1]));
+  EXPECT_EQ(3.0, cell_t(c).rho);
+  EXPECT_EQ(3.0, getField<1>(cell_t(c)));
+  // Generic functions see elements that convert to their value
+  const auto get = [](const auto &c, std::ptrdiff_t i) { return c; };
+  auto ds = fmapStencilMulti<1>(
+      [](const auto &c, std::size_t bdirs, const auto &cm, const auto &cp) {
+        return soa_value_t<std::decay_t<decltype(c)>>{
+            getField<0>(cp) - getField<0>(cm), getField<1>(c), {{0.0, 0.0}}};
+      },
+      get, cs, ~std::size_t(0), boundary(cs, 0), boundary(cs, 1));
+  EXPECT_EQ(9.0, ds.last().rho);
+  EXPECT_EQ(81.0 - 64.0, ds.last().u);
+}
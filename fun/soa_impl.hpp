@@ -0,0 +1,242 @@
+#ifndef FUN_SOA_IMPL_HPP
+#define FUN_SOA_IMPL_HPP
+
+#include "soa_decl.hpp"
+
+#include <adt/soa_impl.hpp>
+
+#include <adt/soa_fields.hpp>
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace fun {
+
+// indexing
+
+namespace detail {
+template <typename T, std::size_t I> auto soa_member() {
+  return std::get<I>(adt::soa_fields<T>::members());
+}
+
+template <typename Col>
+decltype(auto) soa_column_get(const Col &col, std::ptrdiff_t i) {
+  return getIndex(col, i);
+}
+template <typename Col, std::size_t N>
+auto soa_column_get(const adt::detail::soa_columns<Col, N> &cs,
+                    std::ptrdiff_t i) {
+  std::array<std::decay_t<decltype(soa_column_get(cs.cols[0], i))>, N> x;
+  for (std::size_t n = 0; n < N; ++n)
+    x[n] = soa_column_get(cs.cols[n], i);
+  return x;
+}
+} // namespace detail
+
+// soa_element
+
+// A reference to an element of an adt::soa, as returned by getIndex. A
+// field is read from its column only when it is accessed (see
+// getField), so that functions reading some of the fields do not load
+// the others. Converting to T reads all fields. Generic functions
+// applied to soa grids thus access fields via getField instead of by
+// name. The element refers to the container, which needs to outlive
+// it.
+template <typename C, typename T> class soa_element {
+  typedef std::make_index_sequence<adt::soa<C, T>::nfields> fields;
+
+  const adt::soa<C, T> *xs;
+  std::ptrdiff_t i;
+
+  template <std::size_t... Is> T value(std::index_sequence<Is...>) const {
+    T x{};
+    (void)std::initializer_list<int>{
+        (adt::detail::soa_field_t<T, Is>::ref(x, detail::soa_member<T, Is>()) =
+             get<Is>(),
+         0)...};
+    return x;
+  }
+
+public:
+  typedef T value_type;
+
+  soa_element(const adt::soa<C, T> &xs, std::ptrdiff_t i) : xs(&xs), i(i) {}
+
+  // Field I (see adt::soa_fields)
+  template <std::size_t I> decltype(auto) get() const {
+    return detail::soa_column_get(xs->template field<I>(), i);
+  }
+
+  operator T() const { return value(fields()); }
+};
+
+template <typename C, typename T>
+soa_element<C, T> getIndex(const adt::soa<C, T> &xs, std::ptrdiff_t i) {
+  return soa_element<C, T>(xs, i);
+}
+
+// getField
+
+// Field I of element i, reading only its column
+template <std::size_t I, typename C, typename T>
+decltype(auto) getField(const adt::soa<C, T> &xs, std::ptrdiff_t i) {
+  return detail::soa_column_get(xs.template field<I>(), i);
+}
+
+template <std::size_t I, typename C, typename T>
+decltype(auto) getField(const soa_element<C, T> &x) {
+  return x.template get<I>();
+}
+
+// Elements that are stored as a whole, e.g. cells or SIMD packs, so
+// that functions can access fields in the same way for both
+template <std::size_t I, typename T> decltype(auto) getField(const T &x) {
+  return adt::detail::soa_field_t<T, I>::get(x, detail::soa_member<T, I>());
+}
+
+namespace detail {
+// Accumulate a column
+template <typename Col> class soa_column_accumulator {
+  accumulator<Col> acc;
+
+public:
+  soa_column_accumulator(std::ptrdiff_t n) : acc(n) {}
+  template <typename U> void set(std::ptrdiff_t i, const U &x) { acc[i] = x; }
+  auto pointer() { return &acc[0]; }
+  Col finalize() { return acc.finalize(); }
+};
+
+template <typename Col, std::size_t N>
+class soa_column_accumulator<adt::detail::soa_columns<Col, N>> {
+  std::array<soa_column_accumulator<Col>, N> accs;
+
+  template <std::size_t... Ns>
+  soa_column_accumulator(std::ptrdiff_t n, std::index_sequence<Ns...>)
+      : accs{{((void)Ns, soa_column_accumulator<Col>(n))...}} {}
+
+public:
+  soa_column_accumulator(std::ptrdiff_t n)
+      : soa_column_accumulator(n, std::make_index_sequence<N>()) {}
+  template <typename U> void set(std::ptrdiff_t i, const std::array<U, N> &x) {
+    for (std::size_t n = 0; n < N; ++n)
+      accs[n].set(i, x[n]);
+  }
+  auto pointer() {
+    std::array<decltype(accs[0].pointer()), N> ps;
+    for (std::size_t n = 0; n < N; ++n)
+      ps[n] = accs[n].pointer();
+    return ps;
+  }
+  adt::detail::soa_columns<Col, N> finalize() {
+    adt::detail::soa_columns<Col, N> cs;
+    for (std::size_t n = 0; n < N; ++n)
+      cs.cols[n] = accs[n].finalize();
+    return cs;
+  }
+};
+} // namespace detail
+
+template <typename C, typename T> class accumulator<adt::soa<C, T>> {
+  typedef adt::soa<C, T> CT;
+  typedef std::make_index_sequence<CT::nfields> fields;
+
+  template <typename Is> struct accumulators;
+  template <std::size_t... Is> struct accumulators<std::index_sequence<Is...>> {
+    typedef std::tuple<detail::soa_column_accumulator<
+        typename CT::template column_type<Is>>...>
+        type;
+  };
+  typename accumulators<fields>::type accs;
+
+  template <std::size_t... Is>
+  accumulator(std::ptrdiff_t n, std::index_sequence<Is...>)
+      : accs(((void)Is, n)...) {}
+
+  template <std::size_t... Is>
+  void set(std::ptrdiff_t i, const T &x, std::index_sequence<Is...>) {
+    (void)std::initializer_list<int>{
+        (std::get<Is>(accs).set(i, adt::detail::soa_field_t<T, Is>::get(
+                                       x, detail::soa_member<T, Is>())),
+         0)...};
+  }
+
+  template <typename C1, std::size_t... Is>
+  void copy(std::ptrdiff_t i, const soa_element<C1, T> &x,
+            std::index_sequence<Is...>) {
+    (void)std::initializer_list<int>{
+        (std::get<Is>(accs).set(i, x.template get<Is>()), 0)...};
+  }
+
+  template <std::size_t... Is> auto pointers(std::index_sequence<Is...>) {
+    return std::make_tuple(std::get<Is>(accs).pointer()...);
+  }
+
+  template <std::size_t... Is> CT finalize(std::index_sequence<Is...>) {
+    return CT(typename CT::fields_type(std::get<Is>(accs).finalize()...));
+  }
+
+public:
+  // Elements are split into their fields when they are assigned
+  class reference {
+    accumulator &acc;
+    std::ptrdiff_t i;
+
+  public:
+    reference(accumulator &acc, std::ptrdiff_t i) : acc(acc), i(i) {}
+    const reference &operator=(const T &x) const {
+      acc.set(i, x, fields());
+      return *this;
+    }
+    // Copy an element column by column
+    template <typename C1>
+    const reference &operator=(const soa_element<C1, T> &x) const {
+      acc.copy(i, x, fields());
+      return *this;
+    }
+  };
+
+  accumulator(std::ptrdiff_t n) : accumulator(n, fields()) {}
+  reference operator[](std::ptrdiff_t i) { return reference(*this, i); }
+  // non-standard: Pointers to the first element of each field, as for
+  // adt::soa::pointers
+  auto pointers() { return pointers(fields()); }
+  CT finalize() { return finalize(fields()); }
+};
+
+// munit
+
+template <typename C, typename T, std::enable_if_t<detail::is_soa<C>::value> *,
+          typename R, typename CR>
+CR munit(T &&x) {
+  accumulator<CR> acc(1);
+  acc[0] = std::forward<T>(x);
+  return acc.finalize();
+}
+
+// msize
+
+namespace detail {
+template <typename Col> std::size_t soa_column_size(const Col &col) {
+  return msize(col);
+}
+template <typename Col, std::size_t N>
+std::size_t soa_column_size(const adt::detail::soa_columns<Col, N> &cs) {
+  return soa_column_size(cs.cols[0]);
+}
+} // namespace detail
+
+template <typename C, typename T>
+std::size_t msize(const adt::soa<C, T> &xs) {
+  return detail::soa_column_size(xs.template field<0>());
+}
+} // namespace fun
+
+#define FUN_SOA_IMPL_HPP_DONE
+#endif // #ifdef FUN_SOA_IMPL_HPP
+#ifndef FUN_SOA_IMPL_HPP_DONE
+#error "Cyclic include dependency"
+#endif
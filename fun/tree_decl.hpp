@@ -144,6 +144,19 @@ template <typename F, typename Op, typename Z, typename A, typename T,
 R foldMap2(F &&f, Op &&op, Z &&z, const adt::tree<A, T> &xs,
            const adt::tree<A, T2> &ys, Args &&... args);
 
+// foldMapAsync
+
+template <typename F, typename Op, typename Z, typename A, typename T,
+          typename... Args,
+          typename R = std::decay_t<cxx::invoke_of_t<F, T, Args...>>,
+          typename R1 = detail::fold_result_t<R>>
+qthread::future<R1> foldMapAsync(F &&f, Op &&op, Z &&z,
+                                 const adt::tree<A, T> &xs, Args &&... args);
+
+// prefetch
+
+template <typename A, typename T> void prefetch(const adt::tree<A, T> &xs);
+
 // dump
 
 template <typename A, typename T> ostreamer dump(const adt::tree<A, T> &xs);
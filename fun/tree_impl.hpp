@@ -8,16 +8,19 @@
 #include <cxx/cassert.hpp>
 #include <cxx/invoke.hpp>
 #include <fun/fun_decl.hpp>
+#include <fun/fun_impl.hpp>
 
 #include <adt/tree_impl.hpp>
 
 #include <algorithm>
+#include <cstddef>
 #include <initializer_list>
 #include <iterator>
 #include <sstream>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace fun {
 
@@ -506,6 +509,68 @@ R foldMap2(F &&f, Op &&op, Z &&z, const adt::tree<A, T> &xs,
                   std::forward<Args>(args)...);
 }
 
+// foldMapAsync
+
+namespace detail {
+struct tree_foldMapAsync : std::tuple<> {
+  template <typename A, typename T, typename F, typename Op, typename Z,
+            typename... Args>
+  auto operator()(const adt::tree<A, T> &xs, F &&f, Op &&op, Z &&z,
+                  Args &&... args) const {
+    return foldMapAsync(std::forward<F>(f), std::forward<Op>(op),
+                        std::forward<Z>(z), xs, std::forward<Args>(args)...)
+        .share();
+  }
+};
+} // namespace detail
+
+// Subtrees are reduced concurrently
+template <typename F, typename Op, typename Z, typename A, typename T,
+          typename... Args, typename R, typename R1>
+qthread::future<R1> foldMapAsync(F &&f, Op &&op, Z &&z,
+                                 const adt::tree<A, T> &xs, Args &&... args) {
+  static_assert(std::is_same<cxx::invoke_of_t<Op, R1, R1>, R1>::value, "");
+  bool s = xs.subtrees.right();
+  if (!s)
+    return detail::fold_future(cxx::invoke(std::forward<F>(f),
+                                           xs.subtrees.get_left(),
+                                           std::forward<Args>(args)...));
+  return foldMapAsync(detail::tree_foldMapAsync(), op, z,
+                      xs.subtrees.get_right(), f, op, z,
+                      std::forward<Args>(args)...);
+}
+
+namespace detail {
+// A branch is reduced where its subtrees live; leaves are reduced
+// where the tree is
+template <typename A, typename T> struct fold_placement<adt::tree<A, T>> {
+  typedef std::decay_t<decltype(
+      std::declval<adt::tree<A, T>>().subtrees.get_right())>
+      branch_t;
+  static std::ptrdiff_t owner(const adt::tree<A, T> &xs) {
+    if (!xs.subtrees.right())
+      return -1;
+    return fold_placement<branch_t>::owner(xs.subtrees.get_right());
+  }
+  template <typename U, typename F, typename Op, typename R, typename... Args>
+  static qthread::shared_future<R>
+  reduce_groups(std::vector<std::pair<std::ptrdiff_t, std::vector<U>>> groups,
+                const F &f, const Op &op, const R &z, const Args &... args) {
+    return fold_placement<branch_t>::reduce_groups(std::move(groups), f, op,
+                                                   z, args...);
+  }
+};
+} // namespace detail
+
+// prefetch
+
+template <typename A, typename T> void prefetch(const adt::tree<A, T> &xs) {
+  if (xs.subtrees.right())
+    prefetch(xs.subtrees.get_right());
+  else
+    prefetch(xs.subtrees.get_left());
+}
+
 // dump
 
 namespace detail {
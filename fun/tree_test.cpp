@@ -124,6 +124,19 @@ TEST(fun_tree, foldMap) {
   EXPECT_EQ(s * (s - 1) / 2, r);
 }
 
+TEST(fun_tree, foldMapAsync) {
+  std::ptrdiff_t s = 10;
+  auto xs = iotaMap<shared_tree<adt::dummy>>([](auto x) { return int(x); }, s);
+  auto r = foldMapAsync([](auto x) { return x; },
+                        [](auto x, auto y) { return x + y; }, 0, xs);
+  EXPECT_EQ(s * (s - 1) / 2, r.get());
+
+  auto ys = iotaMap<future_tree<adt::dummy>>([](auto x) { return int(x); }, s);
+  auto r2 = foldMapAsync([](auto x) { return x; },
+                         [](auto x, auto y) { return x + y; }, 0, ys);
+  EXPECT_EQ(s * (s - 1) / 2, r2.get());
+}
+
 TEST(fun_tree, monad) {
   auto xs = munit<shared_tree<adt::dummy>>(1);
   auto xss = munit<shared_tree<adt::dummy>>(xs);
@@ -7,8 +7,10 @@
 #include <cxx/invoke.hpp>
 #include <fun/fun_decl.hpp>
 #include <fun/idtype.hpp>
+#include <fun/simd_stencil.hpp>
 
 #include <algorithm>
+#include <array>
 #include <initializer_list>
 #include <iterator>
 #include <memory>
@@ -175,8 +177,11 @@ CR fmapStencil(F &&f, G &&g, const std::vector<T, Allocator> &xs,
   } else if (__builtin_expect(s > 1, true)) {
     rs[0] = cxx::invoke(f, xs[0], bmask & 0b01, std::forward<BM>(bm),
                         cxx::invoke(g, xs[1], 0), args...);
+    const std::ptrdiff_t imin = detail::simd_stencil_loop(
+        f, g, xs.data(), rs.data(), 1, s - 1,
+        std::array<std::ptrdiff_t, 1>{{1}}, args...);
 #pragma omp simd
-    for (std::ptrdiff_t i = 1; i < s - 1; ++i)
+    for (std::ptrdiff_t i = imin; i < s - 1; ++i)
       rs[i] = cxx::invoke(f, xs[i], 0b00, cxx::invoke(g, xs[i - 1], 1),
                           cxx::invoke(g, xs[i + 1], 0), args...);
     rs[s - 1] =
@@ -207,8 +212,10 @@ CR fmapStencilMulti(F &&f, G &&g, const std::vector<T, Allocator> &xs,
   } else if (__builtin_expect(s > 1, true)) {
     rp[0] = cxx::invoke(f, xp[0], bmask & 0b01, mextract(bm),
                         cxx::invoke(g, xp[1], 0), args...);
+    const std::ptrdiff_t imin = detail::simd_stencil_loop(
+        f, g, xp, rp, 1, s - 1, std::array<std::ptrdiff_t, 1>{{1}}, args...);
 #pragma omp simd
-    for (std::ptrdiff_t i = 1; i < s - 1; ++i)
+    for (std::ptrdiff_t i = imin; i < s - 1; ++i)
       rp[i] = cxx::invoke(f, xp[i], 0b00, cxx::invoke(g, xp[i - 1], 1),
                           cxx::invoke(g, xp[i + 1], 0), args...);
     rp[s - 1] =
@@ -350,6 +357,14 @@ R foldMap2(F &&f, Op &&op, Z &&z, const std::vector<T, Allocator> &xs,
   return r;
 }
 
+// prefetch
+
+template <typename T, typename Allocator>
+void prefetch(const std::vector<T, Allocator> &xs) {
+  for (const auto &x : xs)
+    prefetch(x);
+}
+
 // dump
 
 template <typename T, typename Allocator>
@@ -7,10 +7,16 @@
 #include <funhpc/rptr.hpp>
 #include <qthread/future.hpp>
 
+#include <cereal/archives/binary.hpp>
 #include <cereal/types/tuple.hpp>
 
+#include <cstdint>
+#include <numeric>
+#include <sstream>
+#include <string>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 namespace funhpc {
 
@@ -21,6 +27,10 @@ enum class rlaunch : unsigned {
   deferred = static_cast<unsigned>(qthread::launch::deferred),
   sync = static_cast<unsigned>(qthread::launch::sync),
   detached = static_cast<unsigned>(qthread::launch::detached),
+  // modifier: run on a large stack
+  large_stack = static_cast<unsigned>(qthread::launch::large_stack),
+  // modifier: run on any process (only without a destination)
+  anywhere = 32,
 };
 
 inline constexpr rlaunch operator~(rlaunch a) {
@@ -47,6 +57,7 @@ inline rlaunch &operator^=(rlaunch &a, rlaunch b) { return a = a ^ b; }
 namespace detail {
 // Convert bitmask to a specific policy
 /*gcc constexpr*/ inline rlaunch decode_policy(rlaunch policy) {
+  policy &= ~(rlaunch::large_stack | rlaunch::anywhere);
   if ((policy | rlaunch::async) == rlaunch::async)
     return rlaunch::async;
   if ((policy | rlaunch::deferred) == rlaunch::deferred)
@@ -60,40 +71,71 @@ namespace detail {
 
 // Convert policy to a local policy
 constexpr qthread::launch local_policy(rlaunch policy) {
-  return static_cast<qthread::launch>(policy);
+  return static_cast<qthread::launch>(policy & ~rlaunch::anywhere);
+}
+
+constexpr bool large_stack(rlaunch policy) {
+  return (policy & rlaunch::large_stack) == rlaunch::large_stack;
+}
+
+constexpr bool anywhere(rlaunch policy) {
+  return (policy & rlaunch::anywhere) == rlaunch::anywhere;
 }
 } // namespace detail
 
 // async ///////////////////////////////////////////////////////////////////////
 
 namespace detail {
-template <typename R> struct set_result : std::tuple<> {
-  void operator()(rptr<qthread::promise<R>> rpres, R &&res) const {
-    auto pres = rpres.get_ptr();
-    pres->set_value(std::move(res));
-    delete pres;
+// Set a promise from a serialized result (see enqueue_reply)
+template <typename R> void set_reply(void *pres_, std::string &&payload) {
+  auto pres = static_cast<qthread::promise<R> *>(pres_);
+  R res;
+  {
+    std::stringstream buf(std::move(payload));
+    (cereal::BinaryInputArchive(buf))(res);
   }
-};
-template <> struct set_result<void> : std::tuple<> {
-  void operator()(rptr<qthread::promise<void>> rpres) const {
-    auto pres = rpres.get_ptr();
-    pres->set_value();
-    delete pres;
+  pres->set_value(std::move(res));
+  delete pres;
+}
+template <>
+inline void set_reply<void>(void *pres_, std::string &&payload) {
+  auto pres = static_cast<qthread::promise<void> *>(pres_);
+  pres->set_value();
+  delete pres;
+}
+
+struct ignore_result : std::tuple<> {
+  template <typename F, typename... Args>
+  void operator()(F &&f, Args &&... args) const {
+    cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...);
   }
 };
 
+// Create a task that can be serialized
+template <typename F, typename... Args>
+task_t make_task(F &&f, Args &&... args) {
+  task_t::register_type<std::decay_t<F>, std::decay_t<Args>...>();
+  return task_t(std::forward<F>(f), std::forward<Args>(args)...);
+}
+
 template <typename R> struct continued : std::tuple<> {
   template <typename F, typename... Args>
-  void operator()(rptr<qthread::promise<R>> rpres, F &&f, Args &&... args) {
-    rexec(rpres.get_proc(), set_result<R>(), rpres,
+  void operator()(std::ptrdiff_t proc, std::uint64_t id, F &&f,
+                  Args &&... args) const {
+    std::stringstream buf;
+    {
+      (cereal::BinaryOutputArchive(buf))(
           cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...));
+    }
+    enqueue_reply(proc, id, buf.str());
   }
 };
 template <> struct continued<void> : std::tuple<> {
   template <typename F, typename... Args>
-  void operator()(rptr<qthread::promise<void>> rpres, F &&f, Args &&... args) {
+  void operator()(std::ptrdiff_t proc, std::uint64_t id, F &&f,
+                  Args &&... args) const {
     cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...);
-    rexec(rpres.get_proc(), set_result<void>(), rpres);
+    enqueue_reply(proc, id, std::string());
   }
 };
 } // namespace detail
@@ -112,8 +154,13 @@ qthread::future<R> async(rlaunch policy, std::ptrdiff_t dest, F &&f,
   case rlaunch::sync: {
     auto pres = new qthread::promise<R>;
     auto fres = pres->get_future();
-    rexec(dest, detail::continued<R>(), rptr<qthread::promise<R>>(pres),
-          std::forward<F>(f), std::forward<Args>(args)...);
+    auto id = detail::register_reply(detail::set_reply<R>, pres);
+    if (detail::large_stack(policy))
+      rexec(dest, qthread::detail::large_stack_call(), detail::continued<R>(),
+            rank(), id, std::forward<F>(f), std::forward<Args>(args)...);
+    else
+      rexec(dest, detail::continued<R>(), rank(), id, std::forward<F>(f),
+            std::forward<Args>(args)...);
     if (pol == rlaunch::sync)
       fres.wait();
     return fres;
@@ -121,16 +168,25 @@ qthread::future<R> async(rlaunch policy, std::ptrdiff_t dest, F &&f,
   case rlaunch::deferred: {
     return qthread::async(
         qthread::launch::deferred,
-        [dest](auto &&f, auto &&... args) {
-          return async(rlaunch::async, dest, std::move(f), std::move(args)...)
+        [dest, policy](auto &&f, auto &&... args) {
+          return async(rlaunch::async | (policy & rlaunch::large_stack), dest,
+                       std::move(f), std::move(args)...)
               .get();
         },
         std::forward<F>(f), std::forward<Args>(args)...);
   }
   case rlaunch::detached: {
-    rexec(dest, std::forward<F>(f), std::forward<Args>(args)...);
+    if (detail::large_stack(policy))
+      rexec(dest, qthread::detail::large_stack_call(), std::forward<F>(f),
+            std::forward<Args>(args)...);
+    else
+      rexec(dest, std::forward<F>(f), std::forward<Args>(args)...);
     return qthread::future<R>();
   }
+  case rlaunch::large_stack:
+  case rlaunch::anywhere:
+    // masked out by decode_policy
+    break;
   }
   __builtin_unreachable();
 }
@@ -154,6 +210,185 @@ qthread::future<R> async(rlaunch policy,
       },
       std::forward<F>(f), std::forward<Args>(args)...);
 }
+
+// Launch a task on a lightly loaded process. Processes append their
+// current load to all messages they send; the estimates may thus be
+// outdated for processes we have not heard from recently.
+struct least_loaded_t {
+  // Prefer processes on the same node if their load is similar (see
+  // FUNHPC_LOCAL_LOAD_SLACK_PERCENT)
+  bool prefer_local;
+};
+constexpr least_loaded_t least_loaded{false};
+constexpr least_loaded_t least_loaded_local{true};
+
+template <typename F, typename... Args,
+          typename R = std::decay_t<
+              cxx::invoke_of_t<std::decay_t<F>, std::decay_t<Args>...>>>
+qthread::future<R> async(rlaunch policy, least_loaded_t where, F &&f,
+                         Args &&... args) {
+  return async(policy, detail::least_loaded_proc(where.prefer_local),
+               std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+// Launch a task on any process. The task is added to this process'
+// work pool; processes with idle threads steal tasks from other
+// processes' pools. The policy must include rlaunch::anywhere.
+template <typename F, typename... Args,
+          typename R = std::decay_t<
+              cxx::invoke_of_t<std::decay_t<F>, std::decay_t<Args>...>>>
+qthread::future<R> async(rlaunch policy, F &&f, Args &&... args) {
+  cxx_assert(detail::anywhere(policy));
+  auto pol = detail::decode_policy(policy);
+  switch (pol) {
+  case rlaunch::async:
+  case rlaunch::sync: {
+    auto pres = new qthread::promise<R>;
+    auto fres = pres->get_future();
+    auto id = detail::register_reply(detail::set_reply<R>, pres);
+    if (detail::large_stack(policy))
+      enqueue_anywhere(detail::make_task(
+          qthread::detail::large_stack_call(), detail::continued<R>(), rank(),
+          id, std::forward<F>(f), std::forward<Args>(args)...));
+    else
+      enqueue_anywhere(detail::make_task(detail::continued<R>(), rank(), id,
+                                         std::forward<F>(f),
+                                         std::forward<Args>(args)...));
+    if (pol == rlaunch::sync)
+      fres.wait();
+    return fres;
+  }
+  case rlaunch::deferred: {
+    return qthread::async(
+        qthread::launch::deferred,
+        [policy](auto &&f, auto &&... args) {
+          return async(rlaunch::async | rlaunch::anywhere |
+                           (policy & rlaunch::large_stack),
+                       std::move(f), std::move(args)...)
+              .get();
+        },
+        std::forward<F>(f), std::forward<Args>(args)...);
+  }
+  case rlaunch::detached: {
+    if (detail::large_stack(policy))
+      enqueue_anywhere(detail::make_task(qthread::detail::large_stack_call(),
+                                         std::forward<F>(f),
+                                         std::forward<Args>(args)...));
+    else
+      enqueue_anywhere(detail::make_task(std::forward<F>(f),
+                                         std::forward<Args>(args)...));
+    return qthread::future<R>();
+  }
+  case rlaunch::large_stack:
+  case rlaunch::anywhere:
+    // masked out by decode_policy
+    break;
+  }
+  __builtin_unreachable();
+}
+
+// async_unwrap ////////////////////////////////////////////////////////////////
+
+namespace detail {
+template <typename T> struct future_value;
+template <typename T> struct future_value<qthread::future<T>> {
+  typedef T type;
+};
+template <typename T> struct future_value<qthread::shared_future<T>> {
+  typedef T type;
+};
+
+template <typename R> std::string serialize_reply(qthread::future<R> &ftr) {
+  std::stringstream buf;
+  { (cereal::BinaryOutputArchive(buf))(ftr.get()); }
+  return buf.str();
+}
+template <typename R>
+std::string serialize_reply(const qthread::shared_future<R> &ftr) {
+  std::stringstream buf;
+  { (cereal::BinaryOutputArchive(buf))(ftr.get()); }
+  return buf.str();
+}
+inline std::string serialize_reply(qthread::future<void> &ftr) {
+  ftr.get();
+  return std::string();
+}
+inline std::string serialize_reply(const qthread::shared_future<void> &ftr) {
+  ftr.get();
+  return std::string();
+}
+
+// Reply once the future that f returns is ready
+struct continued_unwrap : std::tuple<> {
+  template <typename F, typename... Args>
+  void operator()(std::ptrdiff_t proc, std::uint64_t id, F &&f,
+                  Args &&... args) const {
+    qthread::detail::when_ready(
+        cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...),
+        [proc, id](auto &ftr) {
+          enqueue_reply(proc, id, serialize_reply(ftr));
+        });
+  }
+};
+
+template <typename T> qthread::future<T> unshare(qthread::future<T> &&ftr) {
+  return std::move(ftr);
+}
+template <typename T>
+qthread::future<T> unshare(const qthread::shared_future<T> &ftr) {
+  return qthread::detail::unshare(ftr);
+}
+} // namespace detail
+
+// non-standard: Run a function that returns a future on a process,
+// and return a future for that future's value. The function should
+// return quickly (e.g. after starting other tasks); the reply is sent
+// when its future becomes ready, without a thread waiting for it on
+// the destination.
+template <typename F, typename... Args,
+          typename FR = std::decay_t<
+              cxx::invoke_of_t<std::decay_t<F>, std::decay_t<Args>...>>,
+          typename R = typename detail::future_value<FR>::type>
+qthread::future<R> async_unwrap(std::ptrdiff_t dest, F &&f, Args &&... args) {
+  if (dest == rank())
+    return detail::unshare(
+        cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...));
+  auto pres = new qthread::promise<R>;
+  auto fres = pres->get_future();
+  auto id = detail::register_reply(detail::set_reply<R>, pres);
+  rexec(dest, detail::continued_unwrap(), rank(), id, std::forward<F>(f),
+        std::forward<Args>(args)...);
+  return fres;
+}
+
+// async_set ///////////////////////////////////////////////////////////////////
+
+// Execute a task on a set of distinct processes (see rexec_set), and
+// return a future that becomes ready once all have finished
+template <typename F, typename... Args>
+qthread::future<void> async_set(const std::vector<std::ptrdiff_t> &dests,
+                                F &&f, Args &&... args) {
+  if (dests.empty())
+    return qthread::make_ready_future();
+  if (dests.size() == 1)
+    return async(rlaunch::async, dests[0], detail::ignore_result(),
+                 std::forward<F>(f), std::forward<Args>(args)...);
+  auto done = new qthread::promise<void>;
+  auto fres = done->get_future();
+  task_t::register_type<std::decay_t<F>, std::decay_t<Args>...>();
+  enqueue_broadcast(dests,
+                    task_t(std::forward<F>(f), std::forward<Args>(args)...),
+                    done);
+  return fres;
+}
+
+// Execute a task on all processes
+template <typename F, typename... Args>
+qthread::future<void> async_all(F &&f, Args &&... args) {
+  std::vector<std::ptrdiff_t> dests(size());
+  std::iota(dests.begin(), dests.end(), 0);
+  return async_set(dests, std::forward<F>(f), std::forward<Args>(args)...);
+}
 } // namespace funhpc
 
 #define FUNHPC_ASYNC_HPP_DONE
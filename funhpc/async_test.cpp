@@ -1,8 +1,12 @@
 #include <funhpc/async.hpp>
 #include <qthread/future.hpp>
 
+#include <cereal/types/string.hpp>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 using namespace funhpc;
 using namespace qthread;
 
@@ -105,3 +109,108 @@ TEST(funhpc_async, detached) {
   EXPECT_FALSE(ires.valid());
   qthread::this_thread::sleep_for(std::chrono::milliseconds(200));
 }
+
+namespace {
+// Use about 1 MByte of stack space
+int deep(int count) {
+  volatile char buffer[1024];
+  buffer[0] = char(count);
+  if (count == 0)
+    return buffer[0];
+  return deep(count - 1) + 1 + buffer[0] - char(count);
+}
+} // namespace
+
+TEST(funhpc_async, large_stack) {
+  auto p = 1 % size();
+  auto f = async(rlaunch::async | rlaunch::large_stack, p, deep, 1000);
+  EXPECT_EQ(1000, f.get());
+}
+
+namespace {
+void check_rank(std::ptrdiff_t p) { EXPECT_GE(p, 0); }
+} // namespace
+
+TEST(funhpc_async, async_all) {
+  auto f = async_all(check_rank, rank());
+  f.get();
+  std::vector<std::ptrdiff_t> dests;
+  for (std::ptrdiff_t p = size() - 1; p >= 0; p -= 2)
+    dests.push_back(p);
+  auto g = async_set(dests, check_rank, rank());
+  g.get();
+  auto h = async_set({}, check_rank, rank());
+  EXPECT_TRUE(h.ready());
+}
+
+namespace {
+std::string make_string(std::size_t size) { return std::string(size, 'a'); }
+} // namespace
+
+TEST(funhpc_async, large_result) {
+  auto p = 1 % size();
+  // Small results are handled by the MPI thread, large ones in a new
+  // thread
+  auto f1 = async(rlaunch::async, p, make_string, 10);
+  auto f2 = async(rlaunch::async, p, make_string, 100000);
+  EXPECT_EQ(make_string(10), f1.get());
+  EXPECT_EQ(make_string(100000), f2.get());
+}
+
+namespace {
+int fib(int n) {
+  if (n < 2)
+    return n;
+  auto f1 = async(rlaunch::async | rlaunch::anywhere, fib, n - 1);
+  auto f2 = fib(n - 2);
+  return f1.get() + f2;
+}
+} // namespace
+
+TEST(funhpc_async, anywhere) {
+  std::vector<qthread::future<int>> fs;
+  for (int i = 0; i < 100; ++i)
+    fs.push_back(async(rlaunch::async | rlaunch::anywhere, add, i, 1));
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(i + 1, fs[i].get());
+  auto fres = async(rlaunch::sync | rlaunch::anywhere, idelay);
+  EXPECT_TRUE(fres.ready());
+  EXPECT_EQ(1, fres.get());
+  auto dres = async(rlaunch::deferred | rlaunch::anywhere, idelay);
+  EXPECT_FALSE(dres.ready());
+  EXPECT_EQ(1, dres.get());
+  // Tasks in the pool wait for other tasks in the pool
+  EXPECT_EQ(55, fib(10));
+}
+
+namespace {
+std::ptrdiff_t slow_rank() {
+  qthread::this_thread::sleep_for(std::chrono::milliseconds(10));
+  return rank();
+}
+} // namespace
+
+TEST(funhpc_async, steal) {
+  // Idle processes steal tasks from this process' pool
+  std::vector<qthread::future<std::ptrdiff_t>> fs;
+  for (int i = 0; i < 100; ++i)
+    fs.push_back(async(rlaunch::async | rlaunch::anywhere, slow_rank));
+  std::vector<bool> ran(size(), false);
+  for (auto &f : fs)
+    ran.at(f.get()) = true;
+  for (std::ptrdiff_t p = 0; p < size(); ++p)
+    if (p != rank())
+      EXPECT_TRUE(ran[p]);
+}
+
+TEST(funhpc_async, least_loaded) {
+  std::vector<qthread::future<int>> fs;
+  for (int i = 0; i < 100; ++i)
+    fs.push_back(async(rlaunch::async, least_loaded, add, i, 1));
+  for (int i = 0; i < 100; ++i)
+    fs.push_back(async(rlaunch::async, least_loaded_local, add, i, 2));
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(i + 1, fs[i].get());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(i + 2, fs[100 + i].get());
+}
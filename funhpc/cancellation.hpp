@@ -0,0 +1,286 @@
+#ifndef FUNHPC_CANCELLATION_HPP
+#define FUNHPC_CANCELLATION_HPP
+
+#include <cxx/cstdlib.hpp>
+#include <funhpc/async.hpp>
+#include <funhpc/rexec.hpp>
+#include <qthread/cancellation.hpp>
+#include <qthread/future.hpp>
+#include <qthread/mutex.hpp>
+
+#include <cereal/access.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace funhpc {
+
+// cancellation registry ///////////////////////////////////////////////////////
+
+// Cancellation tokens that cross process boundaries are identified by
+// their origin process and an id. Each process keeps a registry of the
+// tokens it sent or received, together with the processes it sent
+// them to or received them from. Requesting cancellation on any copy
+// sends a control message to these peers, which mark their copies as
+// cancelled and forward the request to their own peers. Cancellation
+// thus only reaches the processes that the token has visited.
+
+namespace detail {
+struct cancellation_registry {
+  typedef std::pair<std::ptrdiff_t, std::uint64_t> key_t;
+  typedef qthread::detail::cancellation_state state_t;
+  typedef std::set<std::ptrdiff_t> peers_t;
+
+  struct entry_t {
+    std::weak_ptr<state_t> state;
+    peers_t peers;
+  };
+
+  qthread::mutex mtx;
+  std::uint64_t next_id{1};
+  std::map<key_t, entry_t> states;
+  // Tokens that were dropped here, but that may still live on their
+  // peers, which need to be notified of cancellation requests
+  std::map<key_t, peers_t> retired, retired_old;
+  // Cancellation requests that arrived before the token did (e.g.
+  // because they overtook the task carrying the token)
+  std::set<key_t> cancelled, cancelled_old;
+  // Only the most recent retired tokens and early requests are kept,
+  // in two generations of at most max_cancelled entries each
+  std::size_t max_cancelled{std::size_t(
+      cxx::envtol("FUNHPC_CANCELLATION_HISTORY", "1024"))};
+  std::size_t prune_size{64};
+
+  void add_cancelled(const key_t &key) {
+    if (cancelled.size() >= max_cancelled) {
+      cancelled_old = std::move(cancelled);
+      cancelled.clear();
+    }
+    cancelled.insert(key);
+  }
+  bool is_cancelled(const key_t &key) const {
+    return cancelled.count(key) || cancelled_old.count(key);
+  }
+
+  void add_retired(const key_t &key, peers_t &&peers) {
+    if (retired.size() >= max_cancelled) {
+      retired_old = std::move(retired);
+      retired.clear();
+    }
+    retired[key] = std::move(peers);
+  }
+  peers_t take_retired(const key_t &key) {
+    peers_t peers;
+    for (auto *gen : {&retired, &retired_old}) {
+      auto i = gen->find(key);
+      if (i != gen->end()) {
+        peers.insert(i->second.begin(), i->second.end());
+        gen->erase(i);
+      }
+    }
+    return peers;
+  }
+
+  void prune() {
+    if (states.size() < prune_size)
+      return;
+    for (auto i = states.begin(); i != states.end();)
+      if (i->second.state.expired()) {
+        if (!i->second.peers.empty())
+          add_retired(i->first, std::move(i->second.peers));
+        i = states.erase(i);
+      } else {
+        ++i;
+      }
+    prune_size = 2 * states.size() + 64;
+  }
+};
+
+inline cancellation_registry &get_cancellation_registry() {
+  static cancellation_registry registry;
+  return registry;
+}
+
+inline void cancel_locally(std::ptrdiff_t origin, std::uint64_t id,
+                           std::ptrdiff_t sender);
+
+// Send a cancellation request to the peers of a token (except to the
+// process we received the request from)
+inline void send_cancel(std::ptrdiff_t origin, std::uint64_t id,
+                        const cancellation_registry::peers_t &peers,
+                        std::ptrdiff_t sender) {
+  std::vector<std::ptrdiff_t> dests;
+  for (auto p : peers)
+    if (p != sender && p != rank())
+      dests.push_back(p);
+  rexec_set(dests, cancel_locally, origin, id, rank());
+}
+
+// Called when a local copy of a token is cancelled
+inline void propagate_cancel(std::ptrdiff_t origin, std::uint64_t id) {
+  auto &registry = get_cancellation_registry();
+  cancellation_registry::peers_t peers;
+  {
+    qthread::lock_guard<qthread::mutex> g(registry.mtx);
+    auto i = registry.states.find(std::make_pair(origin, id));
+    if (i != registry.states.end())
+      peers = i->second.peers;
+  }
+  send_cancel(origin, id, peers, -1);
+}
+
+// Called when a peer requests cancellation
+inline void cancel_locally(std::ptrdiff_t origin, std::uint64_t id,
+                           std::ptrdiff_t sender) {
+  auto &registry = get_cancellation_registry();
+  cancellation_registry::peers_t peers;
+  {
+    qthread::lock_guard<qthread::mutex> g(registry.mtx);
+    auto key = std::make_pair(origin, id);
+    auto i = registry.states.find(key);
+    std::shared_ptr<cancellation_registry::state_t> state;
+    if (i != registry.states.end())
+      state = i->second.state.lock();
+    if (state) {
+      // Don't call request_cancel, which would propagate again
+      if (state->cancelled.exchange(true))
+        return;
+      peers = i->second.peers;
+    } else {
+      // The token may arrive later, or may have been forwarded from
+      // here before it was dropped
+      registry.add_cancelled(key);
+      if (i != registry.states.end()) {
+        peers = std::move(i->second.peers);
+        registry.states.erase(i);
+      }
+      auto retired = registry.take_retired(key);
+      peers.insert(retired.begin(), retired.end());
+    }
+  }
+  send_cancel(origin, id, peers, sender);
+}
+
+// Record the processes a token is sent to
+inline void add_cancellation_peers(const cancellation_registry::state_t &state,
+                                   const std::vector<std::ptrdiff_t> &peers) {
+  auto &registry = get_cancellation_registry();
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  auto &entry = registry.states[std::make_pair(state.origin, state.id)];
+  entry.peers.insert(peers.begin(), peers.end());
+}
+
+// Called when a token is sent to another process for the first time
+inline void register_cancellation_token(
+    const std::shared_ptr<cancellation_registry::state_t> &state) {
+  qthread::lock_guard<qthread::mutex> gs(state->mtx);
+  if (state->id != 0)
+    return;
+  auto &registry = get_cancellation_registry();
+  qthread::lock_guard<qthread::mutex> gr(registry.mtx);
+  state->origin = rank();
+  state->id = registry.next_id++;
+  auto origin = state->origin;
+  auto id = state->id;
+  state->on_cancel = [origin, id]() { propagate_cancel(origin, id); };
+  registry.prune();
+  registry.states[std::make_pair(origin, id)].state = state;
+}
+
+// Called when a token is received from another process
+inline std::shared_ptr<cancellation_registry::state_t>
+lookup_cancellation_token(std::ptrdiff_t origin, std::uint64_t id,
+                          std::ptrdiff_t sender, bool cancel_on_drop) {
+  auto &registry = get_cancellation_registry();
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  auto key = std::make_pair(origin, id);
+  auto &entry = registry.states[key];
+  if (sender >= 0)
+    entry.peers.insert(sender);
+  if (auto state = entry.state.lock())
+    return state;
+  auto state = std::make_shared<cancellation_registry::state_t>();
+  state->cancel_on_drop = cancel_on_drop;
+  state->origin = origin;
+  state->id = id;
+  state->on_cancel = [origin, id]() { propagate_cancel(origin, id); };
+  if (registry.is_cancelled(key))
+    state->cancelled = true;
+  auto retired = registry.take_retired(key);
+  entry.peers.insert(retired.begin(), retired.end());
+  entry.state = state;
+  registry.prune();
+  return state;
+}
+} // namespace detail
+
+// async ///////////////////////////////////////////////////////////////////////
+
+template <typename F, typename... Args,
+          typename R = std::decay_t<
+              cxx::invoke_of_t<std::decay_t<F>, std::decay_t<Args>...>>>
+qthread::future<R> async(rlaunch policy, std::ptrdiff_t dest,
+                         const qthread::cancellation_token &token, F &&f,
+                         Args &&... args) {
+  if (dest == rank())
+    return qthread::async(detail::local_policy(policy), token,
+                          std::forward<F>(f), std::forward<Args>(args)...);
+  static_assert(std::is_void<R>::value ||
+                    std::is_default_constructible<R>::value,
+                "Cancellable tasks need to be able to return a "
+                "value-initialized result");
+  // Don't send tasks that are already cancelled
+  if (token.cancelled()) {
+    if (detail::decode_policy(policy) == rlaunch::detached)
+      return qthread::future<R>();
+    return qthread::detail::async_make_ready_future([]() { return R(); });
+  }
+  auto fres =
+      async(policy, dest, qthread::detail::skip_if_cancelled<R>(), token,
+            std::forward<F>(f), std::forward<Args>(args)...);
+  if (token.cancel_on_drop())
+    return qthread::detail::cancel_on_drop(std::move(fres), token);
+  return fres;
+}
+} // namespace funhpc
+
+namespace qthread {
+
+// serialization ///////////////////////////////////////////////////////////////
+
+template <typename Archive>
+void save(Archive &ar, const cancellation_token &token) {
+  const auto &state = token.get_state();
+  funhpc::detail::register_cancellation_token(state);
+  // Record the peers before reading the flag, so that a concurrent
+  // cancellation either notifies them or is serialized
+  funhpc::detail::add_cancellation_peers(
+      *state, funhpc::detail::archive_destinations(&ar));
+  bool cancelled = token.cancelled();
+  ar(state->origin, state->id, funhpc::rank(), cancelled,
+     state->cancel_on_drop);
+}
+
+template <typename Archive> void load(Archive &ar, cancellation_token &token) {
+  std::ptrdiff_t origin;
+  std::uint64_t id;
+  std::ptrdiff_t sender;
+  bool cancelled, cancel_on_drop;
+  ar(origin, id, sender, cancelled, cancel_on_drop);
+  token = cancellation_token(funhpc::detail::lookup_cancellation_token(
+      origin, id, sender, cancel_on_drop));
+  if (cancelled)
+    token.get_state()->cancelled = true;
+}
+} // namespace qthread
+
+#define FUNHPC_CANCELLATION_HPP_DONE
+#endif // #ifdef FUNHPC_CANCELLATION_HPP
+#ifndef FUNHPC_CANCELLATION_HPP_DONE
+#error "Cyclic include dependency"
+#endif
@@ -0,0 +1,99 @@
+#include <funhpc/cancellation.hpp>
+#include <funhpc/rexec.hpp>
+#include <qthread/cancellation.hpp>
+#include <qthread/thread.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <utility>
+
+using namespace funhpc;
+using namespace qthread;
+
+namespace {
+int add(int x, int y) { return x + y; }
+
+int wait_for_cancel(cancellation_token token) {
+  while (!token.cancelled())
+    this_thread::yield();
+  return 1;
+}
+
+int cancel_self(cancellation_token token) {
+  token.request_cancel();
+  return 1;
+}
+} // namespace
+
+TEST(funhpc_cancellation, remote) {
+  auto p = 1 % size();
+  cancellation_token token;
+  auto f0 = async(rlaunch::async, p, token, add, 1, 2);
+  EXPECT_EQ(3, f0.get());
+  auto f1 = async(rlaunch::async, p, token, wait_for_cancel, token);
+  token.request_cancel();
+  // The task is either skipped, or it notices the cancellation
+  auto r1 = f1.get();
+  EXPECT_TRUE(r1 == 0 || r1 == 1);
+  auto f2 = async(rlaunch::async, p, token, add, 1, 2);
+  EXPECT_EQ(0, f2.get());
+}
+
+TEST(funhpc_cancellation, remote_request) {
+  auto p = 1 % size();
+  cancellation_token token;
+  auto f = async(rlaunch::async, p, token, cancel_self, token);
+  EXPECT_EQ(1, f.get());
+  while (!token.cancelled())
+    this_thread::yield();
+  EXPECT_TRUE(token.cancelled());
+}
+
+TEST(funhpc_cancellation, remote_drop) {
+  auto p = 1 % size();
+  cancellation_token token(true);
+  { auto f = async(rlaunch::async, p, token, wait_for_cancel, token); }
+  EXPECT_TRUE(token.cancelled());
+}
+
+TEST(funhpc_cancellation, history) {
+  // Requests for tokens that never arrive are eventually forgotten
+  auto &registry = funhpc::detail::get_cancellation_registry();
+  auto n = registry.max_cancelled;
+  for (std::uint64_t id = 1; id <= 3 * n; ++id)
+    funhpc::detail::cancel_locally(-1, id, -1);
+  EXPECT_LE(registry.cancelled.size() + registry.cancelled_old.size(), 2 * n);
+  EXPECT_TRUE(registry.is_cancelled(std::make_pair(-1, 3 * n)));
+  EXPECT_FALSE(registry.is_cancelled(std::make_pair(-1, 1)));
+  // Recent requests still apply to tokens that arrive late
+  auto state = funhpc::detail::lookup_cancellation_token(-1, 3 * n, -1, false);
+  EXPECT_TRUE(state->cancelled);
+}
+
+TEST(funhpc_cancellation, peers) {
+  // Cancellation is only sent to the processes that saw the token
+  auto &registry = funhpc::detail::get_cancellation_registry();
+  auto key = std::make_pair(std::ptrdiff_t(-2), std::uint64_t(1));
+  {
+    cancellation_token token(
+        funhpc::detail::lookup_cancellation_token(-2, 1, -1, false));
+    funhpc::detail::add_cancellation_peers(*token.get_state(), {rank()});
+    {
+      qthread::lock_guard<qthread::mutex> g(registry.mtx);
+      EXPECT_EQ(1, registry.states.at(key).peers.size());
+    }
+  }
+  // A dropped token remembers its peers, and forwards requests to them
+  {
+    qthread::lock_guard<qthread::mutex> g(registry.mtx);
+    registry.prune_size = 0;
+    registry.prune();
+    EXPECT_FALSE(registry.states.count(key));
+    EXPECT_TRUE(registry.retired.count(key));
+  }
+  funhpc::detail::cancel_locally(-2, 1, -1);
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  EXPECT_FALSE(registry.retired.count(key));
+  EXPECT_TRUE(registry.is_cancelled(key));
+}
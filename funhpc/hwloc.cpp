@@ -1,5 +1,6 @@
 #include "hwloc.hpp"
 
+#include <adt/grid_decl.hpp>
 #include <cxx/cstdlib.hpp>
 #include <funhpc/rexec.hpp>
 #include <qthread/future.hpp>
@@ -7,10 +8,14 @@
 
 #include <cereal/types/string.hpp>
 #include <hwloc.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -19,6 +24,26 @@ namespace funhpc {
 
 namespace hwloc {
 
+// The topology is kept for the lifetime of the process, since it is
+// needed to place memory
+namespace {
+struct topology_t {
+  hwloc_topology_t topology;
+  topology_t() {
+    int ierr = hwloc_topology_init(&topology);
+    assert(!ierr);
+    ierr = hwloc_topology_load(topology);
+    assert(!ierr);
+  }
+  ~topology_t() { hwloc_topology_destroy(topology); }
+};
+
+hwloc_topology_t get_topology() {
+  static topology_t topology;
+  return topology.topology;
+}
+} // namespace
+
 // Thread layout (processes, threads)
 struct thread_layout {
   int proc, nprocs;               // MPI processes
@@ -85,93 +110,239 @@ struct thread_layout {
 };
 
 // Thread affinity
-struct thread_affinity {
-  int node_npus;
-  bool undersubscribing, oversubscribing;
-  int thread_pu, thread_npus;
 
-  bool invariant() const {
-    return (node_npus > 0) && (thread_pu >= 0 && thread_npus > 0 &&
-                               thread_pu + thread_npus <= node_npus);
+namespace {
+struct bitmap_deleter {
+  void operator()(hwloc_bitmap_t bitmap) const { hwloc_bitmap_free(bitmap); }
+};
+typedef std::unique_ptr<hwloc_bitmap_s, bitmap_deleter> bitmap_ptr;
+
+// The PUs that may be used, in logical order
+hwloc_const_cpuset_t get_available_cpuset(hwloc_topology_t topology) {
+  static bitmap_ptr cpuset = [&]() {
+    bitmap_ptr cpuset(
+        hwloc_bitmap_dup(hwloc_topology_get_allowed_cpuset(topology)));
+    assert(cpuset);
+    const auto restriction = cxx::envtostr("FUNHPC_CPUSET", "");
+    if (!restriction.empty()) {
+      bitmap_ptr restriction_cpuset(hwloc_bitmap_alloc());
+      assert(restriction_cpuset);
+      int ierr = hwloc_bitmap_list_sscanf(restriction_cpuset.get(),
+                                          restriction.c_str());
+      if (ierr) {
+        std::cerr << "Could not parse FUNHPC_CPUSET=\"" << restriction
+                  << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+      hwloc_bitmap_and(cpuset.get(), cpuset.get(), restriction_cpuset.get());
+    }
+    if (hwloc_bitmap_iszero(cpuset.get())) {
+      std::cerr << "FunHPC: no PUs available\n";
+      std::exit(EXIT_FAILURE);
+    }
+    return cpuset;
+  }();
+  return cpuset.get();
+}
+
+std::vector<hwloc_obj_t> get_available_pus(hwloc_topology_t topology) {
+  const hwloc_const_cpuset_t cpuset = get_available_cpuset(topology);
+  const int pu_depth = hwloc_get_type_or_below_depth(topology, HWLOC_OBJ_PU);
+  assert(pu_depth >= 0);
+  const int npus = hwloc_get_nbobjs_by_depth(topology, pu_depth);
+  std::vector<hwloc_obj_t> pus;
+  for (int pu = 0; pu < npus; ++pu) {
+    const hwloc_obj_t pu_obj = hwloc_get_obj_by_depth(topology, pu_depth, pu);
+    if (hwloc_bitmap_isset(cpuset, pu_obj->os_index))
+      pus.push_back(pu_obj);
   }
+  assert(!pus.empty());
+  return pus;
+}
 
-  thread_affinity(hwloc_topology_t topology, const thread_layout &tl) {
-    const int pu_depth = hwloc_get_type_or_below_depth(topology, HWLOC_OBJ_PU);
-    assert(pu_depth >= 0);
+// The available PUs, grouped by core. A PU without a core counts as
+// its own core.
+std::vector<std::vector<hwloc_obj_t>>
+get_available_cores(hwloc_topology_t topology) {
+  std::vector<std::vector<hwloc_obj_t>> cores;
+  hwloc_obj_t last_core_obj = nullptr;
+  for (const hwloc_obj_t pu_obj : get_available_pus(topology)) {
+    const hwloc_obj_t core_obj =
+        hwloc_get_ancestor_obj_by_type(topology, HWLOC_OBJ_CORE, pu_obj);
+    if (!core_obj || core_obj != last_core_obj)
+      cores.emplace_back();
+    cores.back().push_back(pu_obj);
+    last_core_obj = core_obj;
+  }
+  return cores;
+}
 
-    node_npus = hwloc_get_nbobjs_by_depth(topology, pu_depth);
-    assert(node_npus > 0);
+// Remove the cores reserved for the MPI threads, one per process, if
+// there are enough cores. Returns the core reserved for this process.
+std::vector<hwloc_obj_t>
+reserve_comm_core(std::vector<std::vector<hwloc_obj_t>> &cores,
+                  int node_proc, int node_nprocs) {
+  const int ncores = cores.size();
+  if (ncores <= node_nprocs)
+    return {};
+  auto comm_core = cores.at(ncores - node_nprocs + node_proc);
+  cores.resize(ncores - node_nprocs);
+  return comm_core;
+}
 
-    undersubscribing = tl.node_nthreads < node_npus;
-    oversubscribing = tl.node_nthreads > node_npus;
+bitmap_ptr make_cpuset(std::vector<hwloc_obj_t>::const_iterator begin,
+                       std::vector<hwloc_obj_t>::const_iterator end) {
+  bitmap_ptr cpuset(hwloc_bitmap_alloc());
+  assert(cpuset);
+  for (auto iter = begin; iter != end; ++iter)
+    hwloc_bitmap_or(cpuset.get(), cpuset.get(), (*iter)->cpuset);
+  return cpuset;
+}
 
-    thread_npus =
-        oversubscribing ? 1 : cxx::div_exact(node_npus, tl.node_nthreads).quot;
-    thread_pu =
-        oversubscribing
-            ? cxx::div_floor(tl.node_thread * node_npus, tl.node_nthreads).quot
-            : cxx::div_exact(tl.node_thread * node_npus, tl.node_nthreads).quot;
+const char *policy_name(affinity_policy policy) {
+  switch (policy) {
+  case affinity_policy::scatter:
+    return "scatter";
+  case affinity_policy::compact:
+    return "compact";
+  case affinity_policy::core:
+    return "core";
+  case affinity_policy::reserve:
+    return "reserve";
+  }
+  assert(0);
+  return nullptr;
+}
+} // namespace
+
+affinity_policy get_affinity_policy() {
+  const auto name = cxx::envtostr("FUNHPC_THREAD_AFFINITY", "scatter");
+  for (auto policy : {affinity_policy::scatter, affinity_policy::compact,
+                      affinity_policy::core, affinity_policy::reserve})
+    if (name == policy_name(policy))
+      return policy;
+  std::cerr << "Unknown FUNHPC_THREAD_AFFINITY=\"" << name
+            << "\"; expected scatter, compact, core, or reserve\n";
+  std::exit(EXIT_FAILURE);
+}
+
+struct thread_affinity {
+  affinity_policy policy;
+  int node_npus, node_ncores;
+  bool undersubscribing, oversubscribing;
+  bool comm_thread;  // this thread has the reserved core
+  bitmap_ptr cpuset; // PUs for this thread
+
+  bool invariant() const {
+    return (node_npus > 0) && (node_ncores > 0 && node_ncores <= node_npus) &&
+           cpuset && !hwloc_bitmap_iszero(cpuset.get());
+  }
+
+  thread_affinity(hwloc_topology_t topology, const thread_layout &tl,
+                  affinity_policy policy)
+      : policy(policy), comm_thread(false) {
+    auto cores = get_available_cores(topology);
+    affinity_policy layout = policy;
+    // The threads that are laid out
+    int node_thread = tl.node_thread;
+    int node_nthreads = tl.node_nthreads;
+    if (policy == affinity_policy::reserve) {
+      layout = affinity_policy::scatter;
+      // Worker 0 is the thread that runs the MPI event loop (see
+      // funhpc::eventloop). It gets the reserved core; the other
+      // workers are scattered over the remaining cores.
+      const auto comm_core =
+          tl.proc_nthreads > 1
+              ? reserve_comm_core(cores, tl.node_proc, tl.node_nprocs)
+              : std::vector<hwloc_obj_t>();
+      if (!comm_core.empty()) {
+        if (tl.proc_thread == 0)
+          layout = affinity_policy::reserve;
+        node_thread = tl.node_proc * (tl.proc_nthreads - 1) +
+                      std::max(0, tl.proc_thread - 1);
+        node_nthreads = tl.node_nprocs * (tl.proc_nthreads - 1);
+        cpuset = make_cpuset(comm_core.begin(), comm_core.end());
+      }
+    }
+    node_ncores = cores.size();
+
+    std::vector<hwloc_obj_t> pus;
+    for (const auto &core : cores)
+      pus.insert(pus.end(), core.begin(), core.end());
+    node_npus = pus.size();
+
+    undersubscribing = node_nthreads < node_npus;
+    oversubscribing = node_nthreads > node_npus;
+
+    switch (layout) {
+    case affinity_policy::scatter: {
+      // When undersubscribing, a thread is bound to all the PUs in its
+      // share
+      const int pu0 =
+          cxx::div_floor(node_thread * node_npus, node_nthreads).quot;
+      const int pu1 =
+          oversubscribing
+              ? pu0 + 1
+              : cxx::div_floor((node_thread + 1) * node_npus, node_nthreads)
+                    .quot;
+      cpuset = make_cpuset(pus.begin() + pu0, pus.begin() + pu1);
+      break;
+    }
+    case affinity_policy::compact: {
+      const int pu = node_thread % node_npus;
+      cpuset = make_cpuset(pus.begin() + pu, pus.begin() + pu + 1);
+      break;
+    }
+    case affinity_policy::core: {
+      const int ncores = cores.size();
+      const auto &core = cores.at(
+          cxx::div_floor(node_thread * ncores, node_nthreads).quot % ncores);
+      cpuset = make_cpuset(core.begin(), core.begin() + 1);
+      break;
+    }
+    case affinity_policy::reserve:
+      // The reserved core was selected above
+      comm_thread = true;
+      break;
+    default:
+      assert(0);
+    }
 
     const bool verbose = cxx::envtol("FUNHPC_VERBOSE", "0");
     if (verbose)
       if (tl.proc == 0 && tl.proc_thread == 0) {
         std::ostringstream os;
         os << "FunHPC thread affinity:\n";
+        os << "  policy: " << policy_name(policy) << "\n";
         os << "  node_npus: " << node_npus << "\n";
+        os << "  node_ncores: " << node_ncores << "\n";
         os << "  undersubscribing: " << undersubscribing << "\n";
         os << "  oversubscribing: " << oversubscribing << "\n";
-        os << "  thread_pu: " << thread_pu << " / " << thread_npus << "\n";
         std::cout << os.str() << std::flush;
       }
 
-    if (!oversubscribing) {
-      assert(cxx::div_floor(node_npus, tl.node_nthreads).rem == 0);
-      assert(cxx::div_floor(tl.node_thread * node_npus, tl.node_nthreads).rem ==
-             0);
-    }
     assert(invariant());
   }
 };
 
-std::string set_affinity(hwloc_topology_t topology, const thread_affinity &ta) {
-  // Note: Even when undersubscribing we are binding the thread to a single PU
-  const int pu_depth = hwloc_get_type_or_below_depth(topology, HWLOC_OBJ_PU);
-  assert(pu_depth >= 0);
-  const hwloc_obj_t pu_obj =
-      hwloc_get_obj_by_depth(topology, pu_depth, ta.thread_pu);
-  assert(pu_obj);
-  // const hwloc_cpuset_t cpuset = hwloc_bitmap_dup(pu_obj->cpuset);
-  const hwloc_cpuset_t cpuset = pu_obj->cpuset;
-
+std::string bind_thread(hwloc_topology_t topology,
+                        hwloc_const_cpuset_t cpuset) {
   int ierr = hwloc_set_cpubind(topology, cpuset,
                                HWLOC_CPUBIND_THREAD | HWLOC_CPUBIND_STRICT);
   if (ierr)
     ierr = hwloc_set_cpubind(topology, cpuset, HWLOC_CPUBIND_THREAD);
   if (ierr)
     return {" [cannot set CPU bindings]"};
-
-  // hwloc_bitmap_free(cpuset);
   return {};
 }
 
+std::string set_affinity(hwloc_topology_t topology, const thread_affinity &ta) {
+  return bind_thread(topology, ta.cpuset.get());
+}
+
 std::string unset_affinity(hwloc_topology_t topology,
                            const thread_affinity &ta) {
-  const int machine_depth =
-      hwloc_get_type_or_below_depth(topology, HWLOC_OBJ_MACHINE);
-  assert(machine_depth >= 0);
-  const hwloc_obj_t machine_obj =
-      hwloc_get_obj_by_depth(topology, machine_depth, 0);
-  assert(machine_obj);
-  const hwloc_cpuset_t cpuset = machine_obj->cpuset;
-
-  int ierr = hwloc_set_cpubind(topology, cpuset,
-                               HWLOC_CPUBIND_THREAD | HWLOC_CPUBIND_STRICT);
-  if (ierr)
-    ierr = hwloc_set_cpubind(topology, cpuset, HWLOC_CPUBIND_THREAD);
-  if (ierr)
-    return {" [cannot set CPU bindings]"};
-
-  return {};
+  return bind_thread(topology, get_available_cpuset(topology));
 }
 
 std::string get_affinity(hwloc_topology_t topology) {
@@ -211,49 +382,110 @@ std::string get_affinity(hwloc_topology_t topology) {
   return os.str();
 }
 
+// The domain (the index of the containing object of the given type,
+// e.g. a NUMA node) of the calling thread, determined from its CPU
+// binding
+int get_domain(hwloc_topology_t topology, hwloc_obj_type_t type) {
+  const hwloc_cpuset_t cpuset = hwloc_bitmap_alloc();
+  assert(cpuset);
+  int ierr = hwloc_get_cpubind(topology, cpuset, HWLOC_CPUBIND_THREAD);
+  int domain = -1;
+  if (!ierr) {
+    const int ndomains = hwloc_get_nbobjs_by_type(topology, type);
+    for (int d = 0; d < ndomains; ++d) {
+      const hwloc_obj_t obj = hwloc_get_obj_by_type(topology, type, d);
+      if (hwloc_bitmap_isincluded(cpuset, obj->cpuset)) {
+        domain = d;
+        break;
+      }
+    }
+  }
+  hwloc_bitmap_free(cpuset);
+  return domain;
+}
+
 struct cpu_info_t {
   int node, proc, nprocs, thread;
+  int shepherd, domain, locality;
   std::string msg;
 
   template <typename Archive> void serialize(Archive &ar) {
-    ar(node, proc, nprocs, thread, msg);
+    ar(node, proc, nprocs, thread, shepherd, domain, locality, msg);
   }
 };
 
-cpu_info_t manage_affinity(hwloc_topology_t topology, bool do_set_affinity,
-                           bool do_unset_affinity) {
+// The objects that define the locality domains for qthread::async_on
+hwloc_obj_type_t get_locality_type() {
+  const auto name = cxx::envtostr("FUNHPC_LOCALITY_DOMAIN", "numa");
+  if (name == "numa")
+    return HWLOC_OBJ_NUMANODE;
+  if (name == "l3")
+    return HWLOC_OBJ_L3CACHE;
+  std::cerr << "Unknown FUNHPC_LOCALITY_DOMAIN=\"" << name
+            << "\"; expected numa or l3\n";
+  std::exit(EXIT_FAILURE);
+}
+
+// Grid tiling is off by default, since it has not been faster in
+// benchmarks (see examples/grid_tiling.cpp). FUNHPC_GRID_TILE_BYTES
+// enables it; "l2" uses half of the L2 cache, leaving room for the
+// grids that are read.
+void set_grid_tile_bytes(hwloc_topology_t topology) {
+  const char *const env = std::getenv("FUNHPC_GRID_TILE_BYTES");
+  if (!env || !*env)
+    return;
+  if (std::string(env) == "l2") {
+    const hwloc_obj_t l2_obj =
+        hwloc_get_obj_by_type(topology, HWLOC_OBJ_L2CACHE, 0);
+    if (l2_obj && l2_obj->attr && l2_obj->attr->cache.size > 0)
+      adt::set_grid_tile_bytes(l2_obj->attr->cache.size / 2);
+    return;
+  }
+  adt::set_grid_tile_bytes(cxx::envtol("FUNHPC_GRID_TILE_BYTES"));
+}
+
+cpu_info_t manage_affinity(hwloc_topology_t topology, affinity_policy policy,
+                           hwloc_obj_type_t locality_type,
+                           bool do_set_affinity, bool do_unset_affinity) {
   thread_layout tl;
-  thread_affinity ta(topology, tl);
+  thread_affinity ta(topology, tl, policy);
   const auto set_msg = do_set_affinity ? set_affinity(topology, ta) : "";
   const auto unset_msg = do_unset_affinity ? unset_affinity(topology, ta) : "";
   const auto get_msg = get_affinity(topology);
+  const int shepherd = qthread_shep();
+  const int domain = get_domain(topology, HWLOC_OBJ_NUMANODE);
+  const int locality = get_domain(topology, locality_type);
 
   std::ostringstream os;
   os << "FunHPC[" << rank() << "]: "
      << "N" << tl.node << " "
      << "L" << tl.node_proc << " "
      << "P" << tl.proc << " "
-     << "(S" << qthread_shep() << ") "
-     << "T" << tl.proc_thread << set_msg << get_msg;
+     << "(S" << shepherd << ") "
+     << "T" << tl.proc_thread << (ta.comm_thread ? " (MPI)" : "") << set_msg
+     << get_msg << " NUMA " << domain;
 
-  return cpu_info_t{tl.node, tl.node_proc, tl.node_nprocs, tl.proc_thread,
-                    os.str()};
+  return cpu_info_t{tl.node,   tl.node_proc, tl.node_nprocs, tl.proc_thread,
+                    shepherd, domain,       locality,       os.str()};
 }
 
 std::vector<cpu_info_t> cpu_infos;
+// The NUMA nodes of each locality domain
+std::vector<bitmap_ptr> domain_nodesets;
 
 // This routine is called on each process
 void set_all_cpu_affinities() {
+  set_all_cpu_affinities(get_affinity_policy());
+}
+
+void set_all_cpu_affinities(affinity_policy policy) {
   const bool set_thread_bindings =
       cxx::envtol("FUNHPC_SET_THREAD_BINDINGS", "1");
   const bool unset_thread_bindings =
       cxx::envtol("FUNHPC_UNSET_THREAD_BINDINGS", "0");
 
-  hwloc_topology_t topology;
-  int ierr = hwloc_topology_init(&topology);
-  assert(!ierr);
-  ierr = hwloc_topology_load(topology);
-  assert(!ierr);
+  const hwloc_topology_t topology = get_topology();
+  const hwloc_obj_type_t locality_type = get_locality_type();
 
   const int nthreads = qthread::thread::hardware_concurrency();
   cpu_infos.resize(nthreads);
@@ -261,10 +493,43 @@ void set_all_cpu_affinities() {
   qthread::all_threads::run([&]() {
     const int thread = qthread::this_thread::get_worker_id();
     cpu_infos.at(thread) =
-        manage_affinity(topology, set_thread_bindings, unset_thread_bindings);
+        manage_affinity(topology, policy, locality_type, set_thread_bindings,
+                        unset_thread_bindings);
   });
 
-  hwloc_topology_destroy(topology);
+  // Group the shepherds into locality domains, numbering the domains
+  // consecutively. Unbound threads end up in a single domain.
+  std::vector<int> shepherd_localities(qthread_num_shepherds(), -1);
+  std::vector<bool> have_shepherd(qthread_num_shepherds(), false);
+  for (const auto &cpu_info : cpu_infos)
+    if (!have_shepherd.at(cpu_info.shepherd)) {
+      have_shepherd.at(cpu_info.shepherd) = true;
+      shepherd_localities.at(cpu_info.shepherd) = cpu_info.locality;
+    }
+  std::vector<int> localities = shepherd_localities;
+  std::sort(localities.begin(), localities.end());
+  localities.erase(std::unique(localities.begin(), localities.end()),
+                   localities.end());
+  for (auto &locality : shepherd_localities)
+    locality = std::lower_bound(localities.begin(), localities.end(),
+                                locality) -
+               localities.begin();
+  qthread::set_shepherd_domains(shepherd_localities);
+
+  // Memory of an unbound domain may lie anywhere
+  domain_nodesets.clear();
+  for (const int locality : localities) {
+    const hwloc_obj_t obj =
+        locality < 0 ? nullptr
+                     : hwloc_get_obj_by_type(topology, locality_type, locality);
+    const hwloc_const_nodeset_t nodeset =
+        obj && obj->nodeset ? obj->nodeset
+                            : hwloc_get_root_obj(topology)->nodeset;
+    domain_nodesets.emplace_back(hwloc_bitmap_dup(nodeset));
+  }
+  qthread::set_memory_binder(bind_memory);
+
+  set_grid_tile_bytes(topology);
 }
 
 std::string get_all_cpu_infos() {
@@ -273,5 +538,50 @@ std::string get_all_cpu_infos() {
     os << cpu_info.msg << "\n";
   return os.str();
 }
+
+int domain_of(const void *ptr, std::size_t size) {
+  const hwloc_topology_t topology = get_topology();
+  const bitmap_ptr nodeset(hwloc_bitmap_alloc());
+  assert(nodeset);
+  int ierr = hwloc_get_area_memlocation(topology, ptr, size, nodeset.get(),
+                                        HWLOC_MEMBIND_BYNODESET);
+  if (ierr || hwloc_bitmap_iszero(nodeset.get()))
+    return -1;
+  // Prefer a domain with exactly these nodes over a larger one
+  for (std::size_t d = 0; d < domain_nodesets.size(); ++d)
+    if (hwloc_bitmap_isequal(nodeset.get(), domain_nodesets[d].get()))
+      return d;
+  for (std::size_t d = 0; d < domain_nodesets.size(); ++d)
+    if (hwloc_bitmap_isincluded(nodeset.get(), domain_nodesets[d].get()))
+      return d;
+  return -1;
+}
+
+bool bind_memory(const void *ptr, std::size_t size, int domain) {
+  if (domain < 0 || domain >= int(domain_nodesets.size()))
+    return false;
+  // The kernel binds whole pages
+  const std::uintptr_t pagesize = sysconf(_SC_PAGESIZE);
+  const std::uintptr_t begin =
+      (std::uintptr_t(ptr) + pagesize - 1) / pagesize * pagesize;
+  const std::uintptr_t end = (std::uintptr_t(ptr) + size) / pagesize * pagesize;
+  if (begin >= end)
+    return true;
+  const hwloc_topology_t topology = get_topology();
+  // Leave the region alone if its pages are already there, which is
+  // the common case when they were first touched in the domain
+  const bitmap_ptr nodeset(hwloc_bitmap_alloc());
+  assert(nodeset);
+  if (!hwloc_get_area_memlocation(topology, (const void *)begin, end - begin,
+                                  nodeset.get(), HWLOC_MEMBIND_BYNODESET) &&
+      !hwloc_bitmap_iszero(nodeset.get()) &&
+      hwloc_bitmap_isincluded(nodeset.get(), domain_nodesets[domain].get()))
+    return true;
+  int ierr = hwloc_set_area_membind(
+      topology, (const void *)begin, end - begin,
+      domain_nodesets[domain].get(), HWLOC_MEMBIND_BIND,
+      HWLOC_MEMBIND_MIGRATE | HWLOC_MEMBIND_BYNODESET);
+  return !ierr;
+}
 } // namespace hwloc
 } // namespace funhpc
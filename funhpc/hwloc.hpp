@@ -1,12 +1,71 @@
 #ifndef FUNHPC_HWLOC_HPP
 #define FUNHPC_HWLOC_HPP
 
+#include <cxx/invoke.hpp>
+#include <qthread/future.hpp>
+#include <qthread/thread.hpp>
+
+#include <cstddef>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 namespace funhpc {
 namespace hwloc {
+
+// Thread affinity
+
+// How worker threads are bound to PUs (processing units, i.e.
+// hardware threads). The policy is chosen by FUNHPC_THREAD_AFFINITY.
+enum class affinity_policy {
+  scatter, // spread threads evenly over all PUs (default)
+  compact, // bind threads to consecutive PUs
+  core,    // bind threads to one PU per core, skipping SMT siblings
+  reserve, // scatter, except for worker 0 (which runs the MPI event
+           // loop); it gets a core per process to itself
+};
+affinity_policy get_affinity_policy();
+
+// Only PUs in the allowed cpuset are used (e.g. as restricted by the
+// batch system), further restricted by FUNHPC_CPUSET if set (a list
+// of OS PU indices such as "0-7,16-23"). This also sets the tile
+// size for grid stencils (see adt::set_grid_tile_bytes) if
+// FUNHPC_GRID_TILE_BYTES is set (a size in bytes, or "l2" for half of
+// the L2 cache).
 void set_all_cpu_affinities();
+void set_all_cpu_affinities(affinity_policy policy);
 std::string get_all_cpu_infos();
+
+// Memory placement
+
+// Memory is placed in the locality domains of qthread::async_on (see
+// FUNHPC_LOCALITY_DOMAIN); set_all_cpu_affinities installs
+// bind_memory as qthread's memory binder.
+
+// The domain holding a memory region, or -1 if it is spread out or
+// not yet touched. If several domains share a NUMA node (e.g. L3
+// domains), the first of them is returned.
+int domain_of(const void *ptr, std::size_t size = 1);
+// Move a memory region to a domain; returns false if this failed.
+// Pages allocated later in the region are also placed there. Only
+// pages lying entirely in the region are moved, and a region whose
+// pages are all in the domain already is left alone.
+bool bind_memory(const void *ptr, std::size_t size, int domain);
+
+// Run a function on a worker in the domain holding ptr, so that its
+// memory accesses are local (e.g. when updating a block of data).
+// Falls back to any worker if the domain is not known.
+template <typename F, typename... Args,
+          typename R = std::decay_t<
+              cxx::invoke_of_t<std::decay_t<F>, std::decay_t<Args>...>>>
+qthread::future<R> async_near(const void *ptr, F &&f, Args &&... args) {
+  const int domain = domain_of(ptr);
+  if (domain < 0)
+    return qthread::async(qthread::launch::async, std::forward<F>(f),
+                          std::forward<Args>(args)...);
+  return qthread::async_on(domain, std::forward<F>(f),
+                           std::forward<Args>(args)...);
+}
 } // namespace hwloc
 } // namespace funhpc
 
@@ -0,0 +1,61 @@
+#include <funhpc/hwloc.hpp>
+#include <qthread/future.hpp>
+#include <qthread/thread.hpp>
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace funhpc;
+
+namespace {
+// A few pages inside a buffer
+struct pages_t {
+  std::vector<char> buf;
+  char *ptr;
+  std::size_t size;
+  explicit pages_t(std::size_t npages) {
+    const std::size_t pagesize = sysconf(_SC_PAGESIZE);
+    buf.resize((npages + 1) * pagesize);
+    // Touch the pages so that they are allocated
+    for (std::size_t i = 0; i < buf.size(); i += pagesize)
+      buf[i] = 1;
+    ptr = (char *)((std::uintptr_t(buf.data()) + pagesize - 1) / pagesize *
+                   pagesize);
+    size = npages * pagesize;
+  }
+};
+} // namespace
+
+TEST(funhpc_hwloc, bind_memory) {
+  pages_t pages(4);
+  EXPECT_GE(hwloc::domain_of(pages.ptr, pages.size), 0);
+  for (int domain = 0; domain < qthread::num_domains(); ++domain) {
+    EXPECT_TRUE(hwloc::bind_memory(pages.ptr, pages.size, domain));
+    EXPECT_EQ(domain, hwloc::domain_of(pages.ptr, pages.size));
+    // Pages that are already there are left alone
+    EXPECT_TRUE(hwloc::bind_memory(pages.ptr, pages.size, domain));
+    EXPECT_EQ(domain, hwloc::domain_of(pages.ptr, pages.size));
+    // The qthread binder takes the domain modulo the number of domains
+    EXPECT_TRUE(qthread::bind_memory(pages.buf.data(), pages.buf.size(),
+                                     domain + qthread::num_domains()));
+    EXPECT_EQ(domain, hwloc::domain_of(pages.ptr, pages.size));
+  }
+  EXPECT_FALSE(hwloc::bind_memory(pages.ptr, pages.size, -1));
+  // Regions without a whole page are not bound
+  EXPECT_TRUE(hwloc::bind_memory(pages.ptr + 1, 1, 0));
+}
+
+TEST(funhpc_hwloc, async_near) {
+  pages_t pages(1);
+  for (int domain = 0; domain < qthread::num_domains(); ++domain) {
+    EXPECT_TRUE(hwloc::bind_memory(pages.ptr, pages.size, domain));
+    EXPECT_EQ(domain, hwloc::async_near(pages.ptr, []() {
+                        return qthread::this_thread::get_domain();
+                      }).get());
+  }
+}
@@ -0,0 +1,102 @@
+#include "proxy.hpp"
+
+#include <cxx/cstdlib.hpp>
+#include <qthread/mutex.hpp>
+
+#include <list>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace funhpc {
+namespace detail {
+
+namespace {
+struct cache_item_t {
+  proxy_cache_key_t key;
+  std::shared_ptr<void> entry;
+  std::size_t size;
+};
+
+struct proxy_cache_t {
+  qthread::mutex mtx;
+  // Most recently used items first
+  std::list<cache_item_t> items;
+  std::map<proxy_cache_key_t, std::list<cache_item_t>::iterator> index;
+  std::size_t total_size{0};
+  std::size_t max_size;
+
+  proxy_cache_t()
+      : max_size(cxx::envtol("FUNHPC_PROXY_CACHE_SIZE", "268435456")) {}
+
+  void evict() {
+    while (total_size > max_size && !items.empty()) {
+      auto &item = items.back();
+      total_size -= item.size;
+      index.erase(item.key);
+      items.pop_back();
+    }
+  }
+};
+
+proxy_cache_t &get_proxy_cache() {
+  static proxy_cache_t cache;
+  return cache;
+}
+} // namespace
+
+bool operator<(const proxy_cache_key_t &lhs, const proxy_cache_key_t &rhs) {
+  return std::make_tuple(lhs.proc, lhs.addr, lhs.type) <
+         std::make_tuple(rhs.proc, rhs.addr, rhs.type);
+}
+
+std::shared_ptr<void> proxy_cache_lookup_or_insert(
+    const proxy_cache_key_t &key,
+    const std::function<std::shared_ptr<void>()> &make) {
+  auto &cache = get_proxy_cache();
+  if (cache.max_size == 0)
+    return make();
+  qthread::lock_guard<qthread::mutex> g(cache.mtx);
+  auto i = cache.index.find(key);
+  if (i != cache.index.end()) {
+    // Mark as most recently used
+    cache.items.splice(cache.items.begin(), cache.items, i->second);
+    return i->second->entry;
+  }
+  // The entry is created while holding the lock, so that there is at
+  // most one fetch in flight per object
+  auto entry = make();
+  cache.items.push_front({key, entry, 0});
+  cache.index[key] = cache.items.begin();
+  return entry;
+}
+
+void proxy_cache_set_size(const proxy_cache_key_t &key,
+                          const std::shared_ptr<void> &entry,
+                          std::size_t size) {
+  auto &cache = get_proxy_cache();
+  qthread::lock_guard<qthread::mutex> g(cache.mtx);
+  auto i = cache.index.find(key);
+  // The entry may have been evicted already
+  if (i == cache.index.end() || i->second->entry != entry)
+    return;
+  cache.total_size += size - i->second->size;
+  i->second->size = size;
+  cache.evict();
+}
+
+void proxy_cache_clear() {
+  auto &cache = get_proxy_cache();
+  std::list<cache_item_t> items;
+  {
+    qthread::lock_guard<qthread::mutex> g(cache.mtx);
+    using std::swap;
+    swap(items, cache.items);
+    cache.index.clear();
+    cache.total_size = 0;
+  }
+  // The references are released outside the lock
+  items.clear();
+}
+} // namespace detail
+} // namespace funhpc
@@ -12,8 +12,12 @@
 #include <cereal/access.hpp>
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <type_traits>
+#include <typeindex>
+#include <typeinfo>
 #include <utility>
 
 namespace funhpc {
@@ -31,6 +35,9 @@ namespace detail {
 template <typename T>
 proxy<T> make_proxy_with_proc(std::ptrdiff_t proc,
                               qthread::future<proxy<T>> &&fptr);
+template <typename T> proxy<T> proxy_migrate_here(const proxy<T> &old);
+template <typename T>
+std::shared_ptr<T> proxy_get_shared_ptr(const proxy<T> &rptr);
 }
 
 template <typename T> class proxy {
@@ -172,6 +179,8 @@ public:
   }
 
 private:
+  friend proxy detail::proxy_migrate_here<T>(const proxy &old);
+  friend std::shared_ptr<T> detail::proxy_get_shared_ptr<T>(const proxy &rptr);
   friend proxy detail::make_proxy_with_proc<T>(std::ptrdiff_t proc,
                                                qthread::future<proxy> &&fptr);
 
@@ -292,11 +301,11 @@ public:
   }
   void reset() { *this = proxy(); }
 
+  // Note: proc may be outdated if the object has migrated
   bool invariant() const noexcept {
     if (!bool(*this))
       return !robj.valid() && proc < 0;
-    return robj.valid() &&
-           (proc >= 0 && robj.ready() ? proc == robj.get().get_proc() : true);
+    return robj.valid();
   }
 
   operator bool() const noexcept { return robj.valid(); }
@@ -311,14 +320,15 @@ public:
   }
   std::ptrdiff_t get_proc() const {
     cxx_assert(bool(*this));
-    if (proc >= 0)
+    // Once the object is ready, ask it, since it may have migrated
+    if (proc >= 0 && !ready())
       return proc;
     return proc = robj.get().get_proc();
   }
   qthread::future<std::ptrdiff_t> get_proc_future() const {
     cxx_assert(bool(*this));
     if (proc_ready())
-      return qthread::make_ready_future(proc);
+      return qthread::make_ready_future(get_proc());
     return qthread::async(
         [robj = this->robj]() { return robj.get().get_proc(); });
   }
@@ -338,10 +348,9 @@ public:
       proc = robj.get().get_proc();
   }
 
-  const std::shared_ptr<T> &get_shared_ptr() const {
-    static const std::shared_ptr<T> null;
+  std::shared_ptr<T> get_shared_ptr() const {
     if (!bool(*this))
-      return null;
+      return nullptr;
     cxx_assert(local());
     return robj.get().get_shared_ptr();
   }
@@ -353,7 +362,7 @@ public:
     cxx_assert(bool(*this));
     return *get_shared_ptr();
   }
-  const std::shared_ptr<T> &operator->() const { return get_shared_ptr(); }
+  std::shared_ptr<T> operator->() const { return get_shared_ptr(); }
 
   template <typename U = T,
             std::enable_if_t<std::is_same<U, T>::value &&
@@ -362,9 +371,16 @@ public:
     return proxy<typename U::element_type>(*this);
   }
 
-  // TODO: Split this into local_copy() and cache()
+  // Remote objects are cached (see proxy_cache below)
   // TODO: Add optional policy argument (e.g. deferred)
   proxy make_local() const;
+  // Start copying a remote object into the cache, without waiting
+  void prefetch() const;
+
+  // Move the object to process dest. Existing references forward to
+  // the new location. The object must not be accessed on its old
+  // process while it migrates.
+  proxy migrate(std::ptrdiff_t dest) const;
 
   bool operator==(const proxy &other) const {
     auto nt = bool(*this), no = bool(other);
@@ -456,7 +472,11 @@ proxy<R> remote(qthread::future<std::ptrdiff_t> &&fdest, F &&f,
 namespace detail {
 template <typename T>
 std::shared_ptr<T> proxy_get_shared_ptr(const proxy<T> &rptr) {
-  return rptr.get_shared_ptr();
+  if (rptr.local())
+    if (auto obj = rptr.get_shared_ptr())
+      return obj;
+  // The object may have migrated since the request was sent
+  return make_local_shared_ptr(rptr.robj.get()).get();
 }
 } // namespace detail
 
@@ -480,9 +500,124 @@ make_local_shared_ptr(const proxy<T> &rptr) {
   });
 }
 
+// proxy_cache /////////////////////////////////////////////////////////////////
+
+// Each process caches local copies of remote objects. Objects are
+// immutable, so that cached copies never become stale. Concurrent
+// requests for the same object share a single fetch. The least
+// recently used copies are evicted when the cache exceeds
+// FUNHPC_PROXY_CACHE_SIZE bytes (setting this to 0 disables caching).
+//
+// A cache entry holds a reference to the remote object, so that its
+// address cannot be reused while the entry exists.
+
+namespace detail {
+struct proxy_cache_key_t {
+  std::ptrdiff_t proc;
+  std::uintptr_t addr;
+  std::type_index type;
+};
+bool operator<(const proxy_cache_key_t &lhs, const proxy_cache_key_t &rhs);
+
+std::shared_ptr<void> proxy_cache_lookup_or_insert(
+    const proxy_cache_key_t &key,
+    const std::function<std::shared_ptr<void>()> &make);
+void proxy_cache_set_size(const proxy_cache_key_t &key,
+                          const std::shared_ptr<void> &entry,
+                          std::size_t size);
+// Drop all entries; called by the eventloop before it shuts down
+void proxy_cache_clear();
+
+// Estimate the memory used by an object
+template <typename T, typename = void> struct cache_size_of {
+  static std::size_t size(const T &) { return sizeof(T); }
+};
+template <typename T>
+struct cache_size_of<T, decltype(void(std::declval<const T &>().size()),
+                                 void(sizeof(typename T::value_type)))> {
+  static std::size_t size(const T &x) {
+    return sizeof(T) + x.size() * sizeof(typename T::value_type);
+  }
+};
+
+template <typename T> struct proxy_cache_entry_t {
+  shared_rptr<T> ptr;
+  qthread::shared_future<std::shared_ptr<T>> fobj;
+};
+
+template <typename T>
+qthread::shared_future<std::shared_ptr<T>>
+cached_local_shared_ptr(const shared_rptr<T> &ptr) {
+  typedef proxy_cache_entry_t<T> entry_t;
+  proxy_cache_key_t key{ptr.get_proc(), ptr.get_rptr().get_address(),
+                        std::type_index(typeid(T))};
+  bool created = false;
+  auto make = [&]() {
+    auto entry = std::make_shared<entry_t>();
+    entry->ptr = ptr;
+    entry->fobj = make_local_shared_ptr(ptr).share();
+    created = true;
+    return std::shared_ptr<void>(entry);
+  };
+  auto entry = std::static_pointer_cast<entry_t>(
+      proxy_cache_lookup_or_insert(key, make));
+  if (created)
+    qthread::async(qthread::launch::detached, [key, entry]() {
+      auto size = cache_size_of<T>::size(*entry->fobj.get());
+      proxy_cache_set_size(key, entry, size);
+    });
+  return entry->fobj;
+}
+} // namespace detail
+
 template <typename T> proxy<T> proxy<T>::make_local() const {
   cxx_assert(bool(*this));
-  return proxy(make_local_shared_ptr(*this));
+  if (!ready())
+    return proxy(qthread::async([self = *this]() {
+      self.wait();
+      return self.make_local();
+    }));
+  if (local())
+    return *this;
+  return proxy(detail::cached_local_shared_ptr(robj.get()));
+}
+
+template <typename T> void proxy<T>::prefetch() const {
+  cxx_assert(bool(*this));
+  if (!ready()) {
+    qthread::async(qthread::launch::detached, [self = *this]() {
+      self.wait();
+      self.prefetch();
+    });
+    return;
+  }
+  if (local())
+    return;
+  detail::cached_local_shared_ptr(robj.get());
+}
+
+// migrate /////////////////////////////////////////////////////////////////////
+
+namespace detail {
+// Called on the destination process
+template <typename T> proxy<T> proxy_migrate_here(const proxy<T> &old) {
+  auto oldptr = old.robj.get();
+  if (oldptr.local())
+    return old;
+  auto obj = cached_local_shared_ptr(oldptr).get();
+  shared_rptr<T> newptr(obj);
+  async(rlaunch::sync, oldptr.get_proc(), shared_rptr_migrate<T>, oldptr,
+        newptr);
+  return proxy<T>(std::move(newptr));
+}
+} // namespace detail
+
+template <typename T> proxy<T> proxy<T>::migrate(std::ptrdiff_t dest) const {
+  cxx_assert(bool(*this));
+  if (proc_ready() && get_proc() == dest)
+    return *this;
+  return detail::make_proxy_with_proc(
+      dest, async(rlaunch::async, dest, detail::proxy_migrate_here<T>, *this));
 }
 } // namespace funhpc
 
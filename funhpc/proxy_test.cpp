@@ -140,3 +140,64 @@ TEST(funhpc_proxy, nested) {
   auto i = async(rlaunch::sync, 1 % size(), getvalue, all_p1).get();
   EXPECT_EQ(5, i);
 }
+
+TEST(funhpc_proxy, cache) {
+  auto p = make_remote_proxy<int>(1 % size(), 1);
+  auto pl1 = p.make_local();
+  auto pl2 = p.make_local();
+  EXPECT_EQ(1, *pl1);
+  EXPECT_EQ(1, *pl2);
+  // Remote objects are fetched only once
+  EXPECT_EQ(pl1.get_shared_ptr(), pl2.get_shared_ptr());
+}
+
+namespace {
+int get_value(const proxy<int> &p) { return *p.make_local(); }
+}
+
+TEST(funhpc_proxy, migrate) {
+  auto p = make_local_proxy<int>(1);
+  auto dest = 1 % size();
+  auto pm = p.migrate(dest);
+  EXPECT_EQ(dest, pm.get_proc_future().get());
+  EXPECT_EQ(1, *pm.make_local());
+  // Existing references forward to the new location
+  EXPECT_EQ(dest, p.get_proc());
+  EXPECT_EQ(1, async(rlaunch::sync, dest, get_value, p).get());
+  EXPECT_EQ(1, *p.make_local());
+  // Migrate back
+  auto pb = p.migrate(0);
+  EXPECT_EQ(0, pb.get_proc());
+  EXPECT_TRUE(pb.local());
+  EXPECT_EQ(1, *pb);
+}
+
+namespace {
+// Called on a process that holds a reference from before the migration
+void check_redirect(const proxy<int> &p, std::ptrdiff_t dest) {
+  auto pm = p.migrate(dest);
+  EXPECT_EQ(dest, pm.get_proc_future().get());
+  // The first fetch goes via the old owner, which tells us the new one
+  EXPECT_EQ(1, *p.make_local());
+  EXPECT_EQ(dest, p.get_proc());
+  EXPECT_EQ(1, *p.make_local());
+}
+} // namespace
+
+TEST(funhpc_proxy, migrate_redirect) {
+  auto p = make_local_proxy<int>(1);
+  auto dest = size() > 2 ? 2 : 1 % size();
+  async(rlaunch::sync, 1 % size(), check_redirect, p, dest).get();
+  EXPECT_EQ(dest, p.get_proc());
+  EXPECT_EQ(1, *p.make_local());
+}
+
+TEST(funhpc_proxy, prefetch) {
+  auto p = make_remote_proxy<int>(1 % size(), 1);
+  p.prefetch();
+  auto pl = p.make_local();
+  EXPECT_TRUE(pl.local());
+  EXPECT_EQ(1, *pl);
+  // The prefetched copy is used
+  EXPECT_EQ(pl.get_shared_ptr(), p.make_local().get_shared_ptr());
+}
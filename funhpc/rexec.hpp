@@ -4,7 +4,11 @@
 #include <cxx/task.hpp>
 #include <qthread/thread.hpp>
 
+#include <cstdint>
+#include <numeric>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace funhpc {
 namespace detail {
@@ -27,6 +31,36 @@ inline std::ptrdiff_t node_size() { return detail::the_node_size; }
 
 typedef cxx::task<void> task_t;
 void enqueue_task(std::ptrdiff_t dest, task_t &&t);
+// The destinations must be distinct. If done is given, it is set (and
+// deleted) when the task has finished on all destinations.
+void enqueue_broadcast(const std::vector<std::ptrdiff_t> &dests, task_t &&t,
+                       qthread::promise<void> *done);
+// Add a task to this process' work pool, from where it may be stolen
+// by other processes
+void enqueue_anywhere(task_t &&t);
+
+namespace detail {
+// A broadcast serializes its task once, and the result is deserialized
+// once on each destination. Types whose serialization hands out
+// ownership (such as the reference weight of a shared_rptr) need to
+// hand out this many shares. This is 1 except while enqueue_broadcast
+// serializes a task.
+std::ptrdiff_t archive_multiplicity(const void *ar);
+// The other processes that an archive is sent to. These are known for
+// the archives of enqueue_task, enqueue_broadcast, and of stolen
+// tasks; for all other archives, these are all other processes.
+std::vector<std::ptrdiff_t> archive_destinations(const void *ar);
+
+// Replies to remote async calls: register a promise (with a function
+// that sets it from a serialized value), and later send the value
+typedef void reply_setter_t(void *pres, std::string &&payload);
+std::uint64_t register_reply(reply_setter_t *set, void *pres);
+void enqueue_reply(std::ptrdiff_t dest, std::uint64_t id,
+                   std::string &&payload);
+
+// Choose a lightly loaded process, based on gossiped load estimates
+std::ptrdiff_t least_loaded_proc(bool prefer_local);
+} // namespace detail
 
 // Remote execution
 template <typename F, typename... Args>
@@ -37,6 +71,28 @@ void rexec(std::ptrdiff_t dest, F &&f, Args &&... args) {
   task_t::register_type<std::decay_t<F>, std::decay_t<Args>...>();
   enqueue_task(dest, task_t(std::forward<F>(f), std::forward<Args>(args)...));
 }
+
+// Remote execution on a set of distinct processes. The task is
+// serialized only once, and is forwarded along a binomial tree.
+template <typename F, typename... Args>
+void rexec_set(const std::vector<std::ptrdiff_t> &dests, F &&f,
+               Args &&... args) {
+  if (dests.empty())
+    return;
+  if (dests.size() == 1)
+    return rexec(dests[0], std::forward<F>(f), std::forward<Args>(args)...);
+  task_t::register_type<std::decay_t<F>, std::decay_t<Args>...>();
+  enqueue_broadcast(dests,
+                    task_t(std::forward<F>(f), std::forward<Args>(args)...),
+                    nullptr);
+}
+
+// Remote execution on all processes
+template <typename F, typename... Args> void rexec_all(F &&f, Args &&... args) {
+  std::vector<std::ptrdiff_t> dests(size());
+  std::iota(dests.begin(), dests.end(), 0);
+  rexec_set(dests, std::forward<F>(f), std::forward<Args>(args)...);
+}
 } // namespace funhpc
 
 #define FUNHPC_REXEC_HPP_DONE
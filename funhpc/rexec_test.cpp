@@ -4,6 +4,7 @@
 #include <cereal/access.hpp>
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <memory>
 
 namespace {
@@ -95,3 +96,22 @@ TEST(funhpc_rexec, daisy_chaining) {
   p->get_future().wait();
   p.reset();
 }
+
+namespace {
+std::unique_ptr<std::atomic<std::ptrdiff_t>> count;
+void count_one() {
+  if (++*count == funhpc::size())
+    p->set_value();
+}
+void count_remote() { funhpc::rexec(0, count_one); }
+} // namespace
+
+TEST(funhpc_rexec, rexec_all) {
+  p = std::make_unique<qthread::promise<void>>();
+  count = std::make_unique<std::atomic<std::ptrdiff_t>>(0);
+  funhpc::rexec_all(count_remote);
+  p->get_future().wait();
+  EXPECT_EQ(funhpc::size(), *count);
+  count.reset();
+  p.reset();
+}
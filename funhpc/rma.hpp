@@ -0,0 +1,114 @@
+#ifndef FUNHPC_RMA_HPP
+#define FUNHPC_RMA_HPP
+
+#include <cxx/cassert.hpp>
+#include <funhpc/rexec.hpp>
+#include <funhpc/rptr.hpp>
+#include <qthread/future.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace funhpc {
+
+// One-sided access ////////////////////////////////////////////////////////////
+
+// Objects created with make_rma_rptr can be read and written from any
+// process with get and put, without running a task on the owning
+// process. This is only possible for trivially copyable types.
+//
+// Concurrent puts (or a put concurrent with a get) to the same object
+// are a data race, as for local objects.
+
+namespace detail {
+typedef void rma_complete_t(void *arg);
+// Make memory accessible for one-sided communication
+void rma_attach(void *ptr, std::size_t size);
+void rma_detach(void *ptr);
+// Start a one-sided transfer; complete(arg) is called (on the MPI
+// thread) when the transfer has finished. The buffer must remain valid
+// until then.
+void rma_get(void *buf, std::size_t size, std::ptrdiff_t proc,
+             std::uintptr_t addr, rma_complete_t *complete, void *arg);
+void rma_put(const void *buf, std::size_t size, std::ptrdiff_t proc,
+             std::uintptr_t addr, rma_complete_t *complete, void *arg);
+
+template <typename T> struct rma_get_op {
+  std::aligned_storage_t<sizeof(T), alignof(T)> buf;
+  qthread::promise<T> pres;
+
+  static void complete(void *arg) {
+    auto op = static_cast<rma_get_op *>(arg);
+    op->pres.set_value(*reinterpret_cast<const T *>(&op->buf));
+    delete op;
+  }
+};
+
+template <typename T> struct rma_put_op {
+  std::aligned_storage_t<sizeof(T), alignof(T)> buf;
+  qthread::promise<void> pres;
+
+  static void complete(void *arg) {
+    auto op = static_cast<rma_put_op *>(arg);
+    op->pres.set_value();
+    delete op;
+  }
+};
+} // namespace detail
+
+template <typename T, typename... Args>
+rptr<T> make_rma_rptr(Args &&... args) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "One-sided access requires trivially copyable types");
+  auto ptr = new T(std::forward<Args>(args)...);
+  detail::rma_attach(ptr, sizeof(T));
+  return rptr<T>(ptr);
+}
+
+// This must be called on the owning process, after all outstanding
+// get and put operations have completed
+template <typename T> void delete_rma_rptr(const rptr<T> &p) {
+  auto ptr = p.get_ptr();
+  detail::rma_detach(ptr);
+  delete ptr;
+}
+
+template <typename T> qthread::future<T> get(const rptr<T> &p) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "One-sided access requires trivially copyable types");
+  cxx_assert(bool(p));
+  if (p.local())
+    return qthread::make_ready_future(*p.get_ptr());
+  auto op = new detail::rma_get_op<T>;
+  auto fres = op->pres.get_future();
+  detail::rma_get(&op->buf, sizeof(T), p.get_proc(), p.get_address(),
+                  detail::rma_get_op<T>::complete, op);
+  return fres;
+}
+
+template <typename T>
+qthread::future<void> put(const rptr<T> &p, const T &value) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "One-sided access requires trivially copyable types");
+  cxx_assert(bool(p));
+  if (p.local()) {
+    *p.get_ptr() = value;
+    return qthread::make_ready_future();
+  }
+  auto op = new detail::rma_put_op<T>;
+  std::memcpy(&op->buf, &value, sizeof(T));
+  auto fres = op->pres.get_future();
+  detail::rma_put(&op->buf, sizeof(T), p.get_proc(), p.get_address(),
+                  detail::rma_put_op<T>::complete, op);
+  return fres;
+}
+} // namespace funhpc
+
+#define FUNHPC_RMA_HPP_DONE
+#endif // #ifdef FUNHPC_RMA_HPP
+#ifndef FUNHPC_RMA_HPP_DONE
+#error "Cyclic include dependency"
+#endif
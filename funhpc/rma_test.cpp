@@ -0,0 +1,61 @@
+#include <funhpc/async.hpp>
+#include <funhpc/rma.hpp>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace funhpc;
+
+namespace {
+struct point {
+  double x, y;
+};
+
+rptr<point> make_point(double x, double y) {
+  return make_rma_rptr<point>(point{x, y});
+}
+void delete_point(rptr<point> p) { delete_rma_rptr(p); }
+} // namespace
+
+TEST(funhpc_rma, local) {
+  auto p = make_rma_rptr<int>(1);
+  EXPECT_TRUE(p.local());
+  EXPECT_EQ(1, get(p).get());
+  put(p, 2).wait();
+  EXPECT_EQ(2, *p);
+  delete_rma_rptr(p);
+}
+
+TEST(funhpc_rma, remote) {
+  auto p = async(rlaunch::sync, 1 % size(), make_point, 1.0, 2.0).get();
+  auto v = get(p).get();
+  EXPECT_EQ(1.0, v.x);
+  EXPECT_EQ(2.0, v.y);
+  put(p, point{3.0, 4.0}).wait();
+  // The put has completed remotely
+  v = get(p).get();
+  EXPECT_EQ(3.0, v.x);
+  EXPECT_EQ(4.0, v.y);
+  async(rlaunch::sync, p.get_proc(), delete_point, p).wait();
+}
+
+TEST(funhpc_rma, many) {
+  const std::ptrdiff_t n = 10;
+  std::vector<rptr<point>> ps;
+  for (std::ptrdiff_t i = 0; i < n; ++i)
+    ps.push_back(
+        async(rlaunch::sync, i % size(), make_point, double(i), 0.0).get());
+  std::vector<qthread::future<void>> fs;
+  for (std::ptrdiff_t i = 0; i < n; ++i)
+    fs.push_back(put(ps[i], point{double(i), double(i)}));
+  for (auto &f : fs)
+    f.wait();
+  std::vector<qthread::future<point>> gs;
+  for (std::ptrdiff_t i = 0; i < n; ++i)
+    gs.push_back(get(ps[i]));
+  for (std::ptrdiff_t i = 0; i < n; ++i)
+    EXPECT_EQ(double(i), gs[i].get().y);
+  for (std::ptrdiff_t i = 0; i < n; ++i)
+    async(rlaunch::sync, ps[i].get_proc(), delete_point, ps[i]).wait();
+}
@@ -44,6 +44,11 @@ public:
     cxx_assert(bool(*this));
     return proc;
   }
+  // The address on the owning process
+  std::uintptr_t get_address() const {
+    cxx_assert(bool(*this));
+    return iptr;
+  }
   T *get_ptr() const {
     if (!bool(*this))
       return nullptr;
@@ -0,0 +1,96 @@
+#include "serialize_shared_future.hpp"
+
+#include <cxx/cassert.hpp>
+#include <qthread/mutex.hpp>
+
+#include <map>
+#include <utility>
+
+namespace qthread {
+namespace detail {
+
+namespace {
+struct registered_future_t {
+  std::shared_ptr<void> pf;
+  // Number of serializations that have not been released yet
+  std::ptrdiff_t count;
+};
+
+struct received_future_t {
+  std::shared_ptr<void> pf;
+  // Number of times the future was received while its value was
+  // being fetched
+  std::ptrdiff_t count;
+};
+
+struct shared_future_registry_t {
+  qthread::mutex mtx;
+  std::map<std::uintptr_t, registered_future_t> registered;
+  std::map<std::pair<std::ptrdiff_t, std::uintptr_t>, received_future_t>
+      received;
+};
+
+shared_future_registry_t &get_registry() {
+  static shared_future_registry_t registry;
+  return registry;
+}
+} // namespace
+
+void shared_future_register(
+    std::uintptr_t id, const std::function<std::shared_ptr<void>()> &make,
+    std::ptrdiff_t count) {
+  cxx_assert(count > 0);
+  auto &registry = get_registry();
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  auto &entry = registry.registered[id];
+  if (!entry.pf)
+    entry.pf = make();
+  entry.count += count;
+}
+
+std::shared_ptr<void> shared_future_lookup(std::uintptr_t id) {
+  auto &registry = get_registry();
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  auto i = registry.registered.find(id);
+  cxx_assert(i != registry.registered.end());
+  return i->second.pf;
+}
+
+void shared_future_release(std::uintptr_t id, std::ptrdiff_t count) {
+  auto &registry = get_registry();
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  auto i = registry.registered.find(id);
+  cxx_assert(i != registry.registered.end());
+  cxx_assert(count > 0 && count <= i->second.count);
+  if ((i->second.count -= count) == 0)
+    registry.registered.erase(i);
+}
+
+std::shared_ptr<void> shared_future_lookup_or_fetch(
+    std::ptrdiff_t proc, std::uintptr_t id,
+    const std::function<std::shared_ptr<void>()> &make) {
+  auto &registry = get_registry();
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  auto i = registry.received.find({proc, id});
+  if (i != registry.received.end()) {
+    ++i->second.count;
+    return i->second.pf;
+  }
+  // The fetch is started while holding the lock, so that there is at
+  // most one fetch in flight per future
+  auto pf = make();
+  registry.received[{proc, id}] = {pf, 0};
+  return pf;
+}
+
+std::ptrdiff_t shared_future_fetched(std::ptrdiff_t proc, std::uintptr_t id) {
+  auto &registry = get_registry();
+  qthread::lock_guard<qthread::mutex> g(registry.mtx);
+  auto i = registry.received.find({proc, id});
+  cxx_assert(i != registry.received.end());
+  auto count = i->second.count;
+  registry.received.erase(i);
+  return count;
+}
+} // namespace detail
+} // namespace qthread
@@ -2,21 +2,63 @@
 #define SERIALIZE_SHARED_FUTURE_HPP
 
 #include <funhpc/async.hpp>
-#include <funhpc/rptr.hpp>
+#include <funhpc/rexec.hpp>
 #include <qthread/future.hpp>
 
 #include <cereal/access.hpp>
 #include <cereal/types/memory.hpp>
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+
 namespace qthread {
 
+// Unready futures are serialized as a reference to the future on the
+// sending process, which keeps the future alive until all receivers
+// have fetched its value. Each process fetches the value of a remote
+// future at most once, even if it receives the future several times.
+
 namespace detail {
-template <typename T>
-T shared_future_get(const funhpc::rptr<shared_future<T>> &pf) {
+// Sending process: Register count more serializations of the future
+// with the given id; make creates a copy of the future when it is
+// first registered
+void shared_future_register(std::uintptr_t id,
+                            const std::function<std::shared_ptr<void>()> &make,
+                            std::ptrdiff_t count);
+std::shared_ptr<void> shared_future_lookup(std::uintptr_t id);
+void shared_future_release(std::uintptr_t id, std::ptrdiff_t count);
+
+// Receiving process: Look up the local copy of a remote future; make
+// starts fetching the value when the future is first received
+std::shared_ptr<void> shared_future_lookup_or_fetch(
+    std::ptrdiff_t proc, std::uintptr_t id,
+    const std::function<std::shared_ptr<void>()> &make);
+// Forget a fetched future, returning how many serializations still
+// need to be released on the sending process
+std::ptrdiff_t shared_future_fetched(std::ptrdiff_t proc, std::uintptr_t id);
+
+template <typename T> T shared_future_get(std::uintptr_t id) {
+  auto pf =
+      std::static_pointer_cast<shared_future<T>>(shared_future_lookup(id));
   T val = pf->get();
-  delete pf.get_ptr();
+  shared_future_release(id, 1);
   return val;
 }
+
+template <typename T>
+shared_future<T> shared_future_fetch(std::ptrdiff_t proc, std::uintptr_t id) {
+  return async(launch::async, [proc, id]() {
+    T val = funhpc::async(funhpc::rlaunch::sync, proc, shared_future_get<T>,
+                          id)
+                .get();
+    // Release the serializations that were received in the mean time
+    auto count = shared_future_fetched(proc, id);
+    if (count > 0)
+      funhpc::rexec(proc, shared_future_release, id, count);
+    return val;
+  });
+}
 } // namespace detail
 
 template <typename Archive, typename T>
@@ -29,8 +71,13 @@ void save(Archive &ar, const shared_future<T> &f) {
     if (r) {
       ar(f.get());
     } else {
-      funhpc::rptr<shared_future<T>> pf(new shared_future<T>(f));
-      ar(pf);
+      std::ptrdiff_t proc = funhpc::rank();
+      auto id = reinterpret_cast<std::uintptr_t>(f.get_id());
+      // A broadcast is received (and released) once per destination
+      detail::shared_future_register(
+          id, [&]() { return std::make_shared<shared_future<T>>(f); },
+          funhpc::detail::archive_multiplicity(&ar));
+      ar(proc, id);
     }
   }
 }
@@ -47,10 +94,21 @@ void load(Archive &ar, shared_future<T> &f) {
       ar(val);
       f = make_ready_future(std::move(val));
     } else {
-      funhpc::rptr<shared_future<T>> pf;
-      ar(pf);
-      f = funhpc::async(funhpc::rlaunch::async, pf.get_proc(),
-                        detail::shared_future_get<T>, pf);
+      std::ptrdiff_t proc;
+      std::uintptr_t id;
+      ar(proc, id);
+      if (proc == funhpc::rank()) {
+        // The future is local
+        f = *std::static_pointer_cast<shared_future<T>>(
+            detail::shared_future_lookup(id));
+        detail::shared_future_release(id, 1);
+        return;
+      }
+      f = *std::static_pointer_cast<shared_future<T>>(
+          detail::shared_future_lookup_or_fetch(proc, id, [&]() {
+            return std::make_shared<shared_future<T>>(
+                detail::shared_future_fetch<T>(proc, id));
+          }));
     }
   }
 }
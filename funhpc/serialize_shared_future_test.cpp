@@ -0,0 +1,57 @@
+#include <funhpc/serialize_shared_future.hpp>
+
+#include <funhpc/async.hpp>
+#include <qthread/future.hpp>
+
+#include <cereal/types/vector.hpp>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace funhpc;
+
+namespace {
+int sum_futures(const std::vector<qthread::shared_future<int>> &fs) {
+  int sum = 0;
+  for (const auto &f : fs)
+    sum += f.get();
+  return sum;
+}
+} // namespace
+
+TEST(funhpc_serialize_shared_future, ready) {
+  auto f = qthread::make_ready_future(1).share();
+  std::vector<qthread::shared_future<int>> fs(3, f);
+  EXPECT_EQ(3, async(rlaunch::sync, 1 % size(), sum_futures, fs).get());
+}
+
+// The copies are fetched once, and the sender's reference to the
+// future is released only after all copies have been received
+TEST(funhpc_serialize_shared_future, duplicate) {
+  qthread::promise<int> p;
+  auto f = p.get_future().share();
+  std::vector<qthread::shared_future<int>> fs(3, f);
+  auto r = async(rlaunch::async, 1 % size(), sum_futures, fs);
+  auto r2 = async(rlaunch::async, 1 % size(), sum_futures, fs);
+  p.set_value(1);
+  EXPECT_EQ(3, r.get());
+  EXPECT_EQ(3, r2.get());
+}
+
+namespace {
+void check_sum(const std::vector<qthread::shared_future<int>> &fs) {
+  EXPECT_EQ(3, sum_futures(fs));
+}
+} // namespace
+
+// A broadcast is serialized once, but received by every process
+TEST(funhpc_serialize_shared_future, broadcast) {
+  qthread::promise<int> p;
+  auto f = p.get_future().share();
+  std::vector<qthread::shared_future<int>> fs(3, f);
+  auto r = async_all(check_sum, fs);
+  auto r2 = async_all(check_sum, fs);
+  p.set_value(1);
+  r.get();
+  r2.get();
+}
@@ -2,12 +2,17 @@
 #include <cxx/task.hpp>
 #include <funhpc/async.hpp>
 #include <funhpc/hwloc.hpp>
+#include <funhpc/proxy.hpp>
 #include <funhpc/rexec.hpp>
+#include <funhpc/rma.hpp>
 #include <funhpc/server.hpp>
+#include <funhpc/shared_rptr.hpp>
 #include <qthread/future.hpp>
 #include <qthread/mutex.hpp>
 #include <qthread/thread.hpp>
 
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
 #include <mpi.h>
 #include <qthread.h>
 
@@ -15,13 +20,23 @@
 #include <sys/time.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <random>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace funhpc {
@@ -38,6 +53,19 @@ double gettime() {
 bool run_main_everywhere() {
   return cxx::envtol("FUNHPC_MAIN_EVERYWHERE", "0");
 }
+
+// Startup phases and their durations, reported before main is called
+std::vector<std::pair<const char *, double>> startup_times;
+double startup_phase_time;
+void start_startup_timer() {
+  startup_times.clear();
+  startup_phase_time = gettime();
+}
+void end_startup_phase(const char *name) {
+  auto now = gettime();
+  startup_times.emplace_back(name, now - startup_phase_time);
+  startup_phase_time = now;
+}
 } // namespace detail
 
 // Enable/disable communication
@@ -117,7 +145,12 @@ void threading_enable() {
 // MPI
 
 constexpr int mpi_root = 0;
-constexpr int mpi_tag = 0;
+// Message types are distinguished by their tag
+constexpr int mpi_tag_task = 0;
+constexpr int mpi_tag_bcast = 1;
+constexpr int mpi_tag_reply = 2;
+constexpr int mpi_tag_steal = 3;
+constexpr int mpi_tag_steal_reply = 4;
 bool did_initialize_mpi = false;
 MPI_Comm mpi_comm = MPI_COMM_NULL;
 MPI_Comm mpi_node_comm = MPI_COMM_NULL;
@@ -129,6 +162,8 @@ std::ptrdiff_t the_local_rank = -1;
 std::ptrdiff_t the_local_size = -1;
 std::ptrdiff_t the_node_rank = -1;
 std::ptrdiff_t the_node_size = -1;
+// The node rank of each process
+std::vector<int> the_node_ranks;
 void set_rank_size() {
   int rank, size;
   MPI_Comm_rank(mpi_comm, &rank);
@@ -150,37 +185,30 @@ void set_rank_size() {
   // Label nodes by their lowest (global) rank
   int node_group;
   MPI_Allreduce(&rank, &node_group, 1, MPI_INT, MPI_MIN, mpi_node_comm);
-  std::vector<int> node_groups;
-  if (rank == mpi_root)
-    node_groups.resize(size);
-  MPI_Gather(&node_group, 1, MPI_INT, node_groups.data(), 1, MPI_INT, mpi_root,
-             mpi_comm);
-  std::vector<int> node_ranks;
-  int node_size;
+  std::vector<int> node_groups(size);
+  MPI_Allgather(&node_group, 1, MPI_INT, node_groups.data(), 1, MPI_INT,
+                mpi_comm);
+  // Map node groups to node ranks; every process does this, so that
+  // no further communication is necessary
+  std::vector<int> group_ranks(size, -1);
+  the_node_ranks.resize(size);
+  int node_size = 0;
+  for (int p = 0; p < size; ++p) {
+    const int g = node_groups[p];
+    int r = group_ranks[g];
+    if (r < 0)
+      r = group_ranks[g] = node_size++;
+    the_node_ranks[p] = r;
+  }
   if (rank == mpi_root) {
-    // map node groups to node ranks
-    std::vector<int> group_ranks(size, -1);
-    node_ranks.resize(size);
-    node_size = 0;
-    for (int p = 0; p < size; ++p) {
-      const int g = node_groups[p];
-      int r = group_ranks[g];
-      if (r < 0)
-        r = group_ranks[g] = node_size++;
-      node_ranks[p] = r;
-    }
     // check consistency
     std::vector<int> node_rank_count(node_size, 0);
     for (int p = 0; p < size; ++p)
-      ++node_rank_count.at(node_ranks.at(p));
+      ++node_rank_count.at(the_node_ranks.at(p));
     for (int n = 0; n < node_size; ++n)
       assert(node_rank_count.at(n) == local_size);
   }
-  MPI_Bcast(&node_size, 1, MPI_INT, mpi_root, mpi_comm);
-  int node_rank;
-  MPI_Scatter(node_ranks.data(), 1, MPI_INT, &node_rank, 1, MPI_INT, mpi_root,
-              mpi_comm);
-  the_node_rank = node_rank;
+  the_node_rank = the_node_ranks[rank];
   the_node_size = node_size;
 
   int num_threads = qthread::thread::hardware_concurrency();
@@ -232,6 +260,114 @@ void set_rank_size() {
 }
 } // namespace detail
 
+// Load estimates
+
+// Each process estimates its load from the number of its threads that
+// have not finished (which includes local async tasks as well as
+// remote and pool tasks), the number of tasks waiting in the work
+// pool, and its recent utilization. The estimate is appended to every message, so that
+// processes learn about each other's load without extra messages.
+
+namespace detail {
+namespace {
+struct load_t {
+  float queue;       // tasks per thread
+  float utilization; // fraction of busy threads, averaged over time
+
+  float score() const { return queue + utilization; }
+};
+
+std::ptrdiff_t pool_size();
+
+constexpr double utilization_time_scale = 1.0e-2;
+std::atomic<float> utilization{0.0f};
+double utilization_time;
+
+std::vector<load_t> loads;
+std::unique_ptr<qthread::mutex> loads_mutex;
+std::mt19937 loads_rng;
+// Prefer node-local processes if their load is at most this fraction
+// higher than the least load
+float local_load_slack;
+
+void init_loads() {
+  loads_mutex = std::make_unique<qthread::mutex>();
+  loads.assign(size(), load_t{0.0f, 0.0f});
+  utilization_time = gettime();
+  loads_rng.seed(rank());
+  local_load_slack = cxx::envtol("FUNHPC_LOCAL_LOAD_SLACK_PERCENT", "25") /
+                     100.0f;
+}
+
+load_t local_load() {
+  float nthreads = qthread::thread::hardware_concurrency();
+  return {(qthread::num_live_threads() + pool_size()) / nthreads,
+          utilization};
+}
+
+// Called from the MPI thread
+void update_utilization() {
+  auto now = gettime();
+  auto alpha = 1.0 - std::exp(-(now - utilization_time) /
+                              utilization_time_scale);
+  utilization_time = now;
+  float nthreads = qthread::thread::hardware_concurrency();
+  float busy = std::min(1.0f, qthread::num_live_threads() / nthreads);
+  utilization = (1.0 - alpha) * utilization + alpha * busy;
+}
+
+void append_load(std::string &buf) {
+  auto load = local_load();
+  buf.append(reinterpret_cast<const char *>(&load), sizeof load);
+}
+
+void strip_load(std::ptrdiff_t proc, std::string &buf) {
+  load_t load;
+  assert(buf.size() >= sizeof load);
+  std::memcpy(&load, buf.data() + buf.size() - sizeof load, sizeof load);
+  buf.resize(buf.size() - sizeof load);
+  qthread::lock_guard<qthread::mutex> g(*loads_mutex);
+  loads[proc] = load;
+}
+} // namespace
+
+std::ptrdiff_t least_loaded_proc(bool prefer_local) {
+  if (size() == 1)
+    return 0;
+  qthread::lock_guard<qthread::mutex> g(*loads_mutex);
+  loads[rank()] = local_load();
+  constexpr float eps = 1.0e-3f;
+  float min_score = loads[0].score();
+  for (std::ptrdiff_t p = 1; p < size(); ++p)
+    min_score = std::min(min_score, loads[p].score());
+  auto is_local = [](std::ptrdiff_t p) {
+    return the_node_ranks[p] == node_rank();
+  };
+  bool only_local = false;
+  if (prefer_local) {
+    float min_local_score = loads[rank()].score();
+    for (std::ptrdiff_t p = 0; p < size(); ++p)
+      if (is_local(p))
+        min_local_score = std::min(min_local_score, loads[p].score());
+    if (min_local_score <= min_score * (1 + local_load_slack) + eps) {
+      only_local = true;
+      min_score = min_local_score;
+    }
+  }
+  // Choose randomly between equally loaded processes
+  std::vector<std::ptrdiff_t> procs;
+  for (std::ptrdiff_t p = 0; p < size(); ++p)
+    if ((!only_local || is_local(p)) && loads[p].score() <= min_score + eps)
+      procs.push_back(p);
+  assert(!procs.empty());
+  std::uniform_int_distribution<std::size_t> dist(0, procs.size() - 1);
+  auto proc = procs[dist(loads_rng)];
+  // Account for the task that will be sent there
+  loads[proc].queue += 1.0f / qthread::thread::hardware_concurrency();
+  return proc;
+}
+} // namespace detail
+
 struct mpi_req_t {
   mpi_req_t() {}
 
@@ -243,6 +379,7 @@ struct mpi_req_t {
   mpi_req_t &operator=(mpi_req_t &&) = delete;
 
   std::ptrdiff_t proc;
+  int tag;
   std::string buf;
   MPI_Request req;
 };
@@ -255,6 +392,68 @@ std::unique_ptr<qthread::mutex> send_queue_mutex;
 // Send requests, to communicate with MPI
 std::vector<std::unique_ptr<mpi_req_t>> send_reqs;
 
+void enqueue_message(std::unique_ptr<mpi_req_t> &&reqp) {
+  qthread::lock_guard<qthread::mutex> g(*send_queue_mutex);
+  send_queue.push_back(std::move(reqp));
+}
+
+namespace detail {
+namespace {
+// The processes that the archives currently being serialized by
+// enqueue_task, enqueue_broadcast, or a steal reply are sent to
+struct archive_dests_t {
+  const std::ptrdiff_t *dests;
+  std::size_t ndests;
+};
+std::atomic<std::ptrdiff_t> num_archive_dests{0};
+std::mutex archive_dests_mutex;
+std::map<const void *, archive_dests_t> archive_dests;
+
+struct archive_dests_guard {
+  const void *ar;
+  archive_dests_guard(const void *ar, const std::ptrdiff_t *dests,
+                      std::size_t ndests)
+      : ar(ar) {
+    std::lock_guard<std::mutex> g(archive_dests_mutex);
+    archive_dests[ar] = {dests, ndests};
+    ++num_archive_dests;
+  }
+  ~archive_dests_guard() {
+    std::lock_guard<std::mutex> g(archive_dests_mutex);
+    archive_dests.erase(ar);
+    --num_archive_dests;
+  }
+};
+} // namespace
+
+std::ptrdiff_t archive_multiplicity(const void *ar) {
+  if (num_archive_dests == 0)
+    return 1;
+  std::lock_guard<std::mutex> g(archive_dests_mutex);
+  auto i = archive_dests.find(ar);
+  return i == archive_dests.end() ? 1 : i->second.ndests;
+}
+
+std::vector<std::ptrdiff_t> archive_destinations(const void *ar) {
+  std::vector<std::ptrdiff_t> dests;
+  if (num_archive_dests != 0) {
+    std::lock_guard<std::mutex> g(archive_dests_mutex);
+    auto i = archive_dests.find(ar);
+    if (i != archive_dests.end()) {
+      for (std::size_t n = 0; n < i->second.ndests; ++n)
+        if (i->second.dests[n] != rank())
+          dests.push_back(i->second.dests[n]);
+      return dests;
+    }
+  }
+  // Unknown destination: this could be any other process
+  for (std::ptrdiff_t p = 0; p < size(); ++p)
+    if (p != rank())
+      dests.push_back(p);
+  return dests;
+}
+} // namespace detail
+
 // Step 1: Enqueue task (from any thread)
 void enqueue_task(std::ptrdiff_t dest, task_t &&t) {
   assert(size() > 1);
@@ -266,13 +465,15 @@ void enqueue_task(std::ptrdiff_t dest, task_t &&t) {
   // Serialize task
   auto reqp = std::make_unique<mpi_req_t>();
   reqp->proc = dest;
+  reqp->tag = mpi_tag_task;
   std::stringstream buf;
-  { (cereal::BinaryOutputArchive(buf))(std::move(t)); }
-  reqp->buf = buf.str();
   {
-    qthread::lock_guard<qthread::mutex> g(*send_queue_mutex);
-    send_queue.push_back(std::move(reqp));
+    cereal::BinaryOutputArchive ar(buf);
+    detail::archive_dests_guard g(&ar, &dest, 1);
+    ar(std::move(t));
   }
+  reqp->buf = buf.str();
+  enqueue_message(std::move(reqp));
 }
 
 // Step 2: Send task via MPI (from MPI thread)
@@ -290,9 +491,10 @@ bool send_tasks() {
 
   // Begin sending all queued items
   for (auto &reqp : reqps) {
+    detail::append_load(reqp->buf);
     // const_cast is necessary because of an MPI API bug
     MPI_Isend(const_cast<char *>(reqp->buf.data()), reqp->buf.size(), MPI_CHAR,
-              reqp->proc, mpi_tag, mpi_comm, &reqp->req);
+              reqp->proc, reqp->tag, mpi_comm, &reqp->req);
     send_reqs.push_back(std::move(reqp));
     did_send = true;
   }
@@ -333,17 +535,535 @@ void run_task(std::unique_ptr<mpi_req_t> &&reqp) {
   t();
 }
 
+// Broadcasts
+
+// A broadcast task is serialized only once. It is then forwarded
+// along a binomial tree: each process executes the task, and forwards
+// the serialized task to the processes it is responsible for.
+
+namespace {
+struct bcast_msg_t {
+  // Processes to which this message needs to be forwarded
+  std::vector<std::ptrdiff_t> dests;
+  // Completion counter on the parent (if completion is tracked)
+  std::ptrdiff_t parent_proc;
+  std::uintptr_t parent_counter;
+  // Serialized task
+  std::string payload;
+
+  template <typename Archive> void serialize(Archive &ar) {
+    ar(dests, parent_proc, parent_counter, payload);
+  }
+};
+
+// Counts outstanding work (the local task and the subtrees of the
+// children); once done, it notifies the parent
+struct bcast_counter_t {
+  std::atomic<std::ptrdiff_t> count;
+  std::ptrdiff_t parent_proc;
+  std::uintptr_t parent_counter;
+  qthread::promise<void> *done;
+};
+
+void bcast_ack(std::uintptr_t counter);
+
+void bcast_finish(bcast_counter_t *counter) {
+  if (--counter->count > 0)
+    return;
+  if (counter->done) {
+    counter->done->set_value();
+    delete counter->done;
+  } else {
+    rexec(counter->parent_proc, bcast_ack, counter->parent_counter);
+  }
+  delete counter;
+}
+
+void bcast_ack(std::uintptr_t counter) {
+  bcast_finish(reinterpret_cast<bcast_counter_t *>(counter));
+}
+
+void bcast_run(std::shared_ptr<const std::string> payload,
+               bcast_counter_t *counter) {
+  task_t t;
+  {
+    std::stringstream buf(*payload);
+    (cereal::BinaryInputArchive(buf))(t);
+  }
+  payload.reset(); // free memory
+  t();
+  if (counter)
+    bcast_finish(counter);
+}
+
+// Execute the task locally (if requested), and forward it to the
+// given processes
+void bcast_forward(std::vector<std::ptrdiff_t> dests,
+                   std::shared_ptr<const std::string> payload, bool execute,
+                   bool track, std::ptrdiff_t parent_proc,
+                   std::uintptr_t parent_counter,
+                   qthread::promise<void> *done) {
+  // Split the destinations into subtrees
+  std::vector<std::vector<std::ptrdiff_t>> children;
+  while (!dests.empty()) {
+    auto mid = dests.size() / 2;
+    children.emplace_back(dests.begin() + mid, dests.end());
+    dests.resize(mid);
+  }
+
+  bcast_counter_t *counter = nullptr;
+  if (track) {
+    counter = new bcast_counter_t;
+    // Add one to keep the counter alive while we are sending
+    counter->count = children.size() + execute + 1;
+    counter->parent_proc = parent_proc;
+    counter->parent_counter = parent_counter;
+    counter->done = done;
+  }
+
+  for (auto &child : children) {
+    bcast_msg_t msg;
+    msg.dests.assign(child.begin() + 1, child.end());
+    msg.parent_proc = rank();
+    msg.parent_counter = std::uintptr_t(counter);
+    msg.payload = *payload;
+    auto reqp = std::make_unique<mpi_req_t>();
+    reqp->proc = child.front();
+    reqp->tag = mpi_tag_bcast;
+    std::stringstream buf;
+    { (cereal::BinaryOutputArchive(buf))(msg); }
+    reqp->buf = buf.str();
+    enqueue_message(std::move(reqp));
+  }
+
+  if (execute)
+    qthread::thread(bcast_run, std::move(payload), counter).detach();
+
+  if (counter)
+    bcast_finish(counter);
+}
+
+// Receive a broadcast (in a new thread)
+void run_bcast(std::unique_ptr<mpi_req_t> &&reqp) {
+  bcast_msg_t msg;
+  {
+    std::stringstream buf(std::move(reqp->buf));
+    (cereal::BinaryInputArchive(buf))(msg);
+  }
+  reqp.reset(); // free memory
+  auto payload = std::make_shared<const std::string>(std::move(msg.payload));
+  bool track = msg.parent_counter != 0;
+  bcast_forward(std::move(msg.dests), std::move(payload), true, track,
+                msg.parent_proc, msg.parent_counter, nullptr);
+}
+} // namespace
+
+void enqueue_broadcast(const std::vector<std::ptrdiff_t> &dests, task_t &&t,
+                       qthread::promise<void> *done) {
+  // Serialize task once; it is deserialized once per destination
+  std::stringstream buf;
+  {
+    cereal::BinaryOutputArchive ar(buf);
+    detail::archive_dests_guard g(&ar, dests.data(), dests.size());
+    ar(std::move(t));
+  }
+  auto payload = std::make_shared<const std::string>(buf.str());
+  bool execute = false;
+  std::vector<std::ptrdiff_t> others;
+  others.reserve(dests.size());
+  for (auto dest : dests) {
+    assert(dest >= 0 && dest < size());
+    if (dest == rank())
+      execute = true;
+    else
+      others.push_back(dest);
+  }
+  bcast_forward(std::move(others), std::move(payload), execute, bool(done),
+                -1, 0, done);
+}
+
+// One-sided communication
+
+// Objects that are accessed via get/put are attached to a dynamic
+// window. Transfers are started and completed by the MPI thread; a
+// completion function is called when the transfer has completed (for
+// a put, when the data have arrived at the target).
+
+namespace detail {
+namespace {
+MPI_Win rma_win = MPI_WIN_NULL;
+
+struct rma_op_t {
+  rma_op_t() {}
+  rma_op_t(const rma_op_t &) = delete;
+  rma_op_t(rma_op_t &&) = delete;
+  rma_op_t &operator=(const rma_op_t &) = delete;
+  rma_op_t &operator=(rma_op_t &&) = delete;
+
+  bool is_put;
+  void *buf;
+  std::size_t size;
+  std::ptrdiff_t proc;
+  std::uintptr_t addr;
+  rma_complete_t *complete;
+  void *arg;
+  MPI_Request req;
+};
+
+std::vector<std::unique_ptr<rma_op_t>> rma_queue;
+std::unique_ptr<qthread::mutex> rma_queue_mutex;
+std::vector<std::unique_ptr<rma_op_t>> rma_reqs;
+
+void enqueue_rma(std::unique_ptr<rma_op_t> &&op) {
+  qthread::lock_guard<qthread::mutex> g(*rma_queue_mutex);
+  rma_queue.push_back(std::move(op));
+}
+
+// Called from the MPI thread
+bool rma_ops() {
+  bool did_rma = false;
+
+  std::vector<std::unique_ptr<rma_op_t>> ops;
+  {
+    qthread::lock_guard<qthread::mutex> g(*rma_queue_mutex);
+    using std::swap;
+    swap(rma_queue, ops);
+  }
+
+  // With a dynamic window, the target displacement is the target's
+  // absolute address (as returned by MPI_Get_address, which is the
+  // pointer value on all supported platforms)
+  for (auto &op : ops) {
+    if (op->is_put)
+      MPI_Rput(op->buf, op->size, MPI_BYTE, op->proc, MPI_Aint(op->addr),
+               op->size, MPI_BYTE, rma_win, &op->req);
+    else
+      MPI_Rget(op->buf, op->size, MPI_BYTE, op->proc, MPI_Aint(op->addr),
+               op->size, MPI_BYTE, rma_win, &op->req);
+    rma_reqs.push_back(std::move(op));
+    did_rma = true;
+  }
+
+  rma_reqs.erase(std::remove_if(rma_reqs.begin(), rma_reqs.end(),
+                                [&did_rma](auto &op) {
+                                  int flag;
+                                  MPI_Test(&op->req, &flag, MPI_STATUS_IGNORE);
+                                  if (!flag)
+                                    return false;
+                                  // Ensure remote completion
+                                  if (op->is_put)
+                                    MPI_Win_flush(op->proc, rma_win);
+                                  op->complete(op->arg);
+                                  did_rma = true;
+                                  return true;
+                                }),
+                 rma_reqs.end());
+
+  return did_rma;
+}
+} // namespace
+
+void rma_attach(void *ptr, std::size_t size) {
+  if (funhpc::size() == 1)
+    return;
+  comm_lock();
+  MPI_Win_attach(rma_win, ptr, size);
+  comm_unlock();
+}
+
+void rma_detach(void *ptr) {
+  if (funhpc::size() == 1)
+    return;
+  comm_lock();
+  MPI_Win_detach(rma_win, ptr);
+  comm_unlock();
+}
+
+void rma_get(void *buf, std::size_t size, std::ptrdiff_t proc,
+             std::uintptr_t addr, rma_complete_t *complete, void *arg) {
+  assert(proc >= 0 && proc < funhpc::size() && proc != rank());
+  auto op = std::make_unique<rma_op_t>();
+  op->is_put = false;
+  op->buf = buf;
+  op->size = size;
+  op->proc = proc;
+  op->addr = addr;
+  op->complete = complete;
+  op->arg = arg;
+  enqueue_rma(std::move(op));
+}
+
+void rma_put(const void *buf, std::size_t size, std::ptrdiff_t proc,
+             std::uintptr_t addr, rma_complete_t *complete, void *arg) {
+  assert(proc >= 0 && proc < funhpc::size() && proc != rank());
+  auto op = std::make_unique<rma_op_t>();
+  op->is_put = true;
+  op->buf = const_cast<void *>(buf);
+  op->size = size;
+  op->proc = proc;
+  op->addr = addr;
+  op->complete = complete;
+  op->arg = arg;
+  enqueue_rma(std::move(op));
+}
+} // namespace detail
+
+// Replies
+
+// A reply carries the result of a remote async call back to the
+// waiting process. Replies bypass the polymorphic task machinery: the
+// message contains only a promise id and the serialized result, and
+// the receiver looks up the promise (and a function that knows its
+// type) in a table.
+
+namespace detail {
+namespace {
+struct reply_entry_t {
+  reply_setter_t *set;
+  void *pres;
+};
+std::unique_ptr<qthread::mutex> reply_table_mutex;
+std::unordered_map<std::uint64_t, reply_entry_t> reply_table;
+std::uint64_t next_reply_id = 1;
+
+// Small replies are handled directly in the MPI thread. They are
+// collected while receiving, and delivered after the communication
+// lock has been released, so that deserializing results and waking
+// up continuations does not hold up communication.
+constexpr std::size_t max_inline_reply_size = 4096;
+std::vector<std::unique_ptr<mpi_req_t>> inline_replies;
+
+void deliver_reply(std::uint64_t id, std::string &&payload) {
+  reply_entry_t entry;
+  {
+    qthread::lock_guard<qthread::mutex> g(*reply_table_mutex);
+    auto i = reply_table.find(id);
+    assert(i != reply_table.end());
+    entry = i->second;
+    reply_table.erase(i);
+  }
+  entry.set(entry.pres, std::move(payload));
+}
+
+void run_reply(std::unique_ptr<mpi_req_t> &&reqp) {
+  std::uint64_t id;
+  assert(reqp->buf.size() >= sizeof id);
+  std::memcpy(&id, reqp->buf.data(), sizeof id);
+  reqp->buf.erase(0, sizeof id);
+  deliver_reply(id, std::move(reqp->buf));
+}
+
+// Called by the MPI thread without holding the communication lock
+void deliver_inline_replies() {
+  for (auto &reqp : inline_replies)
+    run_reply(std::move(reqp));
+  inline_replies.clear();
+}
+} // namespace
+
+std::uint64_t register_reply(reply_setter_t *set, void *pres) {
+  qthread::lock_guard<qthread::mutex> g(*reply_table_mutex);
+  auto id = next_reply_id++;
+  reply_table[id] = {set, pres};
+  return id;
+}
+
+void enqueue_reply(std::ptrdiff_t dest, std::uint64_t id,
+                   std::string &&payload) {
+  if (dest == rank())
+    return deliver_reply(id, std::move(payload));
+  auto reqp = std::make_unique<mpi_req_t>();
+  reqp->proc = dest;
+  reqp->tag = mpi_tag_reply;
+  reqp->buf.reserve(sizeof id + payload.size());
+  reqp->buf.append(reinterpret_cast<const char *>(&id), sizeof id);
+  reqp->buf.append(payload);
+  enqueue_message(std::move(reqp));
+}
+} // namespace detail
+
+// Work stealing
+
+// Tasks launched with rlaunch::anywhere are kept in a per-process
+// pool. The MPI thread starts them when there are idle threads. When
+// the pool is empty and threads are idle, it asks a randomly chosen
+// process for a batch of tasks. Local tasks are started newest first;
+// stolen tasks are taken oldest first, since these tend to be larger.
+
+namespace detail {
+namespace {
+std::deque<task_t> pool;
+std::unique_ptr<qthread::mutex> pool_mutex;
+std::atomic<std::ptrdiff_t> pool_running{0};
+std::atomic<std::ptrdiff_t> pool_finished{0};
+std::ptrdiff_t pool_max_running;
+std::ptrdiff_t steal_batch_size;
+
+// Pool tasks may wait for other pool tasks. If no pool task finished
+// for some time, we start another task even if this oversubscribes
+// the threads.
+constexpr double pool_stall_time = 1.0e-3;
+std::ptrdiff_t last_pool_finished;
+double last_pool_progress;
+
+// Failed steal attempts are retried with exponential backoff
+constexpr double min_steal_backoff = 1.0e-4;
+constexpr double max_steal_backoff = 1.0e-2;
+bool steal_outstanding = false;
+double steal_backoff = min_steal_backoff;
+double next_steal_time = 0.0;
+std::mt19937 steal_rng;
+
+void run_pool_task(task_t &&t) {
+  // Count the task as finished even if it throws
+  struct pool_task_guard {
+    ~pool_task_guard() {
+      --pool_running;
+      ++pool_finished;
+    }
+  } g;
+  t();
+}
+
+void init_pool() {
+  pool_mutex = std::make_unique<qthread::mutex>();
+  pool_max_running = qthread::thread::hardware_concurrency();
+  steal_batch_size = cxx::envtol("FUNHPC_STEAL_BATCH_SIZE", "8");
+  assert(steal_batch_size > 0);
+  last_pool_finished = 0;
+  last_pool_progress = gettime();
+  steal_rng.seed(rank());
+}
+
+// Called from the MPI thread
+bool start_pool_tasks() {
+  bool did_start = false;
+  bool stalled = false;
+  if (pool_running >= pool_max_running) {
+    auto now = gettime();
+    if (pool_finished != last_pool_finished) {
+      last_pool_finished = pool_finished;
+      last_pool_progress = now;
+    } else if (now - last_pool_progress >= pool_stall_time) {
+      stalled = true;
+      last_pool_progress = now;
+    }
+  }
+  for (;;) {
+    task_t t;
+    {
+      qthread::lock_guard<qthread::mutex> g(*pool_mutex);
+      if (pool.empty())
+        break;
+      if (pool_running >= pool_max_running && !stalled)
+        break;
+      t = std::move(pool.back());
+      pool.pop_back();
+    }
+    ++pool_running;
+    qthread::thread(run_pool_task, std::move(t)).detach();
+    did_start = true;
+    stalled = false;
+  }
+  return did_start;
+}
+
+// Called from the MPI thread
+bool request_steal() {
+  if (steal_outstanding || pool_running >= pool_max_running)
+    return false;
+  {
+    qthread::lock_guard<qthread::mutex> g(*pool_mutex);
+    if (!pool.empty())
+      return false;
+  }
+  if (gettime() < next_steal_time)
+    return false;
+  // Choose a victim other than ourselves
+  std::uniform_int_distribution<std::ptrdiff_t> dist(0, size() - 2);
+  auto victim = dist(steal_rng);
+  if (victim >= rank())
+    ++victim;
+  auto reqp = std::make_unique<mpi_req_t>();
+  reqp->proc = victim;
+  reqp->tag = mpi_tag_steal;
+  enqueue_message(std::move(reqp));
+  steal_outstanding = true;
+  return true;
+}
+
+// Give away up to half of the pool (in a new thread)
+void run_steal(std::unique_ptr<mpi_req_t> &&reqp) {
+  std::vector<task_t> batch;
+  {
+    qthread::lock_guard<qthread::mutex> g(*pool_mutex);
+    auto count = std::min(steal_batch_size, std::ptrdiff_t(pool.size() / 2));
+    for (std::ptrdiff_t i = 0; i < count; ++i) {
+      batch.push_back(std::move(pool.front()));
+      pool.pop_front();
+    }
+  }
+  // An empty reply means that there was nothing to steal
+  reqp->tag = mpi_tag_steal_reply;
+  reqp->buf.clear();
+  if (!batch.empty()) {
+    std::stringstream buf;
+    {
+      cereal::BinaryOutputArchive ar(buf);
+      archive_dests_guard g(&ar, &reqp->proc, 1);
+      ar(batch);
+    }
+    reqp->buf = buf.str();
+  }
+  enqueue_message(std::move(reqp));
+}
+
+// Called from the MPI thread
+void run_steal_reply(std::unique_ptr<mpi_req_t> &&reqp) {
+  assert(steal_outstanding);
+  steal_outstanding = false;
+  if (reqp->buf.empty()) {
+    next_steal_time = gettime() + steal_backoff;
+    steal_backoff = std::min(2 * steal_backoff, max_steal_backoff);
+    return;
+  }
+  steal_backoff = min_steal_backoff;
+  std::vector<task_t> batch;
+  {
+    std::stringstream buf(std::move(reqp->buf));
+    (cereal::BinaryInputArchive(buf))(batch);
+  }
+  qthread::lock_guard<qthread::mutex> g(*pool_mutex);
+  for (auto &t : batch)
+    pool.push_back(std::move(t));
+}
+std::ptrdiff_t pool_size() {
+  qthread::lock_guard<qthread::mutex> g(*pool_mutex);
+  return pool.size();
+}
+} // namespace
+} // namespace detail
+
+void enqueue_anywhere(task_t &&t) {
+  // Without other processes there is no pool; run the task right away
+  if (size() == 1)
+    return qthread::thread(std::move(t)).detach();
+  qthread::lock_guard<qthread::mutex> g(*detail::pool_mutex);
+  detail::pool.push_back(std::move(t));
+}
+
 // Step 3: Receive the task via MPI (in MPI thread)
 bool recv_tasks() {
   bool did_recv = false;
   for (;;) {
     int flag;
     MPI_Status status;
-    MPI_Iprobe(MPI_ANY_SOURCE, mpi_tag, mpi_comm, &flag, &status);
+    MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, mpi_comm, &flag, &status);
     if (!flag)
       return did_recv;
     auto reqp = std::make_unique<mpi_req_t>();
     reqp->proc = status.MPI_SOURCE;
+    reqp->tag = status.MPI_TAG;
     int count;
     MPI_Get_count(&status, MPI_CHAR, &count);
     reqp->buf.resize(count);
@@ -351,7 +1071,8 @@ bool recv_tasks() {
     // Note: The const_cast here is against the C++ standard for
     // std::string, but works fine in practice
     MPI_Recv(const_cast<char *>(reqp->buf.data()), reqp->buf.size(), MPI_CHAR,
-             reqp->proc, mpi_tag, mpi_comm, MPI_STATUS_IGNORE);
+             reqp->proc, reqp->tag, mpi_comm, MPI_STATUS_IGNORE);
+    detail::strip_load(reqp->proc, reqp->buf);
     // MPI_Request req;
     // MPI_Irecv(const_cast<char *>(reqp->buf.data()), reqp->buf.size(),
     //           MPI_CHAR, reqp->proc, mpi_tag, mpi_comm, &req);
@@ -360,7 +1081,30 @@ bool recv_tasks() {
     //   std::cerr << "MPI_Test not ready\n";
     //   std::terminate();
     // }
-    qthread::thread(run_task, std::move(reqp)).detach();
+    switch (reqp->tag) {
+    case mpi_tag_task:
+      qthread::thread(run_task, std::move(reqp)).detach();
+      break;
+    case mpi_tag_bcast:
+      qthread::thread(run_bcast, std::move(reqp)).detach();
+      break;
+    case mpi_tag_reply:
+      if (reqp->buf.size() <= detail::max_inline_reply_size)
+        detail::inline_replies.push_back(std::move(reqp));
+      else
+        qthread::thread(detail::run_reply, std::move(reqp)).detach();
+      break;
+    case mpi_tag_steal:
+      qthread::thread(detail::run_steal, std::move(reqp)).detach();
+      break;
+    case mpi_tag_steal_reply:
+      detail::run_steal_reply(std::move(reqp));
+      break;
+    default:
+      std::cerr << "FunHPC: Received message with unknown tag " << reqp->tag
+                << "\n";
+      std::terminate();
+    }
     did_recv = true;
   }
 }
@@ -385,6 +1129,9 @@ bool terminate_check(bool ready_to_terminate) {
 }
 
 void initialize(int &argc, char **&argv) {
+  // The MPI phase includes initializing MPI, which is often the
+  // slowest part of the startup
+  detail::start_startup_timer();
   int flag;
   MPI_Initialized(&flag);
   int provided;
@@ -399,10 +1146,15 @@ void initialize(int &argc, char **&argv) {
     std::exit(EXIT_FAILURE);
   }
   MPI_Comm_dup(MPI_COMM_WORLD, &mpi_comm);
+  detail::end_startup_phase("MPI");
   qthread_initialize();
+  detail::end_startup_phase("Qthreads");
   detail::set_rank_size();
+  detail::end_startup_phase("layout");
   hwloc::set_all_cpu_affinities();
+  detail::end_startup_phase("affinities");
   MPI_Barrier(mpi_comm);
+  detail::end_startup_phase("barrier");
 }
 
 int run_main(mainfunc_t *user_main, int argc, char **argv) {
@@ -425,46 +1177,87 @@ int run_main(mainfunc_t *user_main, int argc, char **argv) {
   return res;
 }
 
-int eventloop(mainfunc_t *user_main, int argc, char **argv) {
-  // Output thread bindings
-  {
-    if (node_rank() == 0) {
-
-      // Output all CPU infos in order
-      for (int p = 0; p < local_size(); ++p) {
-        std::string msg;
-        // On process p, get the CPU info
-        if (local_rank() == p)
-          msg = hwloc::get_all_cpu_infos();
-        // If necessary, transmit from process p to process 0
-        if (p != 0) {
-          // Send on process p
-          if (local_rank() == p)
-            MPI_Send(msg.data(), msg.size(), MPI_CHAR, 0, 0, mpi_node_comm);
-          // Receive on process 0
-          if (local_rank() == 0) {
-            MPI_Status status;
-            MPI_Probe(p, 0, mpi_node_comm, &status);
-            int count;
-            MPI_Get_count(&status, MPI_CHAR, &count);
-            msg = std::string(count, '\0');
-            MPI_Recv(const_cast<char *>(msg.data()), count, MPI_CHAR, p, 0,
-                     mpi_node_comm, MPI_STATUS_IGNORE);
-          }
-        }
-        // On process 0, output the CPU info
-        if (local_rank() == 0)
-          std::cout << msg;
-      }
+namespace detail {
+// Write the thread bindings of all processes to the file named by
+// FUNHPC_TOPOLOGY_FILE ("-" for stdout). There is no report if this
+// is not set.
+void report_topology() {
+  const auto filename = cxx::envtostr("FUNHPC_TOPOLOGY_FILE", "");
+  if (filename.empty())
+    return;
+  const std::string msg = hwloc::get_all_cpu_infos();
+  int count = msg.size();
+  std::vector<int> counts, displs;
+  if (rank() == mpi_root)
+    counts.resize(size());
+  MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, mpi_root,
+             mpi_comm);
+  std::string msgs;
+  if (rank() == mpi_root) {
+    displs.resize(size());
+    int total = 0;
+    for (std::ptrdiff_t p = 0; p < size(); ++p) {
+      displs[p] = total;
+      total += counts[p];
     }
-    MPI_Barrier(mpi_comm);
+    msgs.resize(total);
   }
+  MPI_Gatherv(msg.data(), count, MPI_CHAR, const_cast<char *>(msgs.data()),
+              counts.data(), displs.data(), MPI_CHAR, mpi_root, mpi_comm);
+  if (rank() == mpi_root) {
+    if (filename == "-") {
+      std::cout << msgs << std::flush;
+    } else {
+      std::ofstream file(filename);
+      file << msgs;
+      if (!file)
+        std::cerr << "FunHPC: Could not write topology report to \""
+                  << filename << "\"\n";
+    }
+  }
+}
 
-  if (size() == 1)
-    return run_main(user_main, argc, argv);
+// Output the slowest process' startup times
+void report_startup_times() {
+  std::vector<double> times, max_times;
+  for (const auto &phase : startup_times)
+    times.push_back(phase.second);
+  max_times.resize(times.size());
+  MPI_Reduce(times.data(), max_times.data(), times.size(), MPI_DOUBLE,
+             MPI_MAX, mpi_root, mpi_comm);
+  if (rank() == mpi_root) {
+    std::ostringstream buf;
+    buf << "FunHPC: Startup times:";
+    for (std::size_t i = 0; i < startup_times.size(); ++i)
+      buf << " " << startup_times[i].first << " " << max_times[i] << " sec"
+          << (i + 1 < startup_times.size() ? "," : "\n");
+    std::cout << buf.str() << std::flush;
+  }
+}
+} // namespace detail
+
+int eventloop(mainfunc_t *user_main, int argc, char **argv) {
+  detail::report_topology();
+  detail::end_startup_phase("topology report");
+  detail::report_startup_times();
+
+  // Replies are also used by a single process, e.g. for tasks
+  // launched with rlaunch::anywhere
+  detail::reply_table_mutex = std::make_unique<qthread::mutex>();
+  if (size() == 1) {
+    int res = run_main(user_main, argc, argv);
+    detail::proxy_cache_clear();
+    detail::reply_table_mutex.reset();
+    return res;
+  }
 
   detail::comm_mutex = std::make_unique<qthread::mutex>();
   send_queue_mutex = std::make_unique<qthread::mutex>();
+  detail::rma_queue_mutex = std::make_unique<qthread::mutex>();
+  detail::init_pool();
+  detail::init_loads();
+  MPI_Win_create_dynamic(MPI_INFO_NULL, mpi_comm, &detail::rma_win);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, detail::rma_win);
 
   qthread::future<int> fres;
   if (detail::run_main_everywhere() || rank() == mpi_root)
@@ -474,13 +1267,33 @@ int eventloop(mainfunc_t *user_main, int argc, char **argv) {
     comm_lock();
     send_tasks();
     recv_tasks();
+    detail::rma_ops();
+    detail::start_pool_tasks();
+    detail::update_utilization();
+    // Processes whose main function has finished (or that do not run
+    // one) keep stealing while they are idle, until all processes
+    // have finished
+    detail::request_steal();
     comm_unlock();
+    detail::deliver_inline_replies();
+    detail::poll_refcounts();
     if (terminate_check(!fres.valid() || fres.ready()))
       break;
     qthread::this_thread::yield();
   }
+  // The proxy cache holds references to remote objects. Release them
+  // while the mutexes still exist, instead of at static destruction
+  // time. All processes are terminating, so the releases are not
+  // sent.
+  detail::proxy_cache_clear();
   cancel_sends();
 
+  MPI_Win_unlock_all(detail::rma_win);
+  MPI_Win_free(&detail::rma_win);
+  detail::loads_mutex.reset();
+  detail::pool_mutex.reset();
+  detail::rma_queue_mutex.reset();
+  detail::reply_table_mutex.reset();
   send_queue_mutex.reset();
   detail::comm_mutex.reset();
   return fres.valid() ? fres.get() : 0;
@@ -0,0 +1,93 @@
+#include "shared_rptr.hpp"
+
+#include <cxx/cstdlib.hpp>
+#include <funhpc/rexec.hpp>
+#include <qthread/mutex.hpp>
+
+#include <cereal/types/map.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace funhpc {
+namespace detail {
+
+namespace {
+// Pending reference count changes for the managers on one process,
+// indexed by the managers' addresses
+typedef std::map<std::uintptr_t, std::ptrdiff_t> refcount_batch;
+
+qthread::mutex &get_refcount_mutex() {
+  static qthread::mutex mtx;
+  return mtx;
+}
+std::map<std::ptrdiff_t, refcount_batch> &get_refcount_batches() {
+  static std::map<std::ptrdiff_t, refcount_batch> batches;
+  return batches;
+}
+
+std::size_t max_batch_size() {
+  static std::size_t size = cxx::envtol("FUNHPC_REFCOUNT_BATCH_SIZE", "1000");
+  return size;
+}
+std::chrono::microseconds flush_interval() {
+  static std::chrono::microseconds interval(
+      cxx::envtol("FUNHPC_REFCOUNT_FLUSH_USEC", "1000"));
+  return interval;
+}
+
+void apply_refcounts(const refcount_batch &batch) {
+  for (const auto &kv : batch)
+    reinterpret_cast<manager_base *>(kv.first)->add_refcount(kv.second);
+}
+
+void send_batch(std::ptrdiff_t proc, refcount_batch &&batch) {
+  rexec(proc, apply_refcounts, std::move(batch));
+}
+
+// Modify the batch for a process, and send it if it is full
+template <typename F> void update_batch(std::ptrdiff_t proc, F &&f) {
+  refcount_batch full;
+  {
+    qthread::lock_guard<qthread::mutex> g(get_refcount_mutex());
+    auto &batch = get_refcount_batches()[proc];
+    f(batch);
+    if (batch.size() < max_batch_size())
+      return;
+    using std::swap;
+    swap(batch, full);
+  }
+  send_batch(proc, std::move(full));
+}
+} // namespace
+
+void enqueue_release(const rptr<manager_base> &mgr, std::ptrdiff_t weight) {
+  cxx_assert(weight > 0);
+  if (mgr.local())
+    return mgr.get_ptr()->add_refcount(-weight);
+  update_batch(mgr.get_proc(), [&](refcount_batch &batch) {
+    // Releases for the same manager are combined
+    batch[mgr.get_address()] -= weight;
+  });
+}
+
+void poll_refcounts() {
+  static auto next_flush = std::chrono::steady_clock::now();
+  auto now = std::chrono::steady_clock::now();
+  if (now < next_flush)
+    return;
+  next_flush = now + flush_interval();
+  std::map<std::ptrdiff_t, refcount_batch> batches;
+  {
+    qthread::lock_guard<qthread::mutex> g(get_refcount_mutex());
+    using std::swap;
+    swap(batches, get_refcount_batches());
+  }
+  for (auto &kv : batches)
+    if (!kv.second.empty())
+      send_batch(kv.first, std::move(kv.second));
+}
+} // namespace detail
+} // namespace funhpc
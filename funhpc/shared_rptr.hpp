@@ -2,95 +2,185 @@
 #define FUNHPC_SHARED_RPTR_HPP
 
 #include <cxx/cassert.hpp>
+#include <funhpc/async.hpp>
 #include <funhpc/rptr.hpp>
 #include <qthread/future.hpp>
 
 #include <cereal/access.hpp>
 #include <cereal/types/memory.hpp>
+#include <cereal/types/tuple.hpp>
 
 #include <atomic>
 #include <cstdlib>
 #include <memory>
+#include <tuple>
 #include <utility>
 
 namespace funhpc {
 
+template <typename T> class shared_rptr;
+namespace detail {
+template <typename T>
+void shared_rptr_migrate(const shared_rptr<T> &oldptr,
+                         const shared_rptr<T> &newptr);
+template <typename T>
+std::tuple<std::shared_ptr<T>, shared_rptr<T>>
+shared_rptr_fetch(const shared_rptr<T> &rptr);
+}
+template <typename T>
+qthread::future<std::shared_ptr<T>>
+make_local_shared_ptr(const shared_rptr<T> &rptr);
+
 // manager /////////////////////////////////////////////////////////////////////
 
+// We use weighted reference counting. Each process that holds a
+// reference to an object has a manager. The manager on the owning
+// process holds the object; its reference count counts the local
+// references plus the total weight of all remote managers. A remote
+// manager holds some weight.
+//
+// Sending a reference to another process gives the copy half of the
+// sender's weight (or fresh weight if the sender is the owner), so that
+// no message to the owner is needed. (A broadcast, which is serialized
+// once and deserialized n times, gives each copy 1/n of that share.)
+// Only destructing a remote manager sends a message, which returns its
+// weight. If a remote manager's weight cannot be split any more, it
+// mints fresh weight itself, and the copy refers to the object
+// indirectly via this manager.
+//
+// An object can migrate to another process (see proxy<T>::migrate).
+// The managers on the old owning process then forward to the new
+// owner, and references sent from there refer to the new owner
+// directly, so that forwarding chains do not grow. A remote manager
+// learns the new owner when it first fetches the object from the old
+// owner, and refers to the new owner directly from then on.
+
 namespace detail {
-// TODO: make this abstract, i.e. independent of the type T
-template <typename T> class manager {
-  std::shared_ptr<T> obj;
-  rptr<T> robj;
+// The type-independent part of a manager, so that reference count
+// changes for different types can be sent together
+class manager_base {
+protected:
   mutable std::atomic<std::ptrdiff_t> refcount;
-  rptr<manager> owner;
 
 public:
+  manager_base() : refcount(1) {}
+  virtual ~manager_base() {}
+
   void incref() { ++refcount; }
   void decref() {
     if (--refcount == 0)
       delete this;
   }
+  void add_refcount(std::ptrdiff_t delta) {
+    if ((refcount += delta) == 0)
+      delete this;
+  }
+};
+
+// Returned weight is collected per process, and is sent in batches
+// (see shared_rptr.cpp)
+void enqueue_release(const rptr<manager_base> &mgr, std::ptrdiff_t weight);
+// Send all pending releases if they are due (called by the MPI thread)
+void poll_refcounts();
+
+// The object on its owning process. All managers on this process
+// share this record. If the object has migrated, the record forwards
+// to the object's new home. The object is accessed atomically, since
+// it is released when it migrates.
+template <typename T> struct home_t {
+  std::shared_ptr<T> obj;
+  std::unique_ptr<shared_rptr<T>> forward;
+  std::atomic<bool> migrated{false};
+
+  home_t(const std::shared_ptr<T> &obj) : obj(obj) {}
+  home_t(std::shared_ptr<T> &&obj) : obj(std::move(obj)) {}
+};
+
+template <typename T> class manager : public manager_base {
+  static constexpr std::ptrdiff_t initial_weight = std::ptrdiff_t(1) << 20;
+
+  std::shared_ptr<home_t<T>> home;
+  rptr<T> robj;
+  // The owner's manager (which holds the object)
+  rptr<manager_base> root;
+  // The manager that issued our weight (either the owner's, or an
+  // intermediate manager)
+  rptr<manager_base> parent;
+  mutable std::atomic<std::ptrdiff_t> weight;
+  // A remote manager whose object has migrated forwards to its new
+  // owner (set by the first fetch that finds the object migrated)
+  mutable std::atomic<shared_rptr<T> *> redirect{nullptr};
+
+  const shared_rptr<T> *forward() const {
+    if (bool(home))
+      return home->migrated ? home->forward.get() : nullptr;
+    return redirect;
+  }
+  const manager &forward_target() const;
 
+public:
   template <typename Archive> void save(Archive &ar) const {
+    // Send references to migrated objects directly to their new home
+    if (migrated())
+      return forward_target().save(ar);
     ar(robj);
     if (bool(robj)) {
-      rptr<manager> origin(const_cast<manager *>(this));
-      rptr<manager> owner1 = owner ? owner : origin;
-      ++refcount;
-      ar(owner1, origin);
+      rptr<manager_base> self(
+          static_cast<manager_base *>(const_cast<manager *>(this)));
+      // A broadcast archive is deserialized n times, and each copy
+      // returns the weight it received
+      const std::ptrdiff_t n = archive_multiplicity(&ar);
+      cxx_assert(n >= 1 && n <= initial_weight);
+      // Split our weight if possible; the n copies receive half of it
+      std::ptrdiff_t w = weight;
+      while (w >= 2 * n &&
+             !weight.compare_exchange_weak(w, w - n * (w / (2 * n))))
+        ;
+      if (w >= 2 * n) {
+        ar(bool(home) ? self : root, parent, w / (2 * n));
+      } else {
+        // Mint fresh weight
+        w = initial_weight;
+        refcount += n * w;
+        ar(bool(home) ? self : root, self, w);
+      }
     }
   }
   template <typename Archive> manager(Archive &ar) : manager() {
     ar(robj);
     if (bool(robj)) {
-      rptr<manager> origin;
-      ar(owner, origin);
-      if (owner.get_proc() == rank()) {
+      std::ptrdiff_t w;
+      ar(root, parent, w);
+      if (root.get_proc() == rank()) {
         // The object is local: create a shortcut
-        obj = owner->obj;
-        owner = nullptr;
-        rexec(origin.get_proc(), decref1, origin);
+        home = static_cast<manager *>(root.get_ptr())->home;
+        root = nullptr;
+        enqueue_release(parent, w);
+        parent = nullptr;
       } else {
-        // Transfer refcount from origin to owner
-        if (owner.get_proc() != origin.get_proc()) {
-          // We must not destruct ourselves until the owner has
-          // received the refcount. We temporarily increase our
-          // refcount to prevent this.
-          ++refcount;
-          rptr<manager> self(this);
-          rexec(owner.get_proc(), incref_then_decref2, owner, origin, self);
-        }
+        weight = w;
       }
     }
     cxx_assert(invariant());
   }
 
-private:
-  static void incref1(rptr<manager> mgr) { mgr->incref(); }
-  static void decref1(rptr<manager> mgr) { mgr->decref(); }
-  static void incref_then_decref2(rptr<manager> mgr, rptr<manager> other1,
-                                  rptr<manager> other2) {
-    mgr->incref();
-    rexec(other1.get_proc(), decref1, other1);
-    rexec(other2.get_proc(), decref1, other2);
-  }
-
-public:
-  manager() : obj(nullptr), robj(nullptr), refcount(1), owner(nullptr) {
+  manager()
+      : home(nullptr), robj(nullptr), root(nullptr), parent(nullptr),
+        weight(0) {
     // This routine is only called for deserialization, and does not
     // need to return an object that is in a consistent state
     // cxx_assert(invariant());
   }
   manager(const std::shared_ptr<T> &obj)
-      : obj(obj), robj(obj.get()), refcount(1), owner(nullptr) {
+      : home(std::make_shared<home_t<T>>(obj)), robj(obj.get()),
+        root(nullptr), parent(nullptr), weight(0) {
     cxx_assert(bool(obj));
     cxx_assert(invariant());
   }
   manager(std::shared_ptr<T> &&obj)
-      : obj(std::move(obj)), robj(this->obj.get()), refcount(1),
-        owner(nullptr) {
-    cxx_assert(bool(this->obj));
+      : home(std::make_shared<home_t<T>>(std::move(obj))),
+        robj(home->obj.get()), root(nullptr), parent(nullptr), weight(0) {
+    cxx_assert(bool(home->obj));
     cxx_assert(invariant());
   }
   manager(manager &&other) = delete;
@@ -99,24 +189,83 @@ public:
   manager &operator=(const manager &other) = delete;
   ~manager() {
     cxx_assert(refcount == 0);
-    if (bool(owner))
-      rexec(owner.get_proc(), decref1, owner);
+    if (bool(parent))
+      enqueue_release(parent, weight);
+    delete redirect.load();
+  }
+
+  // Forward all references on this (the owning) process to the object's
+  // new home, and release the object. If the object has migrated
+  // already, the request is passed on.
+  void migrate(const shared_rptr<T> &target) {
+    cxx_assert(bool(home));
+    if (migrated()) {
+      auto next = *home->forward;
+      async(rlaunch::sync, next.get_proc(), shared_rptr_migrate<T>, next,
+            target);
+      return;
+    }
+    home->forward = std::make_unique<shared_rptr<T>>(target);
+    home->migrated = true;
+    // Concurrent readers either see the object, or no object and the
+    // forwarding reference
+    std::atomic_store(&home->obj, std::shared_ptr<T>());
+  }
+
+  bool migrated() const { return bool(forward()); }
+  // The next reference in the forwarding chain
+  const shared_rptr<T> &get_forward() const {
+    cxx_assert(migrated());
+    return *forward();
+  }
+  // The last manager in the forwarding chain
+  const manager &resolve() const {
+    return migrated() ? forward_target().resolve() : *this;
+  }
+  // Forward this remote manager to the object's new owner
+  void set_redirect(const shared_rptr<T> &target) const {
+    auto ptr = new shared_rptr<T>(target);
+    shared_rptr<T> *expected = nullptr;
+    // Concurrent fetches may find the new owner at the same time
+    if (bool(home) || !redirect.compare_exchange_strong(expected, ptr))
+      delete ptr;
   }
 
-  bool local() const { return !bool(owner); }
-  std::ptrdiff_t get_proc() const { return robj.get_proc(); }
-  const std::shared_ptr<T> &get_shared_ptr() const {
-    cxx_assert(local());
-    return obj;
+  bool local() const {
+    if (migrated())
+      return forward_target().local();
+    return bool(home);
+  }
+  std::ptrdiff_t get_proc() const {
+    if (migrated())
+      return forward_target().get_proc();
+    return robj.get_proc();
+  }
+  // This is null if the object is not local, which may happen
+  // concurrently when it migrates
+  std::shared_ptr<T> get_shared_ptr() const {
+    if (migrated())
+      return forward_target().get_shared_ptr();
+    if (!bool(home))
+      return nullptr;
+    return std::atomic_load(&home->obj);
+  }
+  rptr<T> get_rptr() const {
+    if (migrated())
+      return forward_target().get_rptr();
+    return robj;
   }
-  rptr<T> get_rptr() const { return robj; }
 
   bool invariant() const noexcept {
-    if (local())
-      return bool(obj) && robj.get_proc() == rank() &&
-             robj.get_ptr() == obj.get() && !bool(owner) && refcount >= 1;
-    return !bool(obj) && bool(robj) && robj.get_proc() != rank() &&
-           bool(owner) && owner.get_proc() == robj.get_proc() && refcount >= 1;
+    if (bool(home))
+      return (migrated() ? bool(home->forward)
+                         : robj.get_proc() == rank() &&
+                               robj.get_ptr() ==
+                                   std::atomic_load(&home->obj).get()) &&
+             !bool(root) && !bool(parent) && weight == 0 && refcount >= 1;
+    return bool(robj) && robj.get_proc() != rank() && bool(root) &&
+           root.get_proc() == robj.get_proc() && bool(parent) && weight >= 1 &&
+           refcount >= 1;
   }
 };
 } // namespace detail
@@ -124,6 +273,17 @@ public:
 // shared_rptr /////////////////////////////////////////////////////////////////
 
 template <typename T> class shared_rptr {
+  template <typename U> friend class detail::manager;
+  template <typename U>
+  friend void detail::shared_rptr_migrate(const shared_rptr<U> &oldptr,
+                                          const shared_rptr<U> &newptr);
+  template <typename U>
+  friend std::tuple<std::shared_ptr<U>, shared_rptr<U>>
+  detail::shared_rptr_fetch(const shared_rptr<U> &rptr);
+  template <typename U>
+  friend qthread::future<std::shared_ptr<U>>
+  make_local_shared_ptr(const shared_rptr<U> &rptr);
+
   detail::manager<T> *mgr;
 
   friend class cereal::access;
@@ -189,12 +349,16 @@ public:
     cxx_assert(bool(*this));
     return mgr->get_proc();
   }
+  // The object's address on its owning process
+  rptr<T> get_rptr() const {
+    cxx_assert(bool(*this));
+    return mgr->get_rptr();
+  }
 
-  const std::shared_ptr<T> &get_shared_ptr() const {
-    static const std::shared_ptr<T> null;
+  // The object, or null if it is not local
+  std::shared_ptr<T> get_shared_ptr() const {
     if (!bool(*this))
-      return null;
-    cxx_assert(local());
+      return nullptr;
     return mgr->get_shared_ptr();
   }
   const T &operator*() const {
@@ -205,7 +369,7 @@ public:
     cxx_assert(bool(*this) && local());
     return *get_shared_ptr();
   }
-  const std::shared_ptr<T> &operator->() const { return get_shared_ptr(); }
+  std::shared_ptr<T> operator->() const { return get_shared_ptr(); }
 
   bool operator==(const shared_rptr &other) const {
     if (bool(*this) != bool(other))
@@ -227,6 +391,22 @@ template <typename T> void swap(shared_rptr<T> &lhs, shared_rptr<T> &rhs) {
   lhs.swap(rhs);
 }
 
+namespace detail {
+template <typename T>
+const manager<T> &manager<T>::forward_target() const {
+  cxx_assert(migrated());
+  return *forward()->mgr;
+}
+
+// Make oldptr's object forward to newptr; called on oldptr's home
+template <typename T>
+void shared_rptr_migrate(const shared_rptr<T> &oldptr,
+                         const shared_rptr<T> &newptr) {
+  cxx_assert(bool(oldptr) && bool(newptr));
+  oldptr.mgr->migrate(newptr);
+}
+} // namespace detail
+
 // make_shared_rptr ////////////////////////////////////////////////////////////
 
 template <typename T, typename... Args>
@@ -236,10 +416,20 @@ shared_rptr<T> make_shared_rptr(Args &&... args) {
 
 // make_local_shared_ptr ///////////////////////////////////////////////////////
 
+template <typename T>
+qthread::future<std::shared_ptr<T>>
+make_local_shared_ptr(const shared_rptr<T> &rptr);
+
 namespace detail {
+// Called on the owning process. If the object has migrated, return
+// the next reference in the forwarding chain instead, so that the
+// caller can fetch the object from there directly.
 template <typename T>
-std::shared_ptr<T> shared_rptr_get_shared_ptr(const shared_rptr<T> &rptr) {
-  return rptr.get_shared_ptr();
+std::tuple<std::shared_ptr<T>, shared_rptr<T>>
+shared_rptr_fetch(const shared_rptr<T> &rptr) {
+  if (auto obj = rptr.get_shared_ptr())
+    return std::make_tuple(std::move(obj), shared_rptr<T>());
+  return std::make_tuple(std::shared_ptr<T>(), rptr.mgr->get_forward());
 }
 } // namespace detail
 
@@ -248,9 +438,20 @@ qthread::future<std::shared_ptr<T>>
 make_local_shared_ptr(const shared_rptr<T> &rptr) {
   cxx_assert(bool(rptr));
   if (rptr.local())
-    return qthread::make_ready_future(detail::shared_rptr_get_shared_ptr(rptr));
-  return async(rlaunch::async | rlaunch::deferred, rptr.get_proc(),
-               detail::shared_rptr_get_shared_ptr<T>, rptr);
+    if (auto obj = rptr.get_shared_ptr())
+      return qthread::make_ready_future(std::move(obj));
+  // The manager that refers to the process we ask
+  const auto *mgr = &rptr.mgr->resolve();
+  return async(rlaunch::async | rlaunch::deferred, mgr->get_proc(),
+               detail::shared_rptr_fetch<T>, rptr)
+      .then([rptr, mgr](auto fres) {
+        auto res = fres.get();
+        if (bool(std::get<0>(res)))
+          return std::move(std::get<0>(res));
+        // The object has migrated; remember its new owner
+        mgr->set_redirect(std::get<1>(res));
+        return make_local_shared_ptr(rptr).get();
+      });
 }
 } // namespace funhpc
 
@@ -1,9 +1,15 @@
 #include <funhpc/async.hpp>
 #include <funhpc/shared_rptr.hpp>
 
+#include <qthread/thread.hpp>
+
 #include <cereal/access.hpp>
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <memory>
+#include <vector>
+
 using namespace funhpc;
 
 namespace {
@@ -97,3 +103,53 @@ TEST(funhpc_shared_rptr, get) {
   async(rlaunch::sync, 1 % size(), check<int (*)(int)>, pf, *pf);
   async(rlaunch::sync, 1 % size(), check<shared_rptr<int>>, pp, *pp);
 }
+
+namespace {
+// Forward a reference through a chain of processes
+int forward(shared_rptr<int> p, int hops) {
+  if (hops == 0)
+    return *make_local_shared_ptr(p).get();
+  return async(rlaunch::sync, (rank() + 1) % size(), forward, p, hops - 1)
+      .get();
+}
+} // namespace
+
+TEST(funhpc_shared_rptr, forward) {
+  auto pi = make_shared_rptr<int>(1);
+  std::vector<qthread::future<int>> fs;
+  for (int i = 0; i < 10; ++i)
+    fs.push_back(async(rlaunch::async, i % size(), forward, pi, 3));
+  for (auto &f : fs)
+    EXPECT_EQ(1, f.get());
+  // Forward often enough to exhaust the weight, so that references
+  // become indirect
+  EXPECT_EQ(1, forward(pi, 30));
+}
+
+namespace {
+void check_one(shared_rptr<int> p) {
+  EXPECT_EQ(1, *make_local_shared_ptr(p).get());
+}
+void broadcast_one(shared_rptr<int> p) { async_all(check_one, p).get(); }
+} // namespace
+
+TEST(funhpc_shared_rptr, broadcast) {
+  // A broadcast is deserialized on each destination, and each copy
+  // returns the weight it received
+  auto pi = make_shared_rptr<int>(1);
+  std::weak_ptr<int> wi = pi.get_shared_ptr();
+  for (int i = 0; i < 3; ++i)
+    async_all(check_one, pi).get();
+  // Broadcast from a remote reference, which splits its own weight
+  async(rlaunch::sync, 1 % size(), broadcast_one, pi).get();
+  qthread::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_FALSE(wi.expired());
+  EXPECT_EQ(1, *pi);
+  // Once all weight has been returned, the object is freed
+  pi.reset();
+  auto t0 = std::chrono::steady_clock::now();
+  while (!wi.expired() &&
+         std::chrono::steady_clock::now() - t0 < std::chrono::seconds(10))
+    qthread::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_TRUE(wi.expired());
+}
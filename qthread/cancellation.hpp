@@ -0,0 +1,159 @@
+#ifndef QTHREAD_CANCELLATION_HPP
+#define QTHREAD_CANCELLATION_HPP
+
+#include <cxx/cassert.hpp>
+#include <cxx/invoke.hpp>
+#include <qthread/future.hpp>
+#include <qthread/mutex.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace qthread {
+
+// cancellation_token //////////////////////////////////////////////////////////
+
+// Cooperative cancellation: A token is shared between the code that
+// launches a (speculative) computation and the tasks that perform it.
+// Tasks launched with a token are skipped if the token has been
+// cancelled before they start; running tasks can poll cancelled() and
+// return early.
+
+namespace detail {
+struct cancellation_state {
+  std::atomic<bool> cancelled{false};
+  bool cancel_on_drop{false};
+
+  // Set by funhpc when the token is sent to another process; used to
+  // propagate cancellation requests to remote copies
+  mutex mtx;
+  std::ptrdiff_t origin{-1};
+  std::uint64_t id{0};
+  std::function<void()> on_cancel;
+};
+} // namespace detail
+
+class cancellation_token {
+  std::shared_ptr<detail::cancellation_state> state;
+
+public:
+  cancellation_token()
+      : state(std::make_shared<detail::cancellation_state>()) {}
+  // If cancel_on_drop is set, dropping the last reference to an
+  // unready future that was launched with this token requests
+  // cancellation
+  explicit cancellation_token(bool cancel_on_drop) : cancellation_token() {
+    state->cancel_on_drop = cancel_on_drop;
+  }
+
+  // non-standard
+  explicit cancellation_token(
+      const std::shared_ptr<detail::cancellation_state> &state)
+      : state(state) {}
+  const std::shared_ptr<detail::cancellation_state> &get_state() const {
+    return state;
+  }
+
+  void swap(cancellation_token &other) noexcept { state.swap(other.state); }
+
+  bool cancelled() const noexcept {
+    return state->cancelled.load(std::memory_order_relaxed);
+  }
+  bool cancel_on_drop() const noexcept { return state->cancel_on_drop; }
+
+  void request_cancel() const {
+    if (state->cancelled.exchange(true))
+      return;
+    std::function<void()> on_cancel;
+    {
+      lock_guard<mutex> g(state->mtx);
+      on_cancel = state->on_cancel;
+    }
+    if (on_cancel)
+      on_cancel();
+  }
+
+  bool operator==(const cancellation_token &other) const noexcept {
+    return state == other.state;
+  }
+  bool operator!=(const cancellation_token &other) const noexcept {
+    return !(*this == other);
+  }
+};
+inline void swap(cancellation_token &lhs, cancellation_token &rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+namespace detail {
+// Call a function unless the token has been cancelled; a skipped task
+// returns a value-initialized result
+template <typename R> struct skip_if_cancelled : std::tuple<> {
+  template <typename F, typename... Args>
+  R operator()(const cancellation_token &token, F &&f, Args &&... args) const {
+    if (token.cancelled())
+      return R();
+    return cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...);
+  }
+};
+template <> struct skip_if_cancelled<void> : std::tuple<> {
+  template <typename F, typename... Args>
+  void operator()(const cancellation_token &token, F &&f,
+                  Args &&... args) const {
+    if (token.cancelled())
+      return;
+    cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...);
+  }
+};
+
+// Wrap a future so that the token is cancelled when the last
+// reference to the (unready) future is dropped. The producer (e.g. a
+// promise) holds the original shared state, so that we need a
+// separate reference count for the consumers.
+template <typename R>
+future<R> cancel_on_drop(future<R> &&fres, const cancellation_token &token) {
+  if (!fres.valid())
+    return std::move(fres);
+  auto state = get_shared_state(std::move(fres));
+  auto ptr = state.get();
+  return make_future_with_shared_state(std::shared_ptr<shared_state<R>>(
+      ptr, [state = std::move(state), token](auto *) {
+        if (!state->ready())
+          token.request_cancel();
+      }));
+}
+} // namespace detail
+
+// async ///////////////////////////////////////////////////////////////////////
+
+template <typename F, typename... Args,
+          typename R = std::decay_t<
+              cxx::invoke_of_t<std::decay_t<F>, std::decay_t<Args>...>>>
+future<R> async(launch policy, const cancellation_token &token, F &&f,
+                Args &&... args) {
+  static_assert(std::is_void<R>::value ||
+                    std::is_default_constructible<R>::value,
+                "Cancellable tasks need to be able to return a "
+                "value-initialized result");
+  if (token.cancelled()) {
+    if (detail::decode_policy(policy) == launch::detached)
+      return future<R>();
+    return detail::async_make_ready_future([]() { return R(); });
+  }
+  auto fres = async(policy, detail::skip_if_cancelled<R>(), token,
+                    std::forward<F>(f), std::forward<Args>(args)...);
+  if (token.cancel_on_drop())
+    return detail::cancel_on_drop(std::move(fres), token);
+  return fres;
+}
+} // namespace qthread
+
+#define QTHREAD_CANCELLATION_HPP_DONE
+#endif // #ifdef QTHREAD_CANCELLATION_HPP
+#ifndef QTHREAD_CANCELLATION_HPP_DONE
+#error "Cyclic include dependency"
+#endif
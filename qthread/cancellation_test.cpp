@@ -0,0 +1,86 @@
+#include <qthread/cancellation.hpp>
+#include <qthread/thread.hpp>
+
+#include <gtest/gtest.h>
+#include <qthread.h>
+
+#include <atomic>
+
+using namespace qthread;
+
+namespace {
+int fi(int x) { return x; }
+
+int wait_for_cancel(cancellation_token token, std::atomic<bool> *started) {
+  *started = true;
+  while (!token.cancelled())
+    this_thread::yield();
+  return 1;
+}
+} // namespace
+
+TEST(qthread_cancellation, token) {
+  qthread_initialize();
+
+  cancellation_token t0;
+  EXPECT_FALSE(t0.cancelled());
+  EXPECT_FALSE(t0.cancel_on_drop());
+  auto t1 = t0;
+  EXPECT_EQ(t0, t1);
+  cancellation_token t2;
+  EXPECT_NE(t0, t2);
+  t1.request_cancel();
+  EXPECT_TRUE(t0.cancelled());
+  EXPECT_TRUE(t1.cancelled());
+  EXPECT_FALSE(t2.cancelled());
+  t1.request_cancel();
+  EXPECT_TRUE(t1.cancelled());
+
+  cancellation_token t3(true);
+  EXPECT_TRUE(t3.cancel_on_drop());
+}
+
+TEST(qthread_cancellation, skip) {
+  cancellation_token token;
+  auto f0 = async(launch::async, token, fi, 1);
+  EXPECT_EQ(1, f0.get());
+  token.request_cancel();
+  std::atomic<int> count{0};
+  auto f1 = async(launch::async, token, [&]() { return ++count; });
+  EXPECT_EQ(0, f1.get());
+  auto f2 = async(launch::deferred, token, [&]() { ++count; });
+  f2.get();
+  auto f3 = async(launch::detached, token, [&]() { ++count; });
+  EXPECT_FALSE(f3.valid());
+  EXPECT_EQ(0, count);
+}
+
+TEST(qthread_cancellation, poll) {
+  cancellation_token token;
+  std::atomic<bool> started{false};
+  auto f = async(launch::async, token, wait_for_cancel, token, &started);
+  while (!started)
+    this_thread::yield();
+  EXPECT_FALSE(f.ready());
+  token.request_cancel();
+  EXPECT_EQ(1, f.get());
+}
+
+TEST(qthread_cancellation, drop) {
+  cancellation_token token(true);
+  std::atomic<bool> started{false};
+  {
+    auto f = async(launch::async, token, wait_for_cancel, token, &started);
+    auto sf = f.share();
+    auto sf2 = sf;
+  }
+  // Dropping the future requested cancellation, and the task finishes
+  while (!token.cancelled())
+    this_thread::yield();
+  EXPECT_TRUE(token.cancelled());
+
+  cancellation_token token2(true);
+  auto f2 = async(launch::async, token2, fi, 1);
+  EXPECT_EQ(1, f2.get());
+  EXPECT_FALSE(token2.cancelled());
+}
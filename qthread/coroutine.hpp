@@ -0,0 +1,157 @@
+#ifndef QTHREAD_COROUTINE_HPP
+#define QTHREAD_COROUTINE_HPP
+
+// C++20 coroutine support: futures can be awaited with co_await, and
+// coroutines can return qthread::task<T>. A suspended coroutine does
+// not occupy a qthread (nor its stack); it is resumed in a new qthread
+// when the awaited future becomes ready.
+//
+// This header is empty unless the compiler supports coroutines.
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L &&       \
+    __has_include(<coroutine>)
+#define QTHREAD_HAVE_COROUTINES 1
+#endif
+
+#ifdef QTHREAD_HAVE_COROUTINES
+
+#include <qthread/future.hpp>
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+namespace qthread {
+
+// awaiters ////////////////////////////////////////////////////////////////////
+
+namespace detail {
+// Base class for awaiting a future or shared_future
+template <typename F> struct future_awaiter : continuation {
+  F fut;
+  std::coroutine_handle<> handle;
+
+  future_awaiter(F &&fut) : fut(std::move(fut)) {}
+
+  static void resume(continuation *cont) {
+    auto handle = static_cast<future_awaiter *>(cont)->handle;
+    // Don't resume the coroutine in the thread that made the future
+    // ready; that thread may be holding locks or be latency-sensitive
+    async(launch::detached, [handle]() { handle.resume(); });
+  }
+
+  bool await_ready() const { return fut.ready(); }
+  bool await_suspend(std::coroutine_handle<> h) {
+    handle = h;
+    run = resume;
+    return fut.add_continuation(this);
+  }
+};
+} // namespace detail
+
+// Awaiting a future consumes it, as get() would; lvalue futures need to
+// be moved (or shared) explicitly
+template <typename T> auto operator co_await(future<T> &&fut) {
+  struct awaiter : detail::future_awaiter<future<T>> {
+    using detail::future_awaiter<future<T>>::future_awaiter;
+    decltype(auto) await_resume() { return this->fut.get(); }
+  };
+  cxx_assert(fut.valid());
+  return awaiter(std::move(fut));
+}
+
+template <typename T> auto operator co_await(const shared_future<T> &fut) {
+  struct awaiter : detail::future_awaiter<shared_future<T>> {
+    using detail::future_awaiter<shared_future<T>>::future_awaiter;
+    decltype(auto) await_resume() const { return this->fut.get(); }
+  };
+  cxx_assert(fut.valid());
+  return awaiter(shared_future<T>(fut));
+}
+
+// task ////////////////////////////////////////////////////////////////////////
+
+// The return type of a coroutine. The coroutine starts running
+// immediately in the calling thread; its result is available via a
+// future.
+template <typename T> class task;
+
+namespace detail {
+template <typename T> struct task_promise_base {
+  promise<T> result;
+
+  std::suspend_never initial_suspend() const noexcept { return {}; }
+  // The coroutine frame is destroyed when the coroutine finishes
+  std::suspend_never final_suspend() const noexcept { return {}; }
+  void unhandled_exception() const noexcept { std::terminate(); }
+};
+
+template <typename T> struct task_promise : task_promise_base<T> {
+  task<T> get_return_object();
+  template <typename U = T,
+            std::enable_if_t<std::is_convertible<U, T>::value> * = nullptr>
+  void return_value(U &&value) {
+    this->result.set_value(std::forward<U>(value));
+  }
+};
+template <> struct task_promise<void> : task_promise_base<void> {
+  task<void> get_return_object();
+  void return_void() { this->result.set_value(); }
+};
+} // namespace detail
+
+template <typename T> class task {
+  future<T> fut;
+
+public:
+  typedef detail::task_promise<T> promise_type;
+
+  task() noexcept {}
+  task(future<T> &&fut) noexcept : fut(std::move(fut)) {}
+  task(task &&other) noexcept = default;
+  task(const task &) = delete;
+  task &operator=(task &&other) noexcept = default;
+  task &operator=(const task &) = delete;
+
+  void swap(task &other) noexcept { fut.swap(other.fut); }
+
+  bool valid() const noexcept { return fut.valid(); }
+  bool ready() const { return fut.ready(); }
+  void wait() const { fut.wait(); }
+  decltype(auto) get() { return fut.get(); }
+
+  future<T> get_future() {
+    cxx_assert(valid());
+    return std::move(fut);
+  }
+  shared_future<T> share() {
+    cxx_assert(valid());
+    return fut.share();
+  }
+
+  friend auto operator co_await(task &&t) {
+    return operator co_await(std::move(t.fut));
+  }
+};
+template <typename T> void swap(task<T> &lhs, task<T> &rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+namespace detail {
+template <typename T> task<T> task_promise<T>::get_return_object() {
+  return task<T>(this->result.get_future());
+}
+inline task<void> task_promise<void>::get_return_object() {
+  return task<void>(this->result.get_future());
+}
+} // namespace detail
+} // namespace qthread
+
+#endif // #ifdef QTHREAD_HAVE_COROUTINES
+
+#define QTHREAD_COROUTINE_HPP_DONE
+#endif // #ifdef QTHREAD_COROUTINE_HPP
+#ifndef QTHREAD_COROUTINE_HPP_DONE
+#error "Cyclic include dependency"
+#endif
@@ -0,0 +1,97 @@
+#include <qthread/coroutine.hpp>
+
+#ifdef QTHREAD_HAVE_COROUTINES
+
+#include <qthread/future.hpp>
+#include <qthread/thread.hpp>
+
+#include <gtest/gtest.h>
+#include <qthread.h>
+
+#include <chrono>
+
+using namespace qthread;
+
+namespace {
+task<int> add_one(future<int> f) { co_return co_await std::move(f) + 1; }
+
+task<int> add(shared_future<int> f, shared_future<int> g) {
+  auto x = co_await f;
+  auto y = co_await g;
+  co_return x + y;
+}
+
+task<void> set_flag(future<void> f, bool *flag) {
+  co_await std::move(f);
+  *flag = true;
+}
+
+template <typename F>
+concept co_awaitable =
+    requires(F &&f) { operator co_await(std::forward<F>(f)); };
+
+task<int> fib(int n) {
+  if (n < 2)
+    co_return n;
+  auto f1 = async(launch::async, [n]() { return fib(n - 1).get(); });
+  auto f2 = fib(n - 2);
+  co_return co_await std::move(f1) + co_await std::move(f2);
+}
+} // namespace
+
+TEST(qthread_coroutine, ready) {
+  qthread_initialize();
+
+  auto t = add_one(make_ready_future(1));
+  EXPECT_TRUE(t.ready());
+  EXPECT_EQ(2, t.get());
+}
+
+TEST(qthread_coroutine, suspend) {
+  promise<int> p;
+  auto t = add_one(p.get_future());
+  EXPECT_FALSE(t.ready());
+  p.set_value(1);
+  EXPECT_EQ(2, t.get());
+
+  promise<int> p1, p2;
+  auto t2 = add(p1.get_future().share(), p2.get_future().share());
+  p2.set_value(2);
+  this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(t2.ready());
+  p1.set_value(1);
+  EXPECT_EQ(3, t2.get_future().get());
+}
+
+TEST(qthread_coroutine, void) {
+  promise<void> p;
+  bool flag = false;
+  auto t = set_flag(p.get_future(), &flag);
+  EXPECT_FALSE(flag);
+  p.set_value();
+  t.wait();
+  EXPECT_TRUE(flag);
+}
+
+TEST(qthread_coroutine, deferred) {
+  auto t = add_one(async(launch::deferred, []() { return 1; }));
+  EXPECT_EQ(2, t.get());
+}
+
+TEST(qthread_coroutine, recursive) { EXPECT_EQ(55, fib(10).get()); }
+
+TEST(qthread_coroutine, lvalue) {
+  // Plain futures are consumed by co_await and need to be moved
+  static_assert(!co_awaitable<future<int> &>);
+  static_assert(co_awaitable<future<int>>);
+  static_assert(co_awaitable<shared_future<int> &>);
+
+  // Awaiting a shared future leaves it valid
+  auto f = make_ready_future(1).share();
+  auto t = add(f, f);
+  EXPECT_EQ(2, t.get());
+  EXPECT_TRUE(f.valid());
+  EXPECT_EQ(1, f.get());
+}
+
+#endif // #ifdef QTHREAD_HAVE_COROUTINES
@@ -19,6 +19,20 @@ namespace qthread {
 // shared_state ////////////////////////////////////////////////////////////////
 
 namespace detail {
+// A continuation that is run by whoever makes a shared state ready.
+// Continuations are intrusive so that they can live e.g. in a
+// coroutine frame; they must stay alive until they have been run.
+struct continuation {
+  continuation *next;
+  void (*run)(continuation *);
+};
+
+// Marks a continuation list that has already been run
+inline continuation *continuations_done() {
+  static continuation done;
+  return &done;
+}
+
 template <typename T> class shared_state {
   // id_t<T> is T, but if used in a function template, the compiler
   // cannot deduce T from it
@@ -31,6 +45,9 @@ template <typename T> class shared_state {
   std::atomic<bool> has_trigger;
   cxx::task<T> trigger;
 
+  // continuations to be run when the value has been set
+  std::atomic<continuation *> continuations{nullptr};
+
   // void is stored as empty tuple, references are stored as pointers
   std::conditional_t<std::is_void<T>::value, std::tuple<>,
                      std::conditional_t<std::is_reference<T>::value,
@@ -49,6 +66,17 @@ template <typename T> class shared_state {
     set_value();
   }
 
+  void run_continuations() {
+    auto cont =
+        continuations.exchange(continuations_done(), std::memory_order_acq_rel);
+    while (cont) {
+      // Note: cont may be destructed as soon as it has been run
+      auto next = cont->next;
+      cont->run(cont);
+      cont = next;
+    }
+  }
+
 public:
   shared_state() : has_trigger(false) { is_ready.empty(); }
   ~shared_state() { is_ready.fill(); }
@@ -84,14 +112,35 @@ public:
 
   bool ready() const noexcept { return is_ready.status(); }
 
-  void wait() {
+  // Run the trigger (if any), but do not wait
+  void force() {
     if (bool(has_trigger) && has_trigger.exchange(false)) {
       run_trigger();
       trigger = {};
     }
+  }
+
+  void wait() {
+    force();
     is_ready.readFF();
   }
 
+  // Register a continuation. Returns false (and does not register the
+  // continuation) if the value is already available.
+  bool add_continuation(continuation *cont) {
+    if (ready())
+      return false;
+    auto head = continuations.load(std::memory_order_acquire);
+    do {
+      if (head == continuations_done())
+        return false;
+      cont->next = head;
+    } while (!continuations.compare_exchange_weak(head, cont,
+                                                  std::memory_order_release,
+                                                  std::memory_order_acquire));
+    return true;
+  }
+
   template <typename U = T,
             std::enable_if_t<!std::is_void<U>::value &&
                              !std::is_reference<U>::value> * = nullptr>
@@ -99,6 +148,7 @@ public:
     cxx_assert(!ready());
     value = std::move(value_); /*TODO: memory order */
     is_ready.fill();
+    run_continuations();
   }
   template <typename U = T,
             std::enable_if_t<!std::is_void<U>::value &&
@@ -108,6 +158,7 @@ public:
     cxx_assert(!ready());
     value = value_; /*TODO: memory order */
     is_ready.fill();
+    run_continuations();
   }
   template <typename U = T,
             std::enable_if_t<std::is_reference<U>::value> * = nullptr>
@@ -115,12 +166,14 @@ public:
     cxx_assert(!ready());
     value = &value_; /*TODO: memory order */
     is_ready.fill();
+    run_continuations();
   }
   template <typename U = T,
             std::enable_if_t<std::is_void<U>::value> * = nullptr>
   void set_value() {
     cxx_assert(!ready());
     is_ready.fill();
+    run_continuations();
   }
 
   void set_exception() { throw("not implemented"); }
@@ -180,7 +233,9 @@ namespace detail {
 template <typename T>
 future<T> make_future_with_shared_state(
     std::shared_ptr<detail::shared_state<T>> &&shared_state);
-}
+template <typename T>
+std::shared_ptr<detail::shared_state<T>> get_shared_state(future<T> &&ftr);
+} // namespace detail
 
 template <typename T> class future {
   template <typename U> friend class future;
@@ -189,6 +244,8 @@ template <typename T> class future {
 
   friend future<T> detail::make_future_with_shared_state<T>(
       std::shared_ptr<detail::shared_state<T>> &&shared_state);
+  friend std::shared_ptr<detail::shared_state<T>>
+  detail::get_shared_state<T>(future<T> &&ftr);
 
   typedef T element_type;
 
@@ -260,6 +317,15 @@ public:
     shared_state->wait();
   }
 
+  // Register a continuation that is run as soon as the future becomes
+  // ready. Returns false if the future is already ready, in which case
+  // the continuation is not registered. Deferred futures are forced.
+  bool add_continuation(detail::continuation *cont) const {
+    cxx_assert(valid());
+    shared_state->force();
+    return shared_state->add_continuation(cont);
+  }
+
   template <typename F, typename R = std::decay_t<
                             cxx::invoke_of_t<std::decay_t<F>, future>>>
   future<R> then(launch policy, F &&cont);
@@ -286,6 +352,10 @@ future<T> make_future_with_shared_state(
     std::shared_ptr<detail::shared_state<T>> &&shared_state) {
   return future<T>(std::move(shared_state));
 }
+template <typename T>
+std::shared_ptr<detail::shared_state<T>> get_shared_state(future<T> &&ftr) {
+  return std::move(ftr.shared_state);
+}
 } // namespace detail
 
 // make_ready_future ///////////////////////////////////////////////////////////
@@ -361,6 +431,9 @@ public:
   }
 
   bool valid() const noexcept { return bool(shared_state); }
+  // Identifies the shared state; copies of a shared_future have the
+  // same id
+  const void *get_id() const noexcept { return shared_state.get(); }
 
   bool ready() const noexcept {
     cxx_assert(valid());
@@ -372,6 +445,15 @@ public:
     shared_state->wait();
   }
 
+  // Register a continuation that is run as soon as the future becomes
+  // ready. Returns false if the future is already ready, in which case
+  // the continuation is not registered. Deferred futures are forced.
+  bool add_continuation(detail::continuation *cont) const {
+    cxx_assert(valid());
+    shared_state->force();
+    return shared_state->add_continuation(cont);
+  }
+
   template <typename F, typename R = std::decay_t<
                             cxx::invoke_of_t<std::decay_t<F>, shared_future>>>
   future<R> then(launch policy, F &&cont) const;
@@ -537,6 +619,56 @@ void swap(packaged_task<R(Args...)> &lhs,
   lhs.swap(rhs);
 }
 
+// stack_size //////////////////////////////////////////////////////////////////
+
+// Threads usually run on the (small) stack that Qthreads provides;
+// threads that need deep recursion or large automatic arrays can ask
+// for a large stack instead. Qthreads has no per-thread stack size, so
+// these run on a pool of OS threads with large stacks (see
+// FUNHPC_LARGE_STACK_SIZE and FUNHPC_LARGE_STACK_IDLE).
+enum class stack_size : unsigned char { normal, large };
+
+// Qthreads groups its worker threads into shepherds, which are usually
+// mapped to parts of the machine such as sockets. Threads can be
+// started on a particular shepherd instead of letting Qthreads choose.
+struct shepherd_t {
+  unsigned id;
+};
+
+namespace detail {
+// Start a function on a thread with a large stack (defined in
+// thread.cpp)
+void start_on_large_stack(void (*f)(void *), void *arg);
+// Run a function on a thread with a large stack, and wait until it
+// returns (defined in thread.cpp)
+void run_on_large_stack(void (*f)(void *), void *arg);
+
+// The number of threads that were started and have not finished yet
+// (defined in thread.cpp)
+extern std::atomic<std::ptrdiff_t> live_threads;
+struct live_thread_guard {
+  live_thread_guard() = default;
+  live_thread_guard(const live_thread_guard &) = delete;
+  live_thread_guard &operator=(const live_thread_guard &) = delete;
+  ~live_thread_guard() { --live_threads; }
+};
+
+template <typename F> void call_on_large_stack(F &&f) {
+  typedef std::remove_reference_t<F> FR;
+  run_on_large_stack([](void *arg) { (*static_cast<FR *>(arg))(); }, &f);
+}
+
+// Call a function on a large stack, ignoring its result
+struct large_stack_call : std::tuple<> {
+  template <typename F, typename... Args>
+  void operator()(F &&f, Args &&... args) const {
+    call_on_large_stack([&]() {
+      cxx::invoke(std::forward<F>(f), std::forward<Args>(args)...);
+    });
+  }
+};
+} // namespace detail
+
 // async_thread ////////////////////////////////////////////////////////////////
 
 namespace detail {
@@ -560,35 +692,60 @@ template <typename R> class async_thread {
     }
   };
   static aligned_t run_thread(void *args_) {
+    live_thread_guard g;
     auto thread_args = (thread_args_t *)args_;
     thread_args->run();
     delete thread_args;
     return 1;
   }
 
-public:
-  typedef unsigned int id;
-
-  async_thread() noexcept {}
-  async_thread(async_thread &&other) noexcept : async_thread() { swap(other); }
-
-  template <class F, class... Args,
-            std::enable_if_t<!std::is_same<std::decay_t<F>,
-                                           async_thread>::value> * = nullptr>
-  explicit async_thread(F &&f, Args &&... args) {
+  template <class F, class... Args>
+  void start(stack_size stack, int shep, F &&f, Args &&... args) {
     auto thread_args = new thread_args_t;
     thread_args->task =
         cxx::task<R>(std::forward<F>(f), std::forward<Args>(args)...);
     result = thread_args->result.get_future();
+    ++live_threads;
     // TODO: Add a variant that uses qthread_spawn with preconditions
     // to start the thread in a waiting state
     // TODO: Use this for future::then
     // TODO: Use this for launch::deferred as well, and omit the
     // current mechanism?
-    auto ierr = qthread_fork_syncvar(run_thread, thread_args, nullptr);
+    if (stack == stack_size::large)
+      return start_on_large_stack([](void *args) { run_thread(args); },
+                                  thread_args);
+    auto ierr =
+        shep < 0 ? qthread_fork_syncvar(run_thread, thread_args, nullptr)
+                 : qthread_fork_syncvar_to(run_thread, thread_args, nullptr,
+                                           shep);
     cxx_assert(!ierr);
   }
 
+public:
+  typedef unsigned int id;
+
+  async_thread() noexcept {}
+  async_thread(async_thread &&other) noexcept : async_thread() { swap(other); }
+
+  template <class F, class... Args,
+            std::enable_if_t<
+                !std::is_same<std::decay_t<F>, async_thread>::value &&
+                !std::is_same<std::decay_t<F>, stack_size>::value> * = nullptr>
+  explicit async_thread(F &&f, Args &&... args)
+      : async_thread(stack_size::normal, std::forward<F>(f),
+                     std::forward<Args>(args)...) {}
+
+  // non-standard
+  template <class F, class... Args>
+  async_thread(stack_size stack, F &&f, Args &&... args) {
+    start(stack, -1, std::forward<F>(f), std::forward<Args>(args)...);
+  }
+  // non-standard
+  template <class F, class... Args>
+  async_thread(stack_size stack, shepherd_t shep, F &&f, Args &&... args) {
+    start(stack, shep.id, std::forward<F>(f), std::forward<Args>(args)...);
+  }
+
   async_thread(const async_thread &) = delete;
 
   ~async_thread() { cxx_assert(!joinable()); }
@@ -634,6 +791,8 @@ enum class launch : unsigned {
   deferred = 2,
   sync = 4,
   detached = 8,
+  // modifier: run on a large stack (ignored for deferred and sync)
+  large_stack = 16,
 };
 
 inline constexpr launch operator~(launch a) {
@@ -660,6 +819,7 @@ inline launch &operator^=(launch &a, launch b) { return a = a ^ b; }
 namespace detail {
 // Convert bitmask to a specific policy
 /*gcc constexpr*/ inline launch decode_policy(launch policy) {
+  policy &= ~launch::large_stack;
   if ((policy | launch::async) == launch::async)
     return launch::async;
   if ((policy | launch::deferred) == launch::deferred)
@@ -670,6 +830,12 @@ namespace detail {
     return launch::detached;
   return launch::async;
 }
+
+constexpr stack_size decode_stack_size(launch policy) {
+  return (policy & launch::large_stack) == launch::large_stack
+             ? stack_size::large
+             : stack_size::normal;
+}
 } // namespace detail
 
 // async ///////////////////////////////////////////////////////////////////////
@@ -701,7 +867,8 @@ template <typename F, typename... Args,
 future<R> async(launch policy, F &&f, Args &&... args) {
   switch (detail::decode_policy(policy)) {
   case launch::async:
-    return detail::async_thread<R>(std::forward<F>(f),
+    return detail::async_thread<R>(detail::decode_stack_size(policy),
+                                   std::forward<F>(f),
                                    std::forward<Args>(args)...)
         .detach_get_future();
   case launch::deferred:
@@ -712,9 +879,13 @@ future<R> async(launch policy, F &&f, Args &&... args) {
     return detail::async_make_ready_future(std::forward<F>(f),
                                            std::forward<Args>(args)...);
   case launch::detached:
-    detail::async_thread<R>(std::forward<F>(f), std::forward<Args>(args)...)
+    detail::async_thread<R>(detail::decode_stack_size(policy),
+                            std::forward<F>(f), std::forward<Args>(args)...)
         .detach();
     return future<R>();
+  case launch::large_stack:
+    // masked out by decode_policy
+    break;
   }
   __builtin_unreachable();
 }
@@ -803,6 +974,55 @@ template <typename U, std::enable_if_t<std::is_same<U, T>::value &&
 future<typename U::element_type> shared_future<T>::unwrap() const {
   return async([ftr = *this]() { return ftr.get().get(); });
 }
+
+// when_ready //////////////////////////////////////////////////////////////////
+
+namespace detail {
+template <typename FT, typename F>
+struct when_ready_continuation : continuation {
+  FT ftr;
+  F f;
+  when_ready_continuation(FT &&ftr, F &&f)
+      : ftr(std::move(ftr)), f(std::move(f)) {
+    run = run_f;
+  }
+  static void run_f(continuation *cont) {
+    auto self = static_cast<when_ready_continuation *>(cont);
+    cxx::invoke(self->f, self->ftr);
+    delete self;
+  }
+};
+
+// Call f(ftr) once the future is ready, without waiting for it in a
+// thread. f runs in the thread that makes the future ready, or right
+// away if the future is ready already, and should thus be short.
+template <typename FT, typename F> void when_ready(FT ftr, F f) {
+  auto cont = new when_ready_continuation<FT, F>(std::move(ftr), std::move(f));
+  if (!cont->ftr.add_continuation(cont))
+    cont->run(cont);
+}
+
+template <typename T>
+void set_promise(promise<T> &p, const shared_future<T> &ftr) {
+  p.set_value(ftr.get());
+}
+inline void set_promise(promise<void> &p, const shared_future<void> &ftr) {
+  ftr.get();
+  p.set_value();
+}
+
+// A future for the value of a shared future, without waiting for it in
+// a thread
+template <typename T> future<T> unshare(shared_future<T> ftr) {
+  promise<T> p;
+  auto r = p.get_future();
+  when_ready(std::move(ftr),
+             [p = std::move(p)](const shared_future<T> &ftr) mutable {
+               set_promise(p, ftr);
+             });
+  return r;
+}
+} // namespace detail
 } // namespace qthread
 
 #define QTHREAD_FUTURE_HPP_DONE
@@ -1,12 +1,208 @@
 #include "thread.hpp"
 
+#include <cxx/cassert.hpp>
+#include <cxx/cstdlib.hpp>
 #include <qthread/future.hpp>
 
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace qthread {
 
+namespace detail {
+std::atomic<std::ptrdiff_t> live_threads{0};
+}
+
+// large stacks ////////////////////////////////////////////////////////////////
+
+namespace detail {
+namespace {
+#ifdef __linux__
+// The CPUs of the process, captured before Qthreads binds its workers.
+// Large-stack threads may run on any of these, instead of inheriting
+// the binding of the worker that created them.
+struct process_cpus_t {
+  cpu_set_t cpus;
+  bool valid;
+  process_cpus_t() { valid = !sched_getaffinity(0, sizeof cpus, &cpus); }
+};
+const process_cpus_t process_cpus;
+#endif
+
+// Qthreads gives all its threads the same (small) stack. Tasks that
+// need a large stack run on a separate pool of OS threads with large
+// stacks instead. A thread is started when a task finds no idle
+// thread, and exits when it would be idle while max_idle threads are
+// already idle.
+class large_stack_pool {
+  typedef std::pair<void (*)(void *), void *> task_t;
+
+  std::size_t stack_size;
+  std::size_t max_idle;
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::deque<task_t> tasks;
+  std::size_t nidle{0};
+
+  static void *run_worker(void *pool) {
+    static_cast<large_stack_pool *>(pool)->worker();
+    return nullptr;
+  }
+
+  void worker() {
+    std::unique_lock<std::mutex> g(mtx);
+    for (;;) {
+      if (tasks.empty()) {
+        if (nidle >= max_idle)
+          return;
+        ++nidle;
+        cond.wait(g, [&]() { return !tasks.empty(); });
+        --nidle;
+      }
+      auto task = tasks.front();
+      tasks.pop_front();
+      g.unlock();
+      task.first(task.second);
+      g.lock();
+    }
+  }
+
+  void start_worker() {
+    pthread_attr_t attr;
+    auto ierr = pthread_attr_init(&attr);
+    cxx_assert(!ierr);
+    ierr = pthread_attr_setstacksize(&attr, stack_size);
+    cxx_assert(!ierr);
+    ierr = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    cxx_assert(!ierr);
+#ifdef __linux__
+    if (process_cpus.valid) {
+      ierr = pthread_attr_setaffinity_np(&attr, sizeof process_cpus.cpus,
+                                         &process_cpus.cpus);
+      cxx_assert(!ierr);
+    }
+#endif
+    pthread_t thread;
+    ierr = pthread_create(&thread, &attr, run_worker, this);
+    cxx_assert(!ierr);
+    pthread_attr_destroy(&attr);
+  }
+
+public:
+  large_stack_pool() {
+    auto size = cxx::envtol("FUNHPC_LARGE_STACK_SIZE", "8388608");
+    cxx_assert(size > 0);
+    stack_size = std::max(std::size_t(size), std::size_t(PTHREAD_STACK_MIN));
+    auto idle = cxx::envtol("FUNHPC_LARGE_STACK_IDLE", "4");
+    cxx_assert(idle >= 0);
+    max_idle = idle;
+  }
+
+  void start(void (*f)(void *), void *arg) {
+    bool need_worker;
+    {
+      std::lock_guard<std::mutex> g(mtx);
+      tasks.emplace_back(f, arg);
+      need_worker = tasks.size() > nidle;
+    }
+    if (need_worker)
+      start_worker();
+    else
+      cond.notify_one();
+  }
+};
+
+large_stack_pool &get_large_stack_pool() {
+  // Idle threads may still wait on the pool when the process exits
+  static auto *pool = new large_stack_pool;
+  return *pool;
+}
+
+struct large_stack_args_t {
+  void (*f)(void *);
+  void *arg;
+  promise<void> done;
+};
+} // namespace
+
+void start_on_large_stack(void (*f)(void *), void *arg) {
+  get_large_stack_pool().start(f, arg);
+}
+
+void run_on_large_stack(void (*f)(void *), void *arg) {
+  large_stack_args_t args{f, arg, promise<void>()};
+  auto done = args.done.get_future();
+  start_on_large_stack(
+      [](void *args_) {
+        auto args = static_cast<large_stack_args_t *>(args_);
+        args->f(args->arg);
+        // The caller may destruct args as soon as done is ready
+        auto done = std::move(args->done);
+        done.set_value();
+      },
+      &args);
+  // This blocks only the calling qthread, not its worker
+  done.wait();
+}
+} // namespace detail
+
+// domains /////////////////////////////////////////////////////////////////////
+
+namespace {
+// These are set up once at startup, before they are used concurrently
+std::vector<int> shepherd_domains;
+std::vector<std::vector<unsigned>> domain_shepherds;
+std::atomic<unsigned> next_domain_shepherd{0};
+memory_binder_t *memory_binder = nullptr;
+} // namespace
+
+void set_shepherd_domains(const std::vector<int> &shepherd_domains) {
+  qthread::shepherd_domains = shepherd_domains;
+  domain_shepherds.clear();
+  for (unsigned shep = 0; shep < shepherd_domains.size(); ++shep) {
+    const int domain = shepherd_domains[shep];
+    cxx_assert(domain >= 0);
+    if (domain >= int(domain_shepherds.size()))
+      domain_shepherds.resize(domain + 1);
+    domain_shepherds[domain].push_back(shep);
+  }
+  for (const auto &sheps : domain_shepherds)
+    cxx_assert(!sheps.empty());
+}
+
+int num_domains() { return std::max(std::size_t(1), domain_shepherds.size()); }
+
+int get_shepherd_domain(unsigned shep) {
+  if (shep >= shepherd_domains.size())
+    return 0;
+  return shepherd_domains[shep];
+}
+
+int get_domain_shepherd(int domain) {
+  if (domain_shepherds.empty())
+    return -1;
+  const auto &sheps =
+      domain_shepherds[cxx::div_floor(domain, num_domains()).rem];
+  return sheps[next_domain_shepherd++ % sheps.size()];
+}
+
+void set_memory_binder(memory_binder_t *binder) { memory_binder = binder; }
+
+bool bind_memory(const void *ptr, std::size_t size, int domain) {
+  if (!memory_binder)
+    return false;
+  return memory_binder(ptr, size, cxx::div_floor(domain, num_domains()).rem);
+}
+
 namespace all_threads {
 
 void run(const std::function<void()> &f) {
@@ -7,7 +7,10 @@
 #include <qthread/qthread.hpp>
 
 #include <chrono>
+#include <cstddef>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace qthread {
 
@@ -15,6 +18,34 @@ namespace qthread {
 
 typedef detail::async_thread<void> thread;
 
+// non-standard: The number of threads that were started and have not
+// finished yet, i.e. that are waiting to run, running, or blocked
+inline std::ptrdiff_t num_live_threads() { return detail::live_threads; }
+
+// domains /////////////////////////////////////////////////////////////////////
+
+// non-standard: Shepherds are grouped into locality domains, e.g. NUMA
+// nodes or shared L3 caches. The grouping is set up at startup (see
+// funhpc/hwloc.cpp); by default, all shepherds form a single domain.
+// Domains are numbered from 0 to num_domains()-1.
+
+void set_shepherd_domains(const std::vector<int> &shepherd_domains);
+int num_domains();
+int get_shepherd_domain(unsigned shep);
+// A shepherd in the domain (taken modulo num_domains()), cycling
+// through the domain's shepherds; -1 if there is no grouping
+int get_domain_shepherd(int domain);
+
+// non-standard: Memory can be bound to a locality domain, so that
+// e.g. the blocks of a nested container stay next to the workers that
+// update them. The binder is installed at startup (see
+// funhpc/hwloc.cpp); without one, bind_memory does nothing and returns
+// false.
+typedef bool memory_binder_t(const void *ptr, std::size_t size, int domain);
+void set_memory_binder(memory_binder_t *binder);
+// Bind a memory region to a domain (taken modulo num_domains())
+bool bind_memory(const void *ptr, std::size_t size, int domain);
+
 // this_thread /////////////////////////////////////////////////////////////////
 
 namespace this_thread {
@@ -22,6 +53,12 @@ inline thread::id get_id() { return qthread_id(); }
 
 inline thread::id get_worker_id() { return qthread_worker(nullptr); }
 
+// non-standard
+inline unsigned get_shepherd_id() { return qthread_shep(); }
+
+// non-standard
+inline int get_domain() { return get_shepherd_domain(get_shepherd_id()); }
+
 inline void yield() { qthread_yield(); }
 
 template <typename Rep, typename Period>
@@ -34,6 +71,25 @@ void sleep_for(const std::chrono::duration<Rep, Period> &duration) {
 }
 } // namespace this_thread
 
+// async_on ////////////////////////////////////////////////////////////////////
+
+// non-standard: Run a function on a worker in a locality domain
+// (taken modulo num_domains(), so that blocks can be numbered
+// round-robin)
+template <typename F, typename... Args,
+          typename R = std::decay_t<
+              cxx::invoke_of_t<std::decay_t<F>, std::decay_t<Args>...>>>
+future<R> async_on(int domain, F &&f, Args &&... args) {
+  const int shep = get_domain_shepherd(domain);
+  if (shep < 0)
+    return async(launch::async, std::forward<F>(f),
+                 std::forward<Args>(args)...);
+  return detail::async_thread<R>(stack_size::normal, shepherd_t{unsigned(shep)},
+                                 std::forward<F>(f),
+                                 std::forward<Args>(args)...)
+      .detach_get_future();
+}
+
 // all_threads /////////////////////////////////////////////////////////////////
 
 namespace all_threads {
@@ -4,6 +4,7 @@
 #include <qthread.h>
 
 #include <atomic>
+#include <vector>
 
 using namespace qthread;
 
@@ -65,3 +66,97 @@ TEST(qthread_thread, many) {
   this_thread::sleep_for(std::chrono::milliseconds(100));
   EXPECT_EQ(maxcount, counter);
 }
+
+namespace {
+// Use about 1 MByte of stack space
+int deep(int count) {
+  volatile char buffer[1024];
+  buffer[0] = char(count);
+  if (count == 0)
+    return buffer[0];
+  return deep(count - 1) + 1 + buffer[0] - char(count);
+}
+} // namespace
+
+TEST(qthread_thread, large_stack) {
+  int res = -1;
+  thread t(stack_size::large, [&]() { res = deep(1000); });
+  t.join();
+  EXPECT_EQ(1000, res);
+
+  auto f = async(launch::async | launch::large_stack, deep, 1000);
+  EXPECT_EQ(1000, f.get());
+
+  // Threads are reused
+  std::vector<future<int>> fs;
+  for (int i = 0; i < 10; ++i)
+    fs.push_back(async(launch::async | launch::large_stack, deep, 100 * i));
+  for (int i = 0; i < 10; ++i)
+    EXPECT_EQ(100 * i, fs[i].get());
+
+  // Large-stack threads may wait for each other
+  auto g = async(launch::async | launch::large_stack, []() {
+    return async(launch::async | launch::large_stack, deep, 1000).get();
+  });
+  EXPECT_EQ(1000, g.get());
+}
+
+TEST(qthread_thread, num_live_threads) {
+  // A thread counts itself, also when it runs on a large stack
+  auto f = async(launch::async, []() { return num_live_threads(); });
+  EXPECT_GE(f.get(), 1);
+  auto g = async(launch::async | launch::large_stack,
+                 []() { return num_live_threads(); });
+  EXPECT_GE(g.get(), 1);
+}
+
+TEST(qthread_thread, shepherd) {
+  const unsigned nsheps = qthread_num_shepherds();
+  std::vector<future<unsigned>> fs;
+  for (unsigned shep = 0; shep < nsheps; ++shep)
+    fs.push_back(detail::async_thread<unsigned>(
+                     stack_size::normal, shepherd_t{shep},
+                     []() { return this_thread::get_shepherd_id(); })
+                     .detach_get_future());
+  for (unsigned shep = 0; shep < nsheps; ++shep)
+    EXPECT_EQ(shep, fs[shep].get());
+}
+
+namespace {
+// Set up locality domains for a test, restoring the current ones
+// afterwards
+struct shepherd_domains_t {
+  std::vector<int> old_domains;
+  explicit shepherd_domains_t(const std::vector<int> &domains) {
+    for (unsigned shep = 0; shep < domains.size(); ++shep)
+      old_domains.push_back(get_shepherd_domain(shep));
+    set_shepherd_domains(domains);
+  }
+  ~shepherd_domains_t() { set_shepherd_domains(old_domains); }
+};
+
+int get_domain() { return this_thread::get_domain(); }
+} // namespace
+
+TEST(qthread_thread, async_on) {
+  const unsigned nsheps = qthread_num_shepherds();
+  {
+    // All shepherds in a single domain
+    shepherd_domains_t sd(std::vector<int>(nsheps, 0));
+    EXPECT_EQ(1, num_domains());
+    EXPECT_EQ(0, this_thread::get_domain());
+    for (int domain = 0; domain < 3; ++domain)
+      EXPECT_EQ(0, async_on(domain, get_domain).get());
+  }
+  if (nsheps >= 2) {
+    // Two domains, alternating between shepherds
+    std::vector<int> domains(nsheps);
+    for (unsigned shep = 0; shep < nsheps; ++shep)
+      domains[shep] = shep % 2;
+    shepherd_domains_t sd(domains);
+    EXPECT_EQ(2, num_domains());
+    for (int domain = -2; domain < 4; ++domain)
+      for (int n = 0; n < 4; ++n)
+        EXPECT_EQ((domain + 4) % 2, async_on(domain, get_domain).get());
+  }
+}